@@ -0,0 +1,215 @@
+/**
+ * Compression of recorded sensor traces.
+ *
+ * Each series (1-wire device or ADC channel) of the trace is encoded
+ * into compressed history blocks, then decoded and verified.  One JSON
+ * line per series reports bytes per sample and encode/decode cost.
+*/
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_history.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "node_gorilla.h"
+#include "node_trace_format.h"
+
+enum bench_history_const_internal
+{
+    BENCH_HISTORY_BLOCK_SIZE = CONFIG_BENCH_HISTORY_BLOCK_SIZE,
+    BENCH_HISTORY_MAX_RECORDS = 1 << 20,
+    /** Raw sample: 64-bit timestamp and 32-bit float */
+    BENCH_HISTORY_RAW_SAMPLE_SIZE = 12,
+    /** Compressed sample never takes more, first sample of a block included */
+    BENCH_HISTORY_MAX_SAMPLE_SIZE = 16
+};
+
+static const char *TAG = "history";
+
+/**
+ * One series of the trace.
+*/
+typedef struct bench_series
+{
+    int64_t *times;         /**< Sample times */
+    float *values;          /**< Sample values */
+    uint32_t count;         /**< Number of samples */
+    uint8_t *blocks;        /**< Compressed blocks */
+    uint32_t *block_counts; /**< Samples per block */
+} bench_series_t;
+
+static node_trace_record_t *
+bench_history_load(const char *path, uint32_t *count)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        ESP_LOGW(TAG, "No trace %s, history benchmark skipped", path);
+        return NULL;
+    }
+
+    node_trace_header_t header;
+    node_trace_record_t *records = NULL;
+    *count = 0;
+    if (fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == NODE_TRACE_MAGIC
+        && header.record_size == sizeof(node_trace_record_t))
+    {
+        records = malloc(BENCH_HISTORY_MAX_RECORDS * sizeof(node_trace_record_t));
+        while (records != NULL
+               && *count < BENCH_HISTORY_MAX_RECORDS
+               && fread(&records[*count], sizeof(records[0]), 1, file) == 1
+               && records[*count].type != NODE_TRACE_END)
+        {
+            ++*count;
+        }
+    }
+    else
+    {
+        ESP_LOGE(TAG, "%s is not a sensor trace", path);
+    }
+    fclose(file);
+    return records;
+}
+
+/**
+ * Collect readings of one record type and channel.
+*/
+static void
+bench_history_series(const node_trace_record_t *records,
+                     uint32_t count,
+                     uint8_t type,
+                     uint8_t channel,
+                     bench_series_t *series)
+{
+    series->count = 0;
+    for (uint32_t n = 0; n < count; ++n)
+    {
+        const node_trace_record_t *record = &records[n];
+        if (record->type != type || record->channel != channel || record->status != 0)
+        {
+            continue;
+        }
+        series->times[series->count] = record->time_ms;
+        series->values[series->count] = type == NODE_TRACE_ADC
+                                        ? (float)record->adc.raw
+                                        : record->temperature;
+        ++series->count;
+    }
+}
+
+static void
+bench_history_encode(const char *name, const bench_series_t *series)
+{
+    uint8_t *blocks = series->blocks;
+    uint32_t *block_counts = series->block_counts;
+    size_t bytes = 0;
+    uint32_t block_count = 0;
+    node_gorilla_encoder_t encoder;
+    node_gorilla_encoder_init(&encoder, blocks, BENCH_HISTORY_BLOCK_SIZE);
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t n = 0; n < series->count; ++n)
+    {
+        if (!node_gorilla_append(&encoder, series->times[n], series->values[n]))
+        {
+            block_counts[block_count++] = encoder.count;
+            bytes += BENCH_HISTORY_BLOCK_SIZE;
+            node_gorilla_encoder_init(&encoder, blocks + bytes, BENCH_HISTORY_BLOCK_SIZE);
+            node_gorilla_append(&encoder, series->times[n], series->values[n]);
+        }
+    }
+    int64_t encode_us = esp_timer_get_time() - start;
+    block_counts[block_count++] = encoder.count;
+    size_t encoded = bytes + node_gorilla_size(&encoder);
+
+    uint32_t decoded = 0;
+    uint32_t mismatches = 0;
+    start = esp_timer_get_time();
+    for (uint32_t b = 0; b < block_count; ++b)
+    {
+        node_gorilla_decoder_t decoder;
+        node_gorilla_decoder_init(&decoder,
+                                  blocks + b * BENCH_HISTORY_BLOCK_SIZE,
+                                  BENCH_HISTORY_BLOCK_SIZE,
+                                  block_counts[b]);
+        int64_t time;
+        float value;
+        while (node_gorilla_next(&decoder, &time, &value))
+        {
+            mismatches += time != series->times[decoded]
+                          || memcmp(&value, &series->values[decoded], sizeof(value)) != 0;
+            ++decoded;
+        }
+    }
+    int64_t decode_us = esp_timer_get_time() - start;
+
+    printf("{\"bench\": \"history\", \"series\": \"%s\", \"samples\": %" PRIu32
+           ", \"blocks\": %" PRIu32 ", \"bytes\": %zu, \"bytes_per_sample\": %.3f"
+           ", \"raw_bytes_per_sample\": %d, \"encode_ns\": %.1f, \"decode_ns\": %.1f"
+           ", \"mismatches\": %" PRIu32 "}\n",
+           name,
+           series->count,
+           block_count,
+           encoded,
+           (double)encoded / series->count,
+           BENCH_HISTORY_RAW_SAMPLE_SIZE,
+           1000.0 * encode_us / series->count,
+           1000.0 * decode_us / series->count,
+           mismatches + (series->count - decoded));
+    fflush(stdout);
+}
+
+void bench_history_run()
+{
+    uint32_t count;
+    node_trace_record_t *records = bench_history_load(CONFIG_BENCH_HISTORY_TRACE, &count);
+    if (records == NULL)
+    {
+        return;
+    }
+
+    bench_series_t series = {
+        .times = malloc(count * sizeof(int64_t)),
+        .values = malloc(count * sizeof(float)),
+        .blocks = malloc(count * BENCH_HISTORY_MAX_SAMPLE_SIZE + BENCH_HISTORY_BLOCK_SIZE),
+        .block_counts = malloc(count * sizeof(uint32_t))
+    };
+
+    static const struct
+    {
+        uint8_t type;
+        const char *name;
+    } types[] =
+    {
+        { NODE_TRACE_1WIRE_TEMP, "1wire" },
+        { NODE_TRACE_ADC, "adc" }
+    };
+
+    bool allocated = series.times != NULL
+                     && series.values != NULL
+                     && series.blocks != NULL
+                     && series.block_counts != NULL;
+    for (int t = 0; t < sizeof(types) / sizeof(types[0]) && allocated; ++t)
+    {
+        for (int channel = 0; channel < NODE_TRACE_MAX_CHANNELS; ++channel)
+        {
+            bench_history_series(records, count, types[t].type, channel, &series);
+            if (series.count == 0)
+            {
+                continue;
+            }
+
+            char name[16];
+            snprintf(name, sizeof(name), "%s/%d", types[t].name, channel);
+            bench_history_encode(name, &series);
+        }
+    }
+
+    free(series.blocks);
+    free(series.block_counts);
+    free(series.times);
+    free(series.values);
+    free(records);
+}
\ No newline at end of file
@@ -0,0 +1,3 @@
+#pragma once
+
+void bench_history_run();
\ No newline at end of file
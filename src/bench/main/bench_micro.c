@@ -0,0 +1,35 @@
+/**
+ * Microbenchmarks of the per-reading hot path.
+ *
+ * Each case is printed as one JSON line.
+*/
+#include <inttypes.h>
+#include <stdio.h>
+#include "bench_micro.h"
+#include "node_bench.h"
+#include "node_history.h"
+#include "node_network.h"
+#include "node_sensors.h"
+
+static void bench_micro_report(const node_bench_result_t *result)
+{
+    printf("{\"bench\": \"micro\", \"case\": \"%s\", \"unit\": \"%s\", \"iterations\": %" PRIu32
+           ", \"rounds\": %" PRIu32 ", \"min\": %.1f, \"median\": %.1f, \"mean\": %.1f, \"stddev\": %.1f}\n",
+           result->name,
+           result->unit,
+           result->iterations,
+           result->rounds,
+           result->min,
+           result->median,
+           result->mean,
+           result->stddev);
+    fflush(stdout);
+}
+
+void bench_micro_run()
+{
+    node_network_bench_register();
+    node_sensors_bench_register();
+    node_history_bench_register();
+    node_bench_run(NULL, &bench_micro_report);
+}
\ No newline at end of file
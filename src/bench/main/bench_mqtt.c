@@ -0,0 +1,244 @@
+/**
+ * End-to-end MQTT benchmark.
+ *
+ * Offers messages to the network layer at increasing rates through both
+ * node_mqtt_send_sensor_value() and node_mqtt_send_message(), and reports
+ * for every step sustained acknowledged rate, enqueue-to-PUBACK latency
+ * percentiles, drops and memory high-water mark.  Alarms are sent
+ * through the alarm lane meanwhile, their latency is reported separately.
+ *
+ * Each step is printed as one JSON line starting with '{', log lines
+ * never start with it, so results are extracted with grep '^{'.
+*/
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "bench_history.h"
+#include "bench_micro.h"
+#include "node_network.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <sys/resource.h>
+#else
+#include "esp_system.h"
+#include "nvs_flash.h"
+#endif
+
+enum bench_const_internal
+{
+    BENCH_DRAIN_POLL_MS = 10
+};
+
+static const char *TAG = "bench";
+
+/**
+ * Network layer entry point under test.
+*/
+typedef enum bench_api
+{
+    BENCH_API_SENSOR_VALUE,
+    BENCH_API_MESSAGE,
+    BENCH_API_COUNT
+} bench_api_t;
+
+static const char *bench_api_names[BENCH_API_COUNT] =
+{
+    "sensor_value",
+    "message"
+};
+
+/**
+ * Memory high-water mark: minimal free heap on target,
+ * maximal resident set size on host.
+*/
+static void bench_print_memory()
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("\"max_rss_kb\": %ld", usage.ru_maxrss);
+#else
+    printf("\"heap_min_free\": %" PRIu32, esp_get_minimum_free_heap_size());
+#endif
+}
+
+/**
+ * Offer messages at the given rate for the step duration.
+ *
+ * @return number of messages offered.
+*/
+static uint32_t bench_offer(bench_api_t api, uint32_t rate)
+{
+    const TickType_t ticks = pdMS_TO_TICKS(CONFIG_BENCH_STEP_DURATION_MS);
+    uint64_t due_millis = 0;
+    uint32_t sent = 0;
+
+    mqtt_message_t msg;
+    bzero(&msg, sizeof(msg));
+    strlcpy(msg.topic, "nodes/node1/bench/message", sizeof(msg.topic));
+
+    mqtt_message_t alarm;
+    bzero(&alarm, sizeof(alarm));
+    strlcpy(alarm.topic, "nodes/node1/bench/alarm", sizeof(alarm.topic));
+    const TickType_t alarm_ticks = pdMS_TO_TICKS(CONFIG_BENCH_ALARM_INTERVAL_MS);
+
+    TickType_t last_wake_time = xTaskGetTickCount();
+    for (TickType_t tick = 0; tick < ticks; ++tick)
+    {
+        due_millis += (uint64_t)rate * portTICK_PERIOD_MS;
+        for (; due_millis >= 1000; due_millis -= 1000)
+        {
+            if (api == BENCH_API_SENSOR_VALUE)
+            {
+                node_mqtt_send_sensor_value("bench", "benchmark", "", (float)(sent % 1000) / 10,
+                                            esp_timer_get_time());
+            }
+            else
+            {
+                snprintf(msg.data, sizeof(msg.data), "{\"seq\": %" PRIu32 "}", sent);
+                node_mqtt_send_message(&msg);
+            }
+            ++sent;
+        }
+        if (alarm_ticks > 0 && tick % alarm_ticks == 0)
+        {
+            snprintf(alarm.data, sizeof(alarm.data), "{\"tick\": %" PRIu32 "}", (uint32_t)tick);
+            node_network_send_alarm(&alarm, false);
+        }
+        vTaskDelayUntil(&last_wake_time, 1);
+    }
+    return sent;
+}
+
+/**
+ * Wait until all accepted messages are published and acknowledged.
+*/
+static void bench_drain(uint32_t sent)
+{
+    const int64_t deadline = esp_timer_get_time() + (int64_t)CONFIG_BENCH_DRAIN_TIMEOUT_MS * 1000;
+    while (esp_timer_get_time() < deadline)
+    {
+        node_network_burst_stats_t bursts;
+        node_network_latency_stats_t latency;
+        node_network_alarm_stats_t alarms;
+        node_network_get_burst_stats(&bursts);
+        node_network_get_latency_stats(&latency);
+        node_network_get_alarm_stats(&alarms);
+
+        if (bursts.messages + bursts.dropped >= sent &&
+            latency.hist.count + latency.unmatched >= bursts.messages &&
+            alarms.hist.count + alarms.unmatched >= alarms.queued)
+        {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(BENCH_DRAIN_POLL_MS));
+    }
+    ESP_LOGW(TAG, "Drain timeout");
+}
+
+/**
+ * Run one step and print its result.
+ *
+ * @return true if network sustained the offered rate.
+*/
+static bool bench_step(bench_api_t api, uint32_t rate)
+{
+    node_network_reset_stats();
+
+    int64_t start = esp_timer_get_time();
+    uint32_t sent = bench_offer(api, rate);
+    bench_drain(sent);
+    int64_t elapsed_us = esp_timer_get_time() - start;
+
+    node_network_burst_stats_t bursts;
+    node_network_latency_stats_t latency;
+    node_network_alarm_stats_t alarms;
+    node_network_get_burst_stats(&bursts);
+    node_network_get_latency_stats(&latency);
+    node_network_get_alarm_stats(&alarms);
+
+    uint32_t acked = latency.hist.count;
+    printf("{\"bench\": \"mqtt\", \"api\": \"%s\", \"rate\": %" PRIu32
+           ", \"elapsed_ms\": %" PRId64 ", \"sent\": %" PRIu32
+           ", \"published\": %" PRIu32 ", \"acked\": %" PRIu32
+           ", \"dropped\": %" PRIu32 ", \"unmatched\": %" PRIu32
+           ", \"msgs_per_s\": %.1f, \"p50_us\": %" PRIu32
+           ", \"p99_us\": %" PRIu32 ", \"max_us\": %" PRIu32
+           ", \"alarms\": %" PRIu32 ", \"alarms_dropped\": %" PRIu32
+           ", \"alarm_p50_us\": %" PRIu32 ", \"alarm_p99_us\": %" PRIu32
+           ", \"alarm_max_us\": %" PRIu32 ", ",
+           bench_api_names[api],
+           rate,
+           elapsed_us / 1000,
+           sent,
+           bursts.messages,
+           acked,
+           bursts.dropped,
+           latency.unmatched,
+           elapsed_us > 0 ? acked * 1e6 / elapsed_us : 0.0,
+           node_log_hist_percentile(&latency.hist, 500),
+           node_log_hist_percentile(&latency.hist, 990),
+           latency.hist.max,
+           alarms.queued,
+           alarms.dropped,
+           node_log_hist_percentile(&alarms.hist, 500),
+           node_log_hist_percentile(&alarms.hist, 990),
+           alarms.hist.max);
+    bench_print_memory();
+    printf("}\n");
+    fflush(stdout);
+
+    return (uint64_t)acked * 100 >= (uint64_t)sent * CONFIG_BENCH_SATURATION_PERCENT;
+}
+
+void app_main(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+#endif
+
+#if CONFIG_BENCH_MICRO
+    bench_micro_run();
+#endif
+
+#if CONFIG_BENCH_HISTORY
+    bench_history_run();
+#endif
+
+#if CONFIG_BENCH_MQTT
+    node_network_start();
+    if (!node_network_ready_wait(30000))
+    {
+        ESP_LOGE(TAG, "Broker %s is not reachable", CONFIG_NODE_MQTT_BROKER_URI);
+        return;
+    }
+
+    for (uint32_t rate = CONFIG_BENCH_START_RATE;
+         rate <= CONFIG_BENCH_MAX_RATE;
+         rate = (uint64_t)rate * CONFIG_BENCH_RATE_STEP_PERCENT / 100)
+    {
+        bool sustained = false;
+        for (int api = 0; api < BENCH_API_COUNT; ++api)
+        {
+            sustained |= bench_step(api, rate);
+        }
+
+        if (!sustained)
+        {
+            ESP_LOGI(TAG, "Saturated at %" PRIu32 " messages/s", rate);
+            break;
+        }
+    }
+#endif
+
+    ESP_LOGI(TAG, "Done");
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "node_history.h"
+#include "node_network.h"
+#include "node_sensors.h"
+
+void app_main(void)
+{
+  static const char *tag = "main";
+
+  node_network_start();
+#if CONFIG_NODE_HISTORY
+  if (!node_history_start())
+  {
+    ESP_LOGW(tag, "History is not available");
+  }
+#endif
+
+  node_sensors_start();
+
+  ESP_LOGI(tag, "Host node started, broker %s", CONFIG_NODE_MQTT_BROKER_URI);
+}
\ No newline at end of file
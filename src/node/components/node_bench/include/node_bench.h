@@ -0,0 +1,79 @@
+#pragma once
+/**
+ * Microbenchmark harness.
+ *
+ * Components register benchmark cases for their hot-path primitives.
+ * Each case is run for a fixed number of rounds, each round executes the
+ * primitive a fixed number of iterations; per-iteration cost of every
+ * round is a sample for statistics.
+ *
+ * Cost is measured in CPU cycles on target and in nanoseconds on host.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Constants for microbenchmarks.
+*/
+enum node_bench_const
+{
+    NODE_BENCH_MAX_CASES = 16,  /**< Registered cases limit */
+    NODE_BENCH_ROUNDS = 16      /**< Rounds per case */
+};
+
+/**
+ * Benchmark case.
+*/
+typedef struct node_bench_case
+{
+    const char *name;           /**< Case name */
+    uint32_t iterations;        /**< Iterations per round */
+    void (*setup)(void);        /**< Called before the rounds, may be NULL */
+    void (*run)(uint32_t n);    /**< Execute the primitive n times */
+    void (*teardown)(void);     /**< Called after the rounds, may be NULL */
+} node_bench_case_t;
+
+/**
+ * Result of the case, per-iteration cost statistics over the rounds.
+*/
+typedef struct node_bench_result
+{
+    const char *name;           /**< Case name */
+    const char *unit;           /**< "cycles" or "ns" */
+    uint32_t iterations;        /**< Iterations per round */
+    uint32_t rounds;            /**< Number of rounds */
+    double min;                 /**< Minimal cost */
+    double median;              /**< Median cost */
+    double mean;                /**< Mean cost */
+    double stddev;              /**< Standard deviation of cost */
+} node_bench_result_t;
+
+/**
+ * Report the result of the case.
+*/
+typedef void (*node_bench_report_t)(const node_bench_result_t *result);
+
+/**
+ * Register benchmark case.
+ *
+ * Case descriptor must stay valid, cases are never removed.
+ *
+ * @return true if registered, false if cases table is full.
+*/
+bool
+node_bench_register(const node_bench_case_t *bench);
+
+/**
+ * Run registered cases.
+ *
+ * @filter  run only cases which name contains filter, NULL for all
+ * @report  called with the result of each case
+ * @return number of cases run
+*/
+int
+node_bench_run(const char *filter, node_bench_report_t report);
+
+/**
+ * Prevent compiler from optimizing away the value computed by primitive.
+*/
+#define NODE_BENCH_CLOBBER() __asm__ volatile("" ::: "memory")
@@ -0,0 +1,149 @@
+#include <math.h>
+#include <string.h>
+#include "esp_idf_version.h"
+#include "freertos/FreeRTOS.h"
+#include "node_bench.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#elif ESP_IDF_VERSION_MAJOR >= 5
+#include "esp_cpu.h"
+#else
+#include "soc/cpu.h"
+#endif
+
+static const node_bench_case_t* bench_cases[NODE_BENCH_MAX_CASES];
+static int bench_cases_count = 0;
+static portMUX_TYPE bench_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if CONFIG_IDF_TARGET_LINUX
+static const char *BENCH_UNIT = "ns";
+
+static inline uint64_t bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#else
+static const char *BENCH_UNIT = "cycles";
+
+static inline uint64_t bench_now()
+{
+#if ESP_IDF_VERSION_MAJOR >= 5
+    return esp_cpu_get_cycle_count();
+#else
+    return esp_cpu_get_ccount();
+#endif
+}
+#endif
+
+static void bench_sort(double *values, int count)
+{
+    for (int i = 1; i < count; ++i)
+    {
+        double value = values[i];
+        int j = i;
+        for (; j > 0 && values[j - 1] > value; --j)
+        {
+            values[j] = values[j - 1];
+        }
+        values[j] = value;
+    }
+}
+
+static void bench_run_case(const node_bench_case_t *bench, node_bench_result_t *result)
+{
+    double samples[NODE_BENCH_ROUNDS];
+
+    if (bench->setup != NULL)
+    {
+        bench->setup();
+    }
+
+    /* Warm up caches and branch predictors. */
+    bench->run(bench->iterations);
+
+    for (int round = 0; round < NODE_BENCH_ROUNDS; ++round)
+    {
+        /* 32-bit cycle counter wraps, so the difference is taken modulo 2^32 on target. */
+        uint64_t start = bench_now();
+        bench->run(bench->iterations);
+        uint64_t elapsed = bench_now() - start;
+#if !CONFIG_IDF_TARGET_LINUX
+        elapsed &= UINT32_MAX;
+#endif
+        samples[round] = (double)elapsed / bench->iterations;
+    }
+
+    if (bench->teardown != NULL)
+    {
+        bench->teardown();
+    }
+
+    double sum = 0;
+    double sum_sq = 0;
+    for (int round = 0; round < NODE_BENCH_ROUNDS; ++round)
+    {
+        sum += samples[round];
+        sum_sq += samples[round] * samples[round];
+    }
+    bench_sort(samples, NODE_BENCH_ROUNDS);
+
+    result->name = bench->name;
+    result->unit = BENCH_UNIT;
+    result->iterations = bench->iterations;
+    result->rounds = NODE_BENCH_ROUNDS;
+    result->min = samples[0];
+    result->median = (samples[(NODE_BENCH_ROUNDS - 1) / 2] + samples[NODE_BENCH_ROUNDS / 2]) / 2;
+    result->mean = sum / NODE_BENCH_ROUNDS;
+    double variance = sum_sq / NODE_BENCH_ROUNDS - result->mean * result->mean;
+    result->stddev = sqrt(variance > 0 ? variance : 0);
+}
+
+bool
+node_bench_register(const node_bench_case_t *bench)
+{
+    bool registered = false;
+
+    portENTER_CRITICAL(&bench_lock);
+    for (int n = 0; n < bench_cases_count; ++n)
+    {
+        if (bench_cases[n] == bench)
+        {
+            /* Already registered. */
+            portEXIT_CRITICAL(&bench_lock);
+            return true;
+        }
+    }
+    if (bench_cases_count < NODE_BENCH_MAX_CASES)
+    {
+        bench_cases[bench_cases_count++] = bench;
+        registered = true;
+    }
+    portEXIT_CRITICAL(&bench_lock);
+
+    return registered;
+}
+
+int
+node_bench_run(const char *filter, node_bench_report_t report)
+{
+    int count = 0;
+
+    /* Cases are never removed, so the table may be walked unlocked. */
+    for (int n = 0; n < bench_cases_count; ++n)
+    {
+        const node_bench_case_t *bench = bench_cases[n];
+        if (filter != NULL && strstr(bench->name, filter) == NULL)
+        {
+            continue;
+        }
+
+        node_bench_result_t result;
+        bench_run_case(bench, &result);
+        report(&result);
+        ++count;
+    }
+
+    return count;
+}
\ No newline at end of file
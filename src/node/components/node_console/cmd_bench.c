@@ -0,0 +1,278 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "argtable3/argtable3.h"
+#include "cmd_bench.h"
+#include "cmd_remote.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "node_bench.h"
+#include "node_history.h"
+#include "node_network.h"
+#include "node_sensors.h"
+#include "node_tasks.h"
+
+enum bench_const_internal
+{
+    BENCH_TASK_STACK = 3072,
+    BENCH_DEFAULT_PERIOD_MS = 100,
+    BENCH_DEFAULT_SAMPLES = 100,
+    BENCH_DEFAULT_RATE = 50
+};
+
+static const char *TAG = "bench";
+
+/** Arguments used by 'bench.micro' function */
+static struct {
+    struct arg_str *filter;
+    struct arg_end *end;
+} micro_args;
+
+/** Arguments used by 'bench.jitter' function */
+static struct {
+    struct arg_int *period;
+    struct arg_int *samples;
+    struct arg_int *rate;
+    struct arg_end *end;
+} jitter_args;
+
+/**
+ * Jitter benchmark state shared by sampler and load tasks.
+ */
+typedef struct bench_jitter
+{
+    int period_ms;              /**< Nominal sample period */
+    int samples;                /**< Number of samples to take */
+    int rate;                   /**< Synthetic publish rate, messages/s */
+    volatile bool done;         /**< Sampler finished, load must stop */
+    TaskHandle_t owner;         /**< Task waiting for the result */
+    TaskHandle_t load_task;     /**< Load generator task */
+    int64_t min_us;             /**< Minimal interval deviation */
+    int64_t max_us;             /**< Maximal interval deviation */
+    double sum_us;              /**< Sum of deviations */
+    double sum_sq_us;           /**< Sum of squared deviations */
+    uint32_t sent;              /**< Synthetic messages generated */
+} bench_jitter_t;
+
+/**
+ * Sampler runs with the same core and priority as sensor tasks and
+ * measures deviation of actual sample interval from the nominal one.
+ */
+static void bench_sampler_task(void *arg)
+{
+    bench_jitter_t *bench = arg;
+    const int64_t period_us = (int64_t)bench->period_ms * 1000;
+
+    TickType_t last_wake_time = xTaskGetTickCount();
+    vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(bench->period_ms));
+    int64_t prev = esp_timer_get_time();
+    for (int n = 0; n < bench->samples; ++n)
+    {
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(bench->period_ms));
+        int64_t now = esp_timer_get_time();
+        int64_t deviation = now - prev - period_us;
+        prev = now;
+
+        bench->min_us = deviation < bench->min_us ? deviation : bench->min_us;
+        bench->max_us = deviation > bench->max_us ? deviation : bench->max_us;
+        bench->sum_us += deviation;
+        bench->sum_sq_us += (double)deviation * deviation;
+    }
+
+    bench->done = true;
+    xTaskNotifyGive(bench->owner);
+    vTaskDelete(NULL);
+}
+
+/**
+ * Load generator publishes synthetic messages with the same core and
+ * priority as MQTT publisher.
+ */
+static void bench_load_task(void *arg)
+{
+    bench_jitter_t *bench = arg;
+    TickType_t last_wake_time = xTaskGetTickCount();
+    TickType_t period = pdMS_TO_TICKS(1000 / bench->rate);
+    if (period == 0)
+    {
+        period = 1;
+    }
+    const int per_period = bench->rate * period * portTICK_PERIOD_MS / 1000;
+
+    mqtt_message_t msg;
+    bzero(&msg, sizeof(msg));
+    strlcpy(msg.topic, "nodes/node1/bench/load", sizeof(msg.topic));
+    while (!bench->done)
+    {
+        for (int n = 0; n < (per_period > 0 ? per_period : 1); ++n)
+        {
+            snprintf(msg.data, sizeof(msg.data), "{\"seq\": %u}", bench->sent++);
+            node_mqtt_send_message(&msg);
+        }
+        vTaskDelayUntil(&last_wake_time, period);
+    }
+
+    xTaskNotifyGive(bench->owner);
+    vTaskDelete(NULL);
+}
+
+static int cmd_bench_jitter(int argc, char **argv)
+{
+    jitter_args.period->ival[0] = BENCH_DEFAULT_PERIOD_MS;
+    jitter_args.samples->ival[0] = BENCH_DEFAULT_SAMPLES;
+    jitter_args.rate->ival[0] = BENCH_DEFAULT_RATE;
+
+    int nerrors = arg_parse(argc, argv, (void **) &jitter_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, jitter_args.end, argv[0]);
+        return 1;
+    }
+
+    static bench_jitter_t bench;
+    bzero(&bench, sizeof(bench));
+    bench.period_ms = jitter_args.period->ival[0];
+    bench.samples = jitter_args.samples->ival[0];
+    bench.rate = jitter_args.rate->ival[0];
+    bench.min_us = INT64_MAX;
+    bench.max_us = INT64_MIN;
+    bench.owner = xTaskGetCurrentTaskHandle();
+
+    if (bench.period_ms < portTICK_PERIOD_MS || bench.samples <= 0 || bench.rate < 0)
+    {
+        printf("Invalid arguments\r\n");
+        return 1;
+    }
+
+    node_network_burst_stats_t before;
+    node_network_get_burst_stats(&before);
+
+    node_task_info_t sensors;
+    node_task_info_t network;
+    node_task_get_info(NODE_TASK_1WIRE, &sensors);
+    node_task_get_info(NODE_TASK_MQTT, &network);
+
+    if (bench.rate > 0 &&
+        xTaskCreatePinnedToCore(&bench_load_task, "bench_load", BENCH_TASK_STACK, &bench,
+                                network.priority, &bench.load_task, network.core) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Cannot start load task");
+        return 1;
+    }
+
+    if (xTaskCreatePinnedToCore(&bench_sampler_task, "bench_sampler", BENCH_TASK_STACK, &bench,
+                                sensors.priority, NULL, sensors.core) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Cannot start sampler task");
+        bench.done = true;
+        if (bench.load_task != NULL)
+        {
+            ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+        }
+        return 1;
+    }
+
+    /* Wait for sampler, then for load generator to stop.  Both may
+       notify before this task wakes, so take one count at a time. */
+    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    if (bench.load_task != NULL)
+    {
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    }
+
+    node_network_burst_stats_t after;
+    node_network_get_burst_stats(&after);
+
+    double mean = bench.sum_us / bench.samples;
+    double variance = bench.sum_sq_us / bench.samples - mean * mean;
+    printf("Sampler: core %d, prio %u; load: core %d, prio %u, %d msg/s\r\n",
+           sensors.core == tskNO_AFFINITY ? -1 : sensors.core,
+           sensors.priority,
+           network.core == tskNO_AFFINITY ? -1 : network.core,
+           network.priority,
+           bench.rate);
+    printf("Period %d ms, %d samples\r\n", bench.period_ms, bench.samples);
+    printf("Deviation, us: min %lld, max %lld, mean %.1f, stddev %.1f\r\n",
+           bench.min_us,
+           bench.max_us,
+           mean,
+           sqrt(variance > 0 ? variance : 0));
+    printf("Load: %u generated, %u dropped\r\n",
+           bench.sent,
+           after.dropped - before.dropped);
+    return 0;
+}
+
+
+static void bench_micro_report(const node_bench_result_t *result)
+{
+    printf("%-28s %6u x %2u: min %10.1f, median %10.1f, mean %10.1f, stddev %8.1f %s\r\n",
+           result->name,
+           result->iterations,
+           result->rounds,
+           result->min,
+           result->median,
+           result->mean,
+           result->stddev,
+           result->unit);
+}
+
+static int cmd_bench_micro(int argc, char **argv)
+{
+    micro_args.filter->sval[0] = "";
+
+    int nerrors = arg_parse(argc, argv, (void **) &micro_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, micro_args.end, argv[0]);
+        return 1;
+    }
+
+    node_network_bench_register();
+    node_sensors_bench_register();
+    node_history_bench_register();
+
+    const char *filter = micro_args.filter->sval[0];
+    if (node_bench_run(filter[0] ? filter : NULL, &bench_micro_report) == 0)
+    {
+        printf("No benchmarks match '%s'\r\n", filter);
+        return 1;
+    }
+    return 0;
+}
+
+
+void register_bench()
+{
+    jitter_args.period = arg_int0("p", "period", "<ms>", "Sample period, ms");
+    jitter_args.samples = arg_int0("n", "samples", "<n>", "Number of samples");
+    jitter_args.rate = arg_int0("r", "rate", "<msg/s>", "Synthetic publish rate, 0 - no load");
+    jitter_args.end = arg_end(3);
+
+    const esp_console_cmd_t jitter_cmd = {
+        .command = "bench.jitter",
+        .help = "Measure sample interval deviation under synthetic publish load.\n"
+        "Sampler uses core and priority of sensor tasks, load generator\n"
+        "uses core and priority of MQTT publisher.\n"
+        "Example: bench.jitter -p 100 -n 200 -r 50",
+        .hint = NULL,
+        .func = &cmd_bench_jitter,
+        .argtable = &jitter_args
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&jitter_cmd) );
+
+    micro_args.filter = arg_str0(NULL, NULL, "<filter>", "Run only cases which name contains filter");
+    micro_args.end = arg_end(1);
+
+    const esp_console_cmd_t micro_cmd = {
+        .command = "bench.micro",
+        .help = "Run microbenchmarks of formatting, queue and registry primitives.\n"
+        "Cost per iteration is reported in CPU cycles.\n"
+        "Example: bench.micro mqtt.",
+        .hint = NULL,
+        .func = &cmd_bench_micro,
+        .argtable = &micro_args
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&micro_cmd) );
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include "argtable3/argtable3.h"
+#include "cmd_history.h"
+#include "cmd_remote.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "node_history.h"
+
+static struct {
+    struct arg_str *sensor;
+    struct arg_int *minutes;
+    struct arg_int *limit;
+    struct arg_end *end;
+} query_args;
+
+static int cmd_history_stats(int argc, char **argv)
+{
+    node_history_stats_t stats;
+    node_history_get_stats(&stats);
+    printf("Segments: %" PRIu32 ", %" PRIu32 " bytes, %" PRIu32 " blocks, %" PRIu32 " sensors\r\n",
+           stats.segments, stats.bytes, stats.blocks, stats.sensors);
+    printf("Time range: %" PRId64 " .. %" PRId64 " ms\r\n", stats.first_ms, stats.last_ms);
+    printf("Samples: %" PRIu32 ", pending blocks: %" PRIu32 ", dropped: %" PRIu32 ", errors: %" PRIu32 "\r\n",
+           stats.samples, stats.pending, stats.dropped, stats.errors);
+    return 0;
+}
+
+static bool print_sample(int64_t time_ms, float value, void *arg)
+{
+    int *left = (int *)arg;
+    printf("%" PRId64 " %g\r\n", time_ms, value);
+    return --*left > 0;
+}
+
+static int cmd_history_query(int argc, char **argv)
+{
+    query_args.minutes->ival[0] = 60;
+    query_args.limit->ival[0] = 100;
+
+    int nerrors = arg_parse(argc, argv, (void **) &query_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, query_args.end, argv[0]);
+        return 1;
+    }
+
+    int64_t to = node_history_now_ms();
+    int64_t from = to - (int64_t)query_args.minutes->ival[0] * 60000;
+    int left = query_args.limit->ival[0];
+    if (left <= 0) {
+        return 0;
+    }
+    uint32_t count = node_history_query(query_args.sensor->sval[0], from, to, NULL, &print_sample, &left);
+    printf("%" PRIu32 " samples\r\n", count);
+    return 0;
+}
+
+void register_history()
+{
+    const esp_console_cmd_t stats_cmd = {
+        .command = "history.stats",
+        .help = "Show history log usage",
+        .hint = NULL,
+        .func = &cmd_history_stats,
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&stats_cmd) );
+
+    query_args.sensor = arg_str1(NULL, NULL, "<sensor>", "Sensor name");
+    query_args.minutes = arg_int0("m", "minutes", "<n>", "Time range back from now, default 60");
+    query_args.limit = arg_int0("n", "limit", "<n>", "Maximum samples to print, default 100");
+    query_args.end = arg_end(2);
+
+    const esp_console_cmd_t query_cmd = {
+        .command = "history.query",
+        .help = "Print stored samples of the sensor, oldest first",
+        .hint = NULL,
+        .func = &cmd_history_query,
+        .argtable = &query_args
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&query_cmd) );
+}
\ No newline at end of file
@@ -0,0 +1,3 @@
+#pragma once
+
+void register_history();
\ No newline at end of file
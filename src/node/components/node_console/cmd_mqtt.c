@@ -0,0 +1,154 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include "argtable3/argtable3.h"
+#include "cmd_mqtt.h"
+#include "cmd_remote.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "node_network.h"
+
+/** Arguments used by 'mqtt.brokers' function */
+static struct {
+    struct arg_str *uris;
+    struct arg_lit *clear;
+    struct arg_end *end;
+} brokers_args;
+
+static int cmd_mqtt_stats(int argc, char **argv)
+{
+    static const char *buckets[NODE_NETWORK_BURST_BUCKETS] =
+    {
+        "1", "2-3", "4-7", "8-15", "16-31", "32+"
+    };
+
+    node_network_burst_stats_t stats;
+    node_network_get_burst_stats(&stats);
+
+    printf("Burst interval: %u ms\r\n", stats.interval_ms);
+    printf("Bursts: %u (%u early), messages: %u, dropped: %u\r\n",
+           stats.bursts,
+           stats.early_bursts,
+           stats.messages,
+           stats.dropped);
+    printf("Burst size: avg %.1f, max %u\r\n",
+           stats.bursts ? (float)stats.messages / stats.bursts : 0.0f,
+           stats.max_burst);
+    printf("Active time: total %llu us, avg %llu us, max %u us\r\n",
+           stats.active_us,
+           stats.bursts ? stats.active_us / stats.bursts : 0,
+           stats.max_active_us);
+    for (int i = 0; i < NODE_NETWORK_BURST_BUCKETS; ++i)
+    {
+        printf("%6s: %u\r\n", buckets[i], stats.size_hist[i]);
+    }
+
+    node_network_latency_stats_t latency;
+    node_network_get_latency_stats(&latency);
+    printf("Latency to PUBACK, us: p50 %u, p99 %u, max %u (%u acked, %u unmatched)\r\n",
+           node_log_hist_percentile(&latency.hist, 500),
+           node_log_hist_percentile(&latency.hist, 990),
+           latency.hist.max,
+           latency.hist.count,
+           latency.unmatched);
+
+    node_network_alarm_stats_t alarms;
+    node_network_get_alarm_stats(&alarms);
+    printf("Alarms: %u queued, %u dropped\r\n", alarms.queued, alarms.dropped);
+    printf("Alarm latency to PUBACK, us: p50 %u, p99 %u, max %u (%u acked, %u unmatched)\r\n",
+           node_log_hist_percentile(&alarms.hist, 500),
+           node_log_hist_percentile(&alarms.hist, 990),
+           alarms.hist.max,
+           alarms.hist.count,
+           alarms.unmatched);
+
+    node_network_connect_stats_t connect;
+    node_network_get_connect_stats(&connect);
+    printf("Connects: %u attempts, %u failed, %s%s\r\n",
+           connect.attempts,
+           connect.failed,
+           connect.tls ? "TLS" : "plain",
+           connect.resumption ? " with session resumption" : "");
+    printf("  full, us: p50 %u, p99 %u, max %u (%u), heap %u bytes\r\n",
+           node_log_hist_percentile(&connect.full, 500),
+           node_log_hist_percentile(&connect.full, 990),
+           connect.full.max,
+           connect.full.count,
+           connect.heap_full);
+    if (connect.resumption)
+    {
+        printf("  session offered, us: p50 %u, p99 %u, max %u (%u), heap %u bytes\r\n",
+               node_log_hist_percentile(&connect.offered, 500),
+               node_log_hist_percentile(&connect.offered, 990),
+               connect.offered.max,
+               connect.offered.count,
+               connect.heap_offered);
+    }
+    return 0;
+}
+
+static int cmd_mqtt_brokers(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **) &brokers_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, brokers_args.end, argv[0]);
+        return 1;
+    }
+
+    if (brokers_args.uris->count > 0 || brokers_args.clear->count > 0) {
+        if (!node_network_set_brokers(brokers_args.uris->sval, brokers_args.uris->count)) {
+            printf("Invalid broker list or NVS error\r\n");
+            return 1;
+        }
+    }
+
+    node_network_broker_stats_t stats;
+    for (int n = 0; node_network_get_broker_stats(n, &stats); ++n) {
+        printf("%c %d %s\r\n", stats.current ? '*' : ' ', n, stats.uri);
+        printf("    connects %" PRIu32 ", failures %" PRIu32 " (%" PRIu32 " in a row)"
+               ", connect %" PRIu32 " us, rtt %" PRIu32 " us, retry in %" PRIu32 " ms\r\n",
+               stats.connects,
+               stats.failures,
+               stats.consecutive,
+               stats.connect_us,
+               stats.rtt_us,
+               stats.retry_ms);
+    }
+
+    node_network_failover_stats_t failover;
+    node_network_get_failover_stats(&failover);
+    printf("Failovers: %" PRIu32 ", switches to healthier broker: %" PRIu32 "\r\n",
+           failover.failovers,
+           failover.switches);
+    printf("Outage, us: p50 %" PRIu32 ", p99 %" PRIu32 ", max %" PRIu32 " (%" PRIu32 ")\r\n",
+           node_log_hist_percentile(&failover.outage, 500),
+           node_log_hist_percentile(&failover.outage, 990),
+           failover.outage.max,
+           failover.outage.count);
+    return 0;
+}
+
+void register_mqtt()
+{
+    const esp_console_cmd_t stats_cmd = {
+        .command = "mqtt.stats",
+        .help = "Show MQTT publish burst, alarm and connection statistics",
+        .hint = NULL,
+        .func = &cmd_mqtt_stats,
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&stats_cmd) );
+
+    brokers_args.uris = arg_strn(NULL, NULL, "<uri>", 0, NODE_NETWORK_MAX_BROKERS, "Primary broker, then fallbacks");
+    brokers_args.clear = arg_lit0("c", "clear", "Restore the configured broker");
+    brokers_args.end = arg_end(2);
+
+    const esp_console_cmd_t brokers_cmd = {
+        .command = "mqtt.brokers",
+        .help = "Show broker health and failover statistics, or set the broker list.\n"
+        "The list is stored in NVS, URIs need the port.\n"
+        "Example: mqtt.brokers mqtt://10.0.0.2:1883 mqtt://10.0.0.3:1883",
+        .hint = NULL,
+        .func = &cmd_mqtt_brokers,
+        .argtable = &brokers_args
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&brokers_cmd) );
+}
\ No newline at end of file
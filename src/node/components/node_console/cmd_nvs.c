@@ -19,6 +19,7 @@
 #include "freertos/event_groups.h"
 #include "esp_err.h"
 #include "cmd_nvs.h"
+#include "cmd_remote.h"
 #include "nvs.h"
 
 typedef struct {
@@ -589,10 +590,10 @@ void register_nvs(void)
         .argtable = &list_args
     };
 
-    ESP_ERROR_CHECK(esp_console_cmd_register(&set_cmd));
-    ESP_ERROR_CHECK(esp_console_cmd_register(&get_cmd));
-    ESP_ERROR_CHECK(esp_console_cmd_register(&erase_cmd));
-    ESP_ERROR_CHECK(esp_console_cmd_register(&namespace_cmd));
-    ESP_ERROR_CHECK(esp_console_cmd_register(&list_entries_cmd));
-    ESP_ERROR_CHECK(esp_console_cmd_register(&erase_namespace_cmd));
+    ESP_ERROR_CHECK(console_cmd_register(&set_cmd));
+    ESP_ERROR_CHECK(console_cmd_register(&get_cmd));
+    ESP_ERROR_CHECK(console_cmd_register(&erase_cmd));
+    ESP_ERROR_CHECK(console_cmd_register(&namespace_cmd));
+    ESP_ERROR_CHECK(console_cmd_register(&list_entries_cmd));
+    ESP_ERROR_CHECK(console_cmd_register(&erase_namespace_cmd));
 }
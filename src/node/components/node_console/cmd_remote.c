@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <string.h>
+#include "cmd_remote.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "node_network.h"
+#include "node_tasks.h"
+
+enum cmd_remote_const_internal
+{
+    REMOTE_MAX_COMMANDS = 48,
+    REMOTE_MAX_ARGS = 16,
+    REMOTE_MAX_ID = 24,
+    REMOTE_MAX_LINE = 256,
+    REMOTE_MAX_OUTPUT = 512,
+    REMOTE_QUEUE_LENGTH = 2,
+    REMOTE_SEND_RETRY_MS = 100,
+    REMOTE_SEND_ATTEMPTS = 50,
+    REMOTE_TASK_STACK = 4096
+};
+
+static const char *TAG = "remote";
+
+static const char *REMOTE_REQUEST_TOPIC = "nodes/node1/console/request/#";
+static const char *REMOTE_REQUEST_PREFIX = "nodes/node1/console/request/";
+#if CONFIG_NODE_CONSOLE_REMOTE
+static const char *REMOTE_ALLOWED_COMMANDS = CONFIG_NODE_CONSOLE_REMOTE_COMMANDS;
+#else
+static const char *REMOTE_ALLOWED_COMMANDS = "";
+#endif
+
+/**
+ * Command line received from the broker.
+*/
+typedef struct remote_request
+{
+    char id[REMOTE_MAX_ID];         /** Request id from the topic */
+    char line[REMOTE_MAX_LINE];     /** Command line */
+} remote_request_t;
+
+static esp_console_cmd_t remote_commands[REMOTE_MAX_COMMANDS];
+static int remote_commands_count = 0;
+
+/* Handlers keep argtables and state in statics, one command runs at a time. */
+static SemaphoreHandle_t console_lock = NULL;
+static StaticSemaphore_t console_lock_buffer;
+
+static QueueHandle_t remote_queue_handle;
+static StaticQueue_t remote_queue;
+static uint8_t remote_queue_buf[ REMOTE_QUEUE_LENGTH * sizeof(remote_request_t) ];
+
+/* Used by the worker only */
+static remote_request_t remote_request;
+static char remote_output[REMOTE_MAX_OUTPUT + 1];
+static char remote_response[NODE_NETWORK_BULK_MAX_LEN];
+
+static const esp_console_cmd_t *remote_find(const char *name)
+{
+    for (int n = 0; n < remote_commands_count; ++n) {
+        if (strcmp(remote_commands[n].command, name) == 0) {
+            return &remote_commands[n];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * REPL entry of registered commands, takes turns with the remote worker.
+*/
+static int console_cmd_locked(int argc, char **argv)
+{
+    const esp_console_cmd_t *cmd = remote_find(argv[0]);
+    xSemaphoreTake(console_lock, portMAX_DELAY);
+    int ret = cmd->func(argc, argv);
+    xSemaphoreGive(console_lock);
+    return ret;
+}
+
+esp_err_t console_cmd_register(const esp_console_cmd_t *cmd)
+{
+    /* Commands are registered from console_run() before the REPL and the worker start. */
+    if (console_lock == NULL) {
+        console_lock = xSemaphoreCreateMutexStatic(&console_lock_buffer);
+    }
+    if (remote_commands_count == REMOTE_MAX_COMMANDS) {
+        ESP_LOGW(TAG, "Command %s is not available remotely", cmd->command);
+        return esp_console_cmd_register(cmd);
+    }
+    remote_commands[remote_commands_count++] = *cmd;
+
+    esp_console_cmd_t locked = *cmd;
+    locked.func = &console_cmd_locked;
+    return esp_console_cmd_register(&locked);
+}
+
+static void remote_topic(const char *id, char *topic, size_t size)
+{
+    snprintf(topic, size, "nodes/node1/console/response/%s", id);
+}
+
+static void remote_send(const char *id, const char *data)
+{
+    char topic[MQTT_MAX_TOPIC_LEN];
+    remote_topic(id, topic, sizeof(topic));
+
+    /* Bulk lane refuses while telemetry needs the queue, try for a while. */
+    for (int attempt = 0; attempt < REMOTE_SEND_ATTEMPTS; ++attempt) {
+        if (node_network_send_bulk(topic, data)) {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(REMOTE_SEND_RETRY_MS));
+    }
+    ESP_LOGW(TAG, "Response to %s dropped", id);
+}
+
+/**
+ * Accept command line from MQTT task, the worker runs it.
+*/
+static void remote_on_request(const char *topic, int topic_len, const char *data, int data_len, void *arg)
+{
+    remote_request_t request;
+    size_t prefix_len = strlen(REMOTE_REQUEST_PREFIX);
+    int id_len = topic_len - prefix_len;
+    if (id_len <= 0 || id_len >= sizeof(request.id) || memchr(topic + prefix_len, '/', id_len)) {
+        ESP_LOGW(TAG, "Bad request topic %.*s", topic_len, topic);
+        return;
+    }
+    memcpy(request.id, topic + prefix_len, id_len);
+    request.id[id_len] = '\0';
+
+    if (data_len >= sizeof(request.line)) {
+        /* Single attempt, MQTT task must not wait. */
+        char response[MQTT_MAX_TOPIC_LEN];
+        char data[MQTT_MAX_DATA_LEN];
+        remote_topic(request.id, response, sizeof(response));
+        snprintf(data, sizeof(data),
+                 "{\"id\": \"%s\", \"ret\": -1, \"truncated\": false, \"output\": \"Command too long\"}",
+                 request.id);
+        node_network_send_bulk(response, data);
+        return;
+    }
+    memcpy(request.line, data, data_len);
+    request.line[data_len] = '\0';
+
+    if (xQueueSend(remote_queue_handle, &request, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Request %s dropped, worker is busy", request.id);
+    }
+}
+
+/**
+ * Check if the command may be run remotely.
+*/
+static bool remote_allowed(const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = REMOTE_ALLOWED_COMMANDS + strspn(REMOTE_ALLOWED_COMMANDS, " ");
+    while (*p != '\0') {
+        size_t word = strcspn(p, " ");
+        if (word == len && strncmp(p, name, len) == 0) {
+            return true;
+        }
+        p += word;
+        p += strspn(p, " ");
+    }
+    return false;
+}
+
+static int remote_help()
+{
+    for (int n = 0; n < remote_commands_count; ++n) {
+        if (remote_allowed(remote_commands[n].command)) {
+            printf("%s\n", remote_commands[n].command);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Run the command with stdout and stderr of the worker redirected to
+ * the output buffer.  Standard streams are per task, other tasks still
+ * print to the console.
+*/
+static int remote_run(char *line, bool *truncated)
+{
+    char *argv[REMOTE_MAX_ARGS];
+    size_t argc = esp_console_split_argv(line, argv, REMOTE_MAX_ARGS);
+
+    FILE *out = fmemopen(remote_output, sizeof(remote_output), "w");
+    if (out == NULL) {
+        strlcpy(remote_output, "cannot capture output", sizeof(remote_output));
+        *truncated = false;
+        return -1;
+    }
+    FILE *saved_stdout = stdout;
+    FILE *saved_stderr = stderr;
+    stdout = out;
+    stderr = out;
+
+    int ret = 0;
+    const esp_console_cmd_t *cmd = argc > 0 && remote_allowed(argv[0]) ? remote_find(argv[0]) : NULL;
+    if (argc == 0) {
+        printf("Empty command\n");
+        ret = -1;
+    } else if (strcmp(argv[0], "help") == 0) {
+        ret = remote_help();
+    } else if (cmd == NULL) {
+        printf("Unrecognized command or not allowed remotely\n");
+        ret = -1;
+    } else {
+        xSemaphoreTake(console_lock, portMAX_DELAY);
+        ret = cmd->func(argc, argv);
+        xSemaphoreGive(console_lock);
+    }
+
+    fflush(out);
+    long len = ftell(out);
+    stdout = saved_stdout;
+    stderr = saved_stderr;
+    fclose(out);
+
+    *truncated = len >= REMOTE_MAX_OUTPUT;
+    remote_output[len < REMOTE_MAX_OUTPUT ? len : REMOTE_MAX_OUTPUT] = '\0';
+    return ret;
+}
+
+/**
+ * Format the response, output is JSON-escaped and cut to fit.
+*/
+static void remote_format(const char *id, int ret, bool truncated)
+{
+    /* Reserve room for the closing quote and brace. */
+    const size_t end = sizeof(remote_response) - 3;
+    size_t len = snprintf(remote_response, sizeof(remote_response),
+                          "{\"id\": \"%s\", \"ret\": %d, \"truncated\": %s, \"output\": \"",
+                          id, ret, truncated ? "true" : "false");
+
+    for (const char *p = remote_output; *p != '\0'; ++p) {
+        char escaped[8];
+        int n;
+        switch (*p) {
+        case '"':  n = snprintf(escaped, sizeof(escaped), "\\\""); break;
+        case '\\': n = snprintf(escaped, sizeof(escaped), "\\\\"); break;
+        case '\n': n = snprintf(escaped, sizeof(escaped), "\\n"); break;
+        case '\r': n = 0; break;
+        case '\t': n = snprintf(escaped, sizeof(escaped), "\\t"); break;
+        default:
+            n = (unsigned char)*p < 0x20
+                ? snprintf(escaped, sizeof(escaped), "\\u%04x", *p)
+                : snprintf(escaped, sizeof(escaped), "%c", *p);
+            break;
+        }
+        if (len + n > end) {
+            break;
+        }
+        memcpy(remote_response + len, escaped, n);
+        len += n;
+    }
+    snprintf(remote_response + len, sizeof(remote_response) - len, "\"}");
+}
+
+static void remote_task(void *arg)
+{
+    while (true) {
+        if (xQueueReceive(remote_queue_handle, &remote_request, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+
+        ESP_LOGI(TAG, "Request %s: %s", remote_request.id, remote_request.line);
+        bool truncated;
+        int ret = remote_run(remote_request.line, &truncated);
+        remote_format(remote_request.id, ret, truncated);
+        remote_send(remote_request.id, remote_response);
+    }
+}
+
+static StackType_t remote_task_stack[REMOTE_TASK_STACK];
+
+void register_remote()
+{
+    remote_queue_handle = xQueueCreateStatic(REMOTE_QUEUE_LENGTH,
+                                             sizeof(remote_request_t),
+                                             remote_queue_buf,
+                                             &remote_queue);
+    if (node_task_start(NODE_TASK_REMOTE, &remote_task, NULL,
+                        remote_task_stack, sizeof(remote_task_stack)) != NULL) {
+        node_network_handle(REMOTE_REQUEST_TOPIC, &remote_on_request, NULL);
+    }
+}
\ No newline at end of file
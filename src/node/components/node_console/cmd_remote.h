@@ -0,0 +1,29 @@
+#pragma once
+/**
+ * Remote command channel.
+ *
+ * Command line published on nodes/node1/console/request/<id> is run by
+ * the registered console command in a low-priority worker task, if the
+ * command is listed in CONFIG_NODE_CONSOLE_REMOTE_COMMANDS.  Output
+ * of the command is captured into a bounded buffer and published on
+ * nodes/node1/console/response/<id>:
+ *
+ *   {"id": "<id>", "ret": 0, "truncated": false, "output": "..."}
+ *
+ * esp_console_run() shares one line buffer with the REPL, so commands
+ * are registered through console_cmd_register(), which keeps its own
+ * table for remote dispatch.  Handlers keep their arguments and state in
+ * statics, so a command from the REPL and a remote one never run at the
+ * same time.
+*/
+#include "esp_console.h"
+
+/**
+ * Register console command, available from both REPL and remote channel.
+*/
+esp_err_t console_cmd_register(const esp_console_cmd_t *cmd);
+
+/**
+ * Subscribe to remote commands and start the worker.
+*/
+void register_remote();
\ No newline at end of file
@@ -1,9 +1,55 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "argtable3/argtable3.h"
 #include "cmd_sensors.h"
+#include "cmd_remote.h"
 #include "esp_log.h"
 #include "esp_console.h"
+#include "esp_timer.h"
 #include "node_sensors.h"
 
+#if CONFIG_NODE_SENSORS_HW
+/** Arguments used by 'sensors.adc_cal' function */
+static struct {
+    struct arg_int *channel;
+    struct arg_str *points;
+    struct arg_end *end;
+} adc_cal_args;
+
+/** Arguments used by 'sensors.resolution' function */
+static struct {
+    struct arg_str *sensor;
+    struct arg_str *policy;
+    struct arg_end *end;
+} resolution_args;
+#endif
+
+#if CONFIG_NODE_SENSORS_RULES
+/** Arguments used by 'sensors.rules' function */
+static struct {
+    struct arg_str *definition;
+    struct arg_lit *clear;
+    struct arg_end *end;
+} rules_args;
+#endif
+
+#if CONFIG_NODE_SENSORS_CONTROL
+/** Arguments used by 'sensors.control' function */
+static struct {
+    struct arg_str *sensor;
+    struct arg_dbl *setpoint;
+    struct arg_dbl *kp;
+    struct arg_dbl *ki;
+    struct arg_dbl *kd;
+    struct arg_int *gpio;
+    struct arg_lit *reverse;
+    struct arg_lit *direct;
+    struct arg_lit *off;
+    struct arg_end *end;
+} control_args;
+#endif
+
 
 static int cmd_sensors_list(int argc, char **argv)
 {
@@ -11,15 +57,326 @@ static int cmd_sensors_list(int argc, char **argv)
          sensor != NULL;
          sensor = sensor->next)
     {
-        printf("%s: %s(%s)\r\n",
+        printf("%s: %s(%s)",
                sensor->name,
                sensor->quantity,
                sensor->unit);
+        const node_sensor_rate_t *rate = &sensor->rate;
+        if (rate->base_ms != 0)
+        {
+            printf(", period %u ms, %u readings, %u skipped",
+                   rate->period_ms ? rate->period_ms : rate->base_ms,
+                   rate->readings,
+                   rate->skipped);
+        }
+        printf("\r\n");
     }
     node_sensor_enum_finish();
     return 0;
 }
 
+static int cmd_sensors_jitter(int argc, char **argv)
+{
+    node_sampler_stats_t stats;
+    for (int n = 0; node_sampler_get_stats(n, &stats); ++n)
+    {
+        const node_hist_t *hist = &stats.hist;
+        printf("%s: period %u ms, %u intervals\r\n",
+               stats.name,
+               stats.period_ms,
+               hist->count);
+        if (hist->count == 0)
+        {
+            continue;
+        }
+
+        printf("  deviation, us: min %d, max %d, mean %lld\r\n",
+               hist->min,
+               hist->max,
+               hist->sum / hist->count);
+        for (int b = 0; b < NODE_HIST_BUCKETS; ++b)
+        {
+            if (b == 0)
+            {
+                printf("  %8s < %7d: ", "", hist->bounds[0]);
+            }
+            else if (b == NODE_HIST_BUCKETS - 1)
+            {
+                printf("  %8d <= %6s: ", hist->bounds[b - 1], "");
+            }
+            else
+            {
+                printf("  %8d .. %6d: ", hist->bounds[b - 1], hist->bounds[b]);
+            }
+            printf("%u\r\n", hist->buckets[b]);
+        }
+    }
+    return 0;
+}
+
+#if CONFIG_NODE_SENSORS_HW
+static int cmd_sensors_adc_cal(int argc, char **argv)
+{
+    adc_cal_args.channel->ival[0] = 0;
+
+    int nerrors = arg_parse(argc, argv, (void **) &adc_cal_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, adc_cal_args.end, argv[0]);
+        return 1;
+    }
+
+    int channel = adc_cal_args.channel->ival[0];
+    node_sensors_cal_point_t points[NODE_SENSORS_MAX_CAL_POINTS];
+    int count = adc_cal_args.points->count;
+
+    if (count > 0) {
+        for (int n = 0; n < count; ++n) {
+            unsigned voltage;
+            float moisture;
+            if (sscanf(adc_cal_args.points->sval[n], "%u:%f", &voltage, &moisture) != 2
+                || moisture < 0 || moisture > 100) {
+                printf("Invalid point '%s', expected <mV>:<percent>\r\n",
+                       adc_cal_args.points->sval[n]);
+                return 1;
+            }
+            points[n].voltage_mv = voltage;
+            points[n].moisture = (uint16_t)(moisture * 100 + 0.5f);
+        }
+
+        if (!node_sensors_adc_set_calibration(channel, points, count)) {
+            printf("Cannot set calibration, points must be sorted by voltage\r\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!node_sensors_adc_get_calibration(channel, points, &count)) {
+        printf("Channel %d is not sampled\r\n", channel);
+        return 1;
+    }
+
+    for (int n = 0; n < count; ++n) {
+        printf("%5u mV: %6.2f %%\r\n",
+               points[n].voltage_mv,
+               points[n].moisture / 100.0f);
+    }
+    return 0;
+}
+
+static int cmd_sensors_stats(int argc, char **argv)
+{
+    node_sensors_1wire_bus_stats_t bus;
+    node_sensors_1wire_get_bus_stats(&bus);
+
+    int64_t elapsed = esp_timer_get_time() - bus.since_us;
+    printf("1-wire bus: %u cycles (%u failed), %u discoveries\r\n",
+           bus.cycles,
+           bus.failed_cycles,
+           bus.discoveries);
+    printf("  cycle: avg %llu us, max %u us, conversion avg %llu us, utilisation %.1f %%\r\n",
+           bus.cycles ? bus.busy_us / bus.cycles : 0,
+           bus.max_cycle_us,
+           bus.cycles ? bus.conversion_us / bus.cycles : 0,
+           bus.since_us && elapsed > 0 ? 100.0 * bus.busy_us / elapsed : 0.0);
+
+    node_sensors_1wire_stats_t stats;
+    for (int n = 0; node_sensors_1wire_get_stats(n, &stats); ++n) {
+        printf("%s%s: %u reads, %u failed, crc %u, errors %u, retries %u, 85C %u, "
+               "read avg %llu us, max %u us\r\n",
+               stats.name,
+               stats.present ? "" : " (absent)",
+               stats.reads,
+               stats.failures,
+               stats.crc_errors,
+               stats.read_errors,
+               stats.retries,
+               stats.por_values,
+               stats.reads ? stats.read_us / stats.reads : 0,
+               stats.max_read_us);
+    }
+    return 0;
+}
+
+static const char *policy_name(int policy, char *buf, size_t size)
+{
+    if (policy == NODE_SENSORS_1WIRE_DEFAULT) {
+        return "default";
+    }
+    if (policy == NODE_SENSORS_1WIRE_ADAPTIVE) {
+        return "auto";
+    }
+    snprintf(buf, size, "%d", policy);
+    return buf;
+}
+
+static int cmd_sensors_resolution(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **) &resolution_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, resolution_args.end, argv[0]);
+        return 1;
+    }
+
+    if (resolution_args.sensor->count > 0) {
+        if (resolution_args.policy->count == 0) {
+            printf("Policy is required\r\n");
+            return 1;
+        }
+
+        const char *value = resolution_args.policy->sval[0];
+        int policy;
+        if (strcmp(value, "auto") == 0) {
+            policy = NODE_SENSORS_1WIRE_ADAPTIVE;
+        } else if (strcmp(value, "default") == 0) {
+            policy = NODE_SENSORS_1WIRE_DEFAULT;
+        } else {
+            char *end;
+            long bits = strtol(value, &end, 10);
+            if (end == value || *end != '\0' || bits < 9 || bits > 12) {
+                printf("Invalid policy '%s', expected 9..12, auto or default\r\n", value);
+                return 1;
+            }
+            policy = (int)bits;
+        }
+
+        if (!node_sensors_1wire_set_policy(resolution_args.sensor->sval[0], policy)) {
+            printf("Cannot set policy '%s' of %s\r\n", value, resolution_args.sensor->sval[0]);
+            return 1;
+        }
+        return 0;
+    }
+
+    node_sensors_1wire_info_t info;
+    for (int n = 0; node_sensors_1wire_get_info(n, &info); ++n) {
+        char buf[8];
+        printf("%s: policy %s, resolution %d bit\r\n",
+               info.name,
+               policy_name(info.policy, buf, sizeof(buf)),
+               info.resolution);
+    }
+    return 0;
+}
+#endif
+
+#if CONFIG_NODE_SENSORS_RULES
+static int cmd_sensors_rules(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **) &rules_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, rules_args.end, argv[0]);
+        return 1;
+    }
+
+    if (rules_args.definition->count > 0 || rules_args.clear->count > 0) {
+        const char *definition = rules_args.clear->count > 0 ? "" : rules_args.definition->sval[0];
+        if (!node_sensors_rules_set(definition)) {
+            printf("Invalid rules or cannot store them\r\n");
+            return 1;
+        }
+    }
+
+    printf("Rules: %s\r\n", node_sensors_rules_get());
+    node_sensors_rule_info_t info;
+    for (int n = 0; node_sensors_rule_get_info(n, &info); ++n) {
+        printf("%d: %s %c %.2f (off %c %.2f) -> GPIO%d%s, %s, %u triggers\r\n",
+               n,
+               info.sensor,
+               info.above ? '>' : '<',
+               info.on,
+               info.above ? '<' : '>',
+               info.off,
+               info.gpio,
+               info.invert ? " inverted" : "",
+               info.active ? "on" : "off",
+               info.triggers);
+    }
+    return 0;
+}
+#endif
+
+#if CONFIG_NODE_SENSORS_CONTROL
+static int cmd_sensors_control(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **) &control_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, control_args.end, argv[0]);
+        return 1;
+    }
+
+    node_sensors_control_status_t status;
+    node_sensors_control_get_status(&status);
+
+    if (argc > 1) {
+        node_sensors_control_config_t config = status.config;
+        if (control_args.off->count > 0) {
+            config.sensor[0] = '\0';
+        }
+        if (control_args.sensor->count > 0) {
+            strlcpy(config.sensor, control_args.sensor->sval[0], sizeof(config.sensor));
+        }
+        if (control_args.setpoint->count > 0) {
+            config.setpoint = control_args.setpoint->dval[0];
+        }
+        if (control_args.kp->count > 0) {
+            config.kp = control_args.kp->dval[0];
+        }
+        if (control_args.ki->count > 0) {
+            config.ki = control_args.ki->dval[0];
+        }
+        if (control_args.kd->count > 0) {
+            config.kd = control_args.kd->dval[0];
+        }
+        if (control_args.gpio->count > 0) {
+            config.gpio = control_args.gpio->ival[0];
+        }
+        if (control_args.reverse->count > 0 || control_args.direct->count > 0) {
+            config.reverse = control_args.reverse->count > 0;
+        }
+        if (!node_sensors_control_set(&config)) {
+            printf("Invalid settings or cannot store them\r\n");
+            return 1;
+        }
+        node_sensors_control_get_status(&status);
+    }
+
+    const node_sensors_control_config_t *config = &status.config;
+    if (config->sensor[0] == '\0') {
+        printf("Control loop is off\r\n");
+        return 0;
+    }
+    printf("%s -> GPIO%d, setpoint %.2f, %s\r\n",
+           config->sensor,
+           config->gpio,
+           config->setpoint,
+           config->reverse ? "reverse (cooling)" : "direct (heating)");
+    printf("  kp %.3f, ki %.4f, kd %.3f\r\n", config->kp, config->ki, config->kd);
+    printf("  input %.2f%s, output %.1f %%, integral %.1f %%\r\n",
+           status.input,
+           status.valid ? "" : " (stale)",
+           status.output,
+           status.integral);
+    printf("  %u iterations, %u without input, %u saturated\r\n",
+           status.cycles,
+           status.timeouts,
+           status.saturated);
+    const node_hist_t *jitter = &status.jitter;
+    if (jitter->count > 0) {
+        printf("  period deviation, us: min %d, max %d, mean %lld\r\n",
+               jitter->min,
+               jitter->max,
+               jitter->sum / jitter->count);
+    }
+    const node_log_hist_t *compute = &status.compute;
+    if (compute->count > 0) {
+        printf("  compute, us: p50 %u, p99 %u, max %u\r\n",
+               node_log_hist_percentile(compute, 500),
+               node_log_hist_percentile(compute, 990),
+               compute->max);
+    }
+    return 0;
+}
+#endif
+
 
 void register_sensors()
 {
@@ -30,5 +387,97 @@ void register_sensors()
         .hint = NULL,
         .func = &cmd_sensors_list,
     };
-    ESP_ERROR_CHECK( esp_console_cmd_register(&list_cmd) );
+    ESP_ERROR_CHECK( console_cmd_register(&list_cmd) );
+
+    const esp_console_cmd_t jitter_cmd = {
+        .command = "sensors.jitter",
+        .help = "Show histogram of sample interval deviation, us",
+        .hint = NULL,
+        .func = &cmd_sensors_jitter,
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&jitter_cmd) );
+
+#if CONFIG_NODE_SENSORS_HW
+    adc_cal_args.channel = arg_int0("c", "channel", "<n>", "ADC1 channel, default 0");
+    adc_cal_args.points = arg_strn(NULL, NULL, "<mV>:<percent>", 0, NODE_SENSORS_MAX_CAL_POINTS,
+                                   "Calibration points sorted by voltage");
+    adc_cal_args.end = arg_end(2);
+
+    const esp_console_cmd_t adc_cal_cmd = {
+        .command = "sensors.adc_cal",
+        .help = "Show or set moisture probe calibration.\n"
+        "Points are stored in NVS, moisture between them is interpolated.\n"
+        "Example: sensors.adc_cal 1700:100 2200:45 2800:0",
+        .hint = NULL,
+        .func = &cmd_sensors_adc_cal,
+        .argtable = &adc_cal_args
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&adc_cal_cmd) );
+
+    const esp_console_cmd_t stats_cmd = {
+        .command = "sensors.stats",
+        .help = "Show 1-wire bus and per-device statistics",
+        .hint = NULL,
+        .func = &cmd_sensors_stats,
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&stats_cmd) );
+
+    resolution_args.sensor = arg_str0(NULL, NULL, "<sensor>", "1-wire sensor name");
+    resolution_args.policy = arg_str0(NULL, NULL, "<9..12|auto|default>", "Resolution policy");
+    resolution_args.end = arg_end(2);
+
+    const esp_console_cmd_t resolution_cmd = {
+        .command = "sensors.resolution",
+        .help = "Show or set DS18B20 resolution policy.\n"
+        "Fixed resolution in bits, 'auto' for adaptive resolution or\n"
+        "'default' for configured policy.  Stored in NVS.\n"
+        "Example: sensors.resolution 28ff641e8216c3a1 10",
+        .hint = NULL,
+        .func = &cmd_sensors_resolution,
+        .argtable = &resolution_args
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&resolution_cmd) );
+#endif
+
+#if CONFIG_NODE_SENSORS_RULES
+    rules_args.definition = arg_str0(NULL, NULL, "<rules>", "Rules definition");
+    rules_args.clear = arg_lit0(NULL, "clear", "Remove all rules");
+    rules_args.end = arg_end(2);
+
+    const esp_console_cmd_t rules_cmd = {
+        .command = "sensors.rules",
+        .help = "Show or set threshold rules driving GPIO outputs.\n"
+        "<sensor><'>'|'<'><threshold>[~hysteresis]:<gpio>[!] separated by ';',\n"
+        "'!' inverts the output.  Stored in NVS.\n"
+        "Example: sensors.rules \"28ff641e8216c3a1>28.5~0.5:17;ADC_1_0<30~5:18\"",
+        .hint = NULL,
+        .func = &cmd_sensors_rules,
+        .argtable = &rules_args
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&rules_cmd) );
+#endif
+
+#if CONFIG_NODE_SENSORS_CONTROL
+    control_args.sensor = arg_str0("i", "input", "<sensor>", "Input sensor name");
+    control_args.setpoint = arg_dbl0("s", "setpoint", "<value>", "Target value of the input");
+    control_args.kp = arg_dbl0(NULL, "kp", "<gain>", "Proportional gain, % per unit");
+    control_args.ki = arg_dbl0(NULL, "ki", "<gain>", "Integral gain, % per unit per second");
+    control_args.kd = arg_dbl0(NULL, "kd", "<gain>", "Derivative gain, % per unit per second of change");
+    control_args.gpio = arg_int0("g", "gpio", "<n>", "PWM output");
+    control_args.reverse = arg_lit0(NULL, "reverse", "Output rises above setpoint (cooling)");
+    control_args.direct = arg_lit0(NULL, "direct", "Output rises below setpoint (heating)");
+    control_args.off = arg_lit0(NULL, "off", "Switch the loop off");
+    control_args.end = arg_end(2);
+
+    const esp_console_cmd_t control_cmd = {
+        .command = "sensors.control",
+        .help = "Show or change PID control loop settings.\n"
+        "Options not given keep their values.  Stored in NVS.\n"
+        "Example: sensors.control -i 28ff641e8216c3a1 -s 24 --kp 20 --ki 0.05 -g 16",
+        .hint = NULL,
+        .func = &cmd_sensors_control,
+        .argtable = &control_args
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&control_cmd) );
+#endif
 }
@@ -5,12 +5,14 @@
 #include <unistd.h>
 
 #include "argtable3/argtable3.h"
+#include "cmd_remote.h"
 #include "esp_log.h"
 #include "esp_console.h"
 #include "esp_spi_flash.h"
 #include "esp_system.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "node_tasks.h"
 
 static void register_cmd_sys();
 static int sys_version();
@@ -69,13 +71,13 @@ static void register_cmd_sys()
         "sys free - Show size of free heap memory\n"
         "sys heap - Show min heap size\n"
         "sys version - Show version of chip and SDK\n"
-        "sys tasks - Show information about running tasks\n"
+        "sys tasks - Show information about running tasks and stack usage of Node tasks\n"
         "sys restart - Software reset of the chip\n",
         .hint = NULL,
         .func = &cmd_sys,
         .argtable = &sys_args,
     };
-    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd) );
+    ESP_ERROR_CHECK( console_cmd_register(&cmd) );
 }
 
 /* 'version' command */
@@ -113,5 +115,23 @@ static int sys_tasks()
     vTaskList(task_list_buffer);
     fputs(task_list_buffer, stdout);
     free(task_list_buffer);
+
+    fputs("\nNode Task\tStack\tHWM\tUsed\tPrio\tCore\n", stdout);
+    for (int id = 0; id < NODE_TASK_COUNT; ++id) {
+        node_task_info_t info;
+        node_task_get_info(id, &info);
+        if (!info.running) {
+            printf("%s\tnot started\n", info.name);
+            continue;
+        }
+        uint32_t used = info.stack_size - info.stack_hwm;
+        printf("%s\t%u\t%u\t%u%%\t%u\t%d\n",
+               info.name,
+               info.stack_size,
+               info.stack_hwm,
+               used * 100 / info.stack_size,
+               info.priority,
+               info.core == tskNO_AFFINITY ? -1 : info.core);
+    }
     return 0;
 }
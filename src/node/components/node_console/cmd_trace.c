@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include "cmd_trace.h"
+#include "cmd_remote.h"
+#include "esp_log.h"
+#include "esp_console.h"
+#include "node_sensors.h"
+
+enum cmd_trace_const_internal
+{
+    TRACE_DUMP_LINE_BYTES = 32
+};
+
+
+static void print_trace_status()
+{
+    node_sensors_trace_status_t status;
+    node_sensors_trace_get_status(&status);
+    printf("Trace: %s, %u records (%u dropped), %u of %u bytes\r\n",
+           status.recording ? "recording" : "stopped",
+           status.records,
+           status.dropped,
+           status.size,
+           status.capacity);
+}
+
+static int cmd_trace_start(int argc, char **argv)
+{
+    if (!node_sensors_trace_start()) {
+        printf("Cannot start trace recording\r\n");
+        return 1;
+    }
+    print_trace_status();
+    return 0;
+}
+
+static int cmd_trace_stop(int argc, char **argv)
+{
+    node_sensors_trace_stop();
+    print_trace_status();
+    return 0;
+}
+
+static int cmd_trace_status(int argc, char **argv)
+{
+    print_trace_status();
+    return 0;
+}
+
+static int cmd_trace_dump(int argc, char **argv)
+{
+    uint8_t line[TRACE_DUMP_LINE_BYTES];
+    uint32_t offset = 0;
+    int size;
+    while ((size = node_sensors_trace_read(offset, line, sizeof(line))) > 0) {
+        for (int i = 0; i < size; ++i) {
+            printf("%02x", line[i]);
+        }
+        printf("\r\n");
+        offset += size;
+    }
+
+    if (size < 0) {
+        printf("Cannot read trace, stop recording first\r\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+void register_trace()
+{
+    const esp_console_cmd_t start_cmd = {
+        .command = "trace.start",
+        .help = "Erase trace partition and start recording raw sensor readings",
+        .hint = NULL,
+        .func = &cmd_trace_start,
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&start_cmd) );
+
+    const esp_console_cmd_t stop_cmd = {
+        .command = "trace.stop",
+        .help = "Stop recording sensor trace",
+        .hint = NULL,
+        .func = &cmd_trace_stop,
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&stop_cmd) );
+
+    const esp_console_cmd_t status_cmd = {
+        .command = "trace.status",
+        .help = "Show sensor trace size",
+        .hint = NULL,
+        .func = &cmd_trace_status,
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&status_cmd) );
+
+    const esp_console_cmd_t dump_cmd = {
+        .command = "trace.dump",
+        .help = "Print recorded sensor trace as hex.\n"
+        "Convert captured output to binary with 'xxd -r -p'",
+        .hint = NULL,
+        .func = &cmd_trace_dump,
+    };
+    ESP_ERROR_CHECK( console_cmd_register(&dump_cmd) );
+}
\ No newline at end of file
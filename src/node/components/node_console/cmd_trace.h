@@ -0,0 +1,3 @@
+#pragma once
+
+void register_trace();
\ No newline at end of file
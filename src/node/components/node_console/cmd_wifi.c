@@ -1,4 +1,5 @@
 #include "cmd_wifi.h"
+#include "cmd_remote.h"
 #include "node_wifi.h"
 
 #include "argtable3/argtable3.h"
@@ -29,9 +30,9 @@ static int cmd_wifi_connect(int argc, char **argv)
     return status ? 0 : 1;
 }
 
-static int cmd_wifi_scan(int argc, char **argv)
+static int cmd_wifi_list(int argc, char **argv)
 {
-    wifi_scan();
+    wifi_list();
     return 0;
 }
 
@@ -56,15 +57,15 @@ void register_wifi(void)
         .func = &cmd_wifi_connect,
         .argtable = &join_args
     };
-    ESP_ERROR_CHECK( esp_console_cmd_register(&join_cmd) );
+    ESP_ERROR_CHECK( console_cmd_register(&join_cmd) );
 
     const esp_console_cmd_t list_cmd = {
         .command = "wifi.list",
-        .help = "List available WiFi AP",
+        .help = "List WiFi APs seen by background scan",
         .hint = NULL,
-        .func = &cmd_wifi_scan,
+        .func = &cmd_wifi_list,
     };
-    ESP_ERROR_CHECK( esp_console_cmd_register(&list_cmd) );
+    ESP_ERROR_CHECK( console_cmd_register(&list_cmd) );
 
     const esp_console_cmd_t log_cmd = {
         .command = "wifi.status",
@@ -72,5 +73,5 @@ void register_wifi(void)
         .hint = NULL,
         .func = &cmd_wifi_status
     };
-    ESP_ERROR_CHECK( esp_console_cmd_register(&log_cmd) );
+    ESP_ERROR_CHECK( console_cmd_register(&log_cmd) );
 }
@@ -1,8 +1,19 @@
 #include "node_console.h"
+#include "cmd_bench.h"
+#if CONFIG_NODE_HISTORY
+#include "cmd_history.h"
+#endif
+#include "cmd_mqtt.h"
 #include "cmd_nvs.h"
+#if CONFIG_NODE_CONSOLE_REMOTE
+#include "cmd_remote.h"
+#endif
 #include "cmd_wifi.h"
 #include "cmd_sensors.h"
 #include "cmd_sys.h"
+#if CONFIG_NODE_SENSORS_TRACE
+#include "cmd_trace.h"
+#endif
 #include "esp_console.h"
 
 static const int CONSOLE_MAX_COMMAND_LINE_LENGTH = 256;
@@ -18,12 +29,25 @@ void console_run()
   repl_config.max_cmdline_length = CONSOLE_MAX_COMMAND_LINE_LENGTH;
 
   esp_console_register_help_command();
+  register_bench();
+#if CONFIG_NODE_HISTORY
+  register_history();
+#endif
+  register_mqtt();
   register_nvs();
   register_sensors();
   register_system();
+#if CONFIG_NODE_SENSORS_TRACE
+  register_trace();
+#endif
   register_wifi();
 
   esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
   ESP_ERROR_CHECK(esp_console_new_repl_uart(&hw_config, &repl_config, &repl));
   ESP_ERROR_CHECK(esp_console_start_repl(repl));
+
+#if CONFIG_NODE_CONSOLE_REMOTE
+  /* All commands are registered by now. */
+  register_remote();
+#endif
 }
@@ -0,0 +1,119 @@
+#pragma once
+/**
+ * Compressed block format for sensor time series.
+ *
+ * Gorilla-style encoding: timestamps as delta-of-delta, values as XOR
+ * with the previous value, both written with variable length prefix
+ * codes.  Slowly changing readings taken at a steady period cost one
+ * or two bits per timestamp and a few bits per value.
+ *
+ * The first sample of a block is stored uncompressed (64-bit time,
+ * 32-bit float), so each block decodes independently.  Encoder appends
+ * samples one by one, decoder streams them back in order.
+*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Constants for compressed blocks.
+*/
+enum node_gorilla_const
+{
+    NODE_GORILLA_FIRST_BITS = 96,   /**< Size of the first sample */
+    NODE_GORILLA_MAX_BITS = 88      /**< Worst-case size of other samples */
+};
+
+/**
+ * Encoder of one block.
+*/
+typedef struct node_gorilla_encoder
+{
+    uint8_t *data;          /**< Block buffer */
+    size_t capacity_bits;   /**< Buffer size, bits */
+    size_t size_bits;       /**< Encoded size, bits */
+    uint32_t count;         /**< Number of samples */
+    int64_t time;           /**< Last timestamp */
+    int64_t delta;          /**< Last timestamp delta */
+    uint32_t value;         /**< Last value bits */
+    uint8_t leading;        /**< Leading zeros of the last XOR window */
+    uint8_t trailing;       /**< Trailing zeros of the last XOR window */
+} node_gorilla_encoder_t;
+
+/**
+ * Streaming decoder of one block.
+*/
+typedef struct node_gorilla_decoder
+{
+    const uint8_t *data;    /**< Block data */
+    size_t size_bits;       /**< Encoded size, bits */
+    size_t pos;             /**< Read position, bits */
+    uint32_t remaining;     /**< Samples left */
+    uint32_t count;         /**< Samples decoded */
+    int64_t time;           /**< Last timestamp */
+    int64_t delta;          /**< Last timestamp delta */
+    uint32_t value;         /**< Last value bits */
+    uint8_t leading;        /**< Leading zeros of the last XOR window */
+    uint8_t trailing;       /**< Trailing zeros of the last XOR window */
+} node_gorilla_decoder_t;
+
+/**
+ * Start an empty block.
+ *
+ * @data    block buffer
+ * @size    buffer size, bytes
+*/
+void
+node_gorilla_encoder_init(node_gorilla_encoder_t *encoder, uint8_t *data, size_t size);
+
+/**
+ * Append a sample.
+ *
+ * Timestamps must not decrease.  Block is left unchanged when the
+ * sample does not fit.
+ *
+ * @time    sample time, any unit (ms in the Node)
+ * @value   sample value
+ * @return false if the block is full.
+*/
+bool
+node_gorilla_append(node_gorilla_encoder_t *encoder, int64_t time, float value);
+
+/**
+ * Shift all timestamps of a non-empty block.
+ *
+ * Only the first timestamp is stored absolute, the block is changed in
+ * place and keeps its size.
+*/
+void
+node_gorilla_shift(uint8_t *data, int64_t offset);
+
+/**
+ * Encoded block size in bytes.
+*/
+static inline size_t
+node_gorilla_size(const node_gorilla_encoder_t *encoder)
+{
+    return (encoder->size_bits + 7) / 8;
+}
+
+/**
+ * Start decoding a block.
+ *
+ * @data    block data
+ * @size    block size, bytes
+ * @count   number of samples in the block
+*/
+void
+node_gorilla_decoder_init(node_gorilla_decoder_t *decoder,
+                          const uint8_t *data,
+                          size_t size,
+                          uint32_t count);
+
+/**
+ * Decode next sample.
+ *
+ * @return false at the end of block or on malformed data.
+*/
+bool
+node_gorilla_next(node_gorilla_decoder_t *decoder, int64_t *time, float *value);
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+/**
+ * On-device history of sensor readings.
+ *
+ * Readings are compressed per sensor (see node_gorilla.h) in RAM and
+ * written as blocks to a rotating segmented log on the 'history' data
+ * partition, so the Node keeps local data across outages and reboots.
+ * Range queries read back readings of one sensor.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Constants for history.
+*/
+enum node_history_const
+{
+    NODE_HISTORY_MAX_SENSORS = 32,  /**< Sensors limit */
+    NODE_HISTORY_MAX_NAME_LEN = 32  /**< Sensor name length limit */
+};
+
+/**
+ * History statistics.
+*/
+typedef struct node_history_stats
+{
+    uint32_t segments;      /**< Segments on the partition */
+    uint32_t bytes;         /**< Size of segments */
+    uint32_t blocks;        /**< Blocks in segments */
+    int64_t first_ms;       /**< Oldest stored time, 0 if empty */
+    int64_t last_ms;        /**< Newest stored time, 0 if empty */
+    uint32_t sensors;       /**< Known sensors */
+    uint32_t samples;       /**< Samples recorded since boot */
+    uint32_t pending;       /**< Blocks waiting to be written */
+    uint32_t dropped;       /**< Blocks lost, writer was too slow */
+    uint32_t errors;        /**< Write errors */
+} node_history_stats_t;
+
+/**
+ * Position in a query result, lets a query resume where the previous
+ * one stopped.  Zero it to start from the beginning.
+*/
+typedef struct node_history_cursor
+{
+    uint32_t seq;       /**< Log segment of the next block */
+    uint32_t offset;    /**< Offset of the next block in the segment */
+    uint32_t blocks;    /**< Blocks past the log position already read */
+    uint32_t samples;   /**< Samples of the next block already read */
+} node_history_cursor_t;
+
+/**
+ * Called for each sample of the query result, in time order.
+ *
+ * @return false to stop the query.
+*/
+typedef bool (*node_history_cb_t)(int64_t time_ms, float value, void *arg);
+
+/**
+ * Mount the history partition, open the log and start the writer task.
+ *
+ * @return false if history storage is not available.
+*/
+bool
+node_history_start();
+
+/**
+ * Current time used for history, ms since epoch (since boot until the
+ * clock is set).
+*/
+int64_t
+node_history_now_ms();
+
+/**
+ * Record a sample.
+ *
+ * Cheap, the sample is compressed in RAM; full blocks are written by
+ * the writer task.  Does nothing if history is not started.
+ *
+ * Until the clock is synchronised samples are stamped with uptime and
+ * kept in RAM, they are moved to wall clock time and written once the
+ * clock is set.  Blocks which do not fit in RAM meanwhile are dropped.
+ *
+ * @time_us capture time, esp_timer_get_time()
+*/
+void
+node_history_record(const char *sensor, int64_t time_us, float value);
+
+/**
+ * Read samples of the sensor in [from_ms, to_ms].
+ *
+ * Blocks are copied out under the history locks, the callback runs
+ * without them and may take its time.
+ *
+ * If cursor is not NULL the query starts at it, and on return it points
+ * at the sample the callback stopped on, or past the last sample.
+ *
+ * @return number of samples passed to the callback.
+*/
+uint32_t
+node_history_query(const char *sensor,
+                   int64_t from_ms,
+                   int64_t to_ms,
+                   node_history_cursor_t *cursor,
+                   node_history_cb_t cb,
+                   void *arg);
+
+/**
+ * Get history statistics.
+*/
+void
+node_history_get_stats(node_history_stats_t *stats);
+
+/**
+ * Register microbenchmarks of history encoding.
+*/
+void
+node_history_bench_register();
\ No newline at end of file
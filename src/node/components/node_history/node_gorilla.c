@@ -0,0 +1,336 @@
+#include <string.h>
+#include "node_gorilla.h"
+
+enum gorilla_const_internal
+{
+    GORILLA_FIELDS = 5,         /**< Fields per sample, at most */
+    GORILLA_NO_WINDOW = 0xff,   /**< No previous XOR window */
+    GORILLA_LARGE_DOD_BITS = 40 /**< Widest delta-of-delta */
+};
+
+/**
+ * Prefix codes of timestamp delta-of-delta: prefix, its length and
+ * width of the signed value that follows.
+*/
+static const struct
+{
+    uint8_t prefix;
+    uint8_t prefix_bits;
+    uint8_t value_bits;
+} gorilla_dod_classes[] =
+{
+    { 0x2, 2, 7 },
+    { 0x6, 3, 9 },
+    { 0xe, 4, 12 },
+    { 0xf, 4, GORILLA_LARGE_DOD_BITS }
+};
+
+/**
+ * Bit field to be written.
+*/
+typedef struct gorilla_field
+{
+    uint64_t bits;
+    uint8_t n;
+} gorilla_field_t;
+
+static void
+gorilla_put(uint8_t *data, size_t *pos, uint64_t bits, int n)
+{
+    while (n > 0)
+    {
+        uint8_t *byte = data + (*pos >> 3);
+        int room = 8 - (*pos & 7);
+        int take = n < room ? n : room;
+        int shift = room - take;
+        uint8_t mask = ((1u << take) - 1) << shift;
+        uint8_t chunk = (bits >> (n - take)) & ((1u << take) - 1);
+        /* Masked write, bytes past the end may hold a rejected sample */
+        *byte = (*byte & ~mask) | (chunk << shift);
+        *pos += take;
+        n -= take;
+    }
+}
+
+static bool
+gorilla_get(node_gorilla_decoder_t *decoder, int n, uint64_t *bits)
+{
+    if (decoder->pos + n > decoder->size_bits)
+    {
+        return false;
+    }
+
+    uint64_t value = 0;
+    while (n > 0)
+    {
+        uint8_t byte = decoder->data[decoder->pos >> 3];
+        int room = 8 - (decoder->pos & 7);
+        int take = n < room ? n : room;
+        int shift = room - take;
+        value = (value << take) | ((byte >> shift) & ((1u << take) - 1));
+        decoder->pos += take;
+        n -= take;
+    }
+    *bits = value;
+    return true;
+}
+
+static int64_t
+gorilla_sign_extend(uint64_t bits, int n)
+{
+    uint64_t sign = (uint64_t)1 << (n - 1);
+    return (int64_t)((bits ^ sign) - sign);
+}
+
+static uint32_t
+gorilla_float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float
+gorilla_bits_float(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void
+node_gorilla_shift(uint8_t *data, int64_t offset)
+{
+    uint64_t time = 0;
+    for (int n = 0; n < 8; ++n)
+    {
+        time = (time << 8) | data[n];
+    }
+    size_t pos = 0;
+    gorilla_put(data, &pos, (uint64_t)((int64_t)time + offset), 64);
+}
+
+void
+node_gorilla_encoder_init(node_gorilla_encoder_t *encoder, uint8_t *data, size_t size)
+{
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->data = data;
+    encoder->capacity_bits = size * 8;
+    encoder->leading = GORILLA_NO_WINDOW;
+}
+
+bool
+node_gorilla_append(node_gorilla_encoder_t *encoder, int64_t time, float value)
+{
+    gorilla_field_t fields[GORILLA_FIELDS];
+    int count = 0;
+    uint32_t bits = gorilla_float_bits(value);
+    uint8_t leading = encoder->leading;
+    uint8_t trailing = encoder->trailing;
+    int64_t delta = 0;
+
+    if (encoder->count == 0)
+    {
+        fields[count++] = (gorilla_field_t){ (uint64_t)time, 64 };
+        fields[count++] = (gorilla_field_t){ bits, 32 };
+    }
+    else
+    {
+        if (time < encoder->time)
+        {
+            return false;
+        }
+
+        delta = time - encoder->time;
+        int64_t dod = delta - encoder->delta;
+        if (dod == 0)
+        {
+            fields[count++] = (gorilla_field_t){ 0, 1 };
+        }
+        else
+        {
+            int c = 0;
+            const int classes = sizeof(gorilla_dod_classes) / sizeof(gorilla_dod_classes[0]);
+            while (c < classes)
+            {
+                int64_t limit = (int64_t)1 << (gorilla_dod_classes[c].value_bits - 1);
+                if (dod >= -limit && dod < limit)
+                {
+                    break;
+                }
+                ++c;
+            }
+            if (c == classes)
+            {
+                return false;
+            }
+            fields[count++] = (gorilla_field_t){ gorilla_dod_classes[c].prefix,
+                                                 gorilla_dod_classes[c].prefix_bits };
+            fields[count++] = (gorilla_field_t){ (uint64_t)dod & (((uint64_t)1 << gorilla_dod_classes[c].value_bits) - 1),
+                                                 gorilla_dod_classes[c].value_bits };
+        }
+
+        uint32_t x = bits ^ encoder->value;
+        if (x == 0)
+        {
+            fields[count++] = (gorilla_field_t){ 0, 1 };
+        }
+        else
+        {
+            uint8_t lead = __builtin_clz(x);
+            uint8_t trail = __builtin_ctz(x);
+            if (lead > 31)
+            {
+                lead = 31;
+            }
+
+            if (leading != GORILLA_NO_WINDOW && lead >= leading && trail >= trailing)
+            {
+                /* Meaningful bits fit into the previous window */
+                int len = 32 - leading - trailing;
+                fields[count++] = (gorilla_field_t){ 0x2, 2 };
+                fields[count++] = (gorilla_field_t){ x >> trailing, len };
+            }
+            else
+            {
+                int len = 32 - lead - trail;
+                fields[count++] = (gorilla_field_t){ 0x3, 2 };
+                fields[count++] = (gorilla_field_t){ ((uint32_t)lead << 5) | (len - 1), 10 };
+                fields[count++] = (gorilla_field_t){ x >> trail, len };
+                leading = lead;
+                trailing = trail;
+            }
+        }
+    }
+
+    size_t needed = 0;
+    for (int n = 0; n < count; ++n)
+    {
+        needed += fields[n].n;
+    }
+    if (encoder->size_bits + needed > encoder->capacity_bits)
+    {
+        return false;
+    }
+
+    for (int n = 0; n < count; ++n)
+    {
+        gorilla_put(encoder->data, &encoder->size_bits, fields[n].bits, fields[n].n);
+    }
+
+    encoder->delta = delta;
+    encoder->time = time;
+    encoder->value = bits;
+    encoder->leading = leading;
+    encoder->trailing = trailing;
+    ++encoder->count;
+    return true;
+}
+
+void
+node_gorilla_decoder_init(node_gorilla_decoder_t *decoder,
+                          const uint8_t *data,
+                          size_t size,
+                          uint32_t count)
+{
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->data = data;
+    decoder->size_bits = size * 8;
+    decoder->remaining = count;
+    decoder->leading = GORILLA_NO_WINDOW;
+}
+
+bool
+node_gorilla_next(node_gorilla_decoder_t *decoder, int64_t *time, float *value)
+{
+    if (decoder->remaining == 0)
+    {
+        return false;
+    }
+
+    uint64_t bits;
+    if (decoder->count == 0)
+    {
+        uint64_t first;
+        if (!gorilla_get(decoder, 64, &first) || !gorilla_get(decoder, 32, &bits))
+        {
+            return false;
+        }
+        decoder->time = (int64_t)first;
+        decoder->value = bits;
+    }
+    else
+    {
+        /* Timestamp: count leading ones of the prefix */
+        int ones = 0;
+        while (ones < 4)
+        {
+            if (!gorilla_get(decoder, 1, &bits))
+            {
+                return false;
+            }
+            if (bits == 0)
+            {
+                break;
+            }
+            ++ones;
+        }
+
+        int64_t dod = 0;
+        if (ones > 0)
+        {
+            int width = gorilla_dod_classes[ones - 1].value_bits;
+            if (!gorilla_get(decoder, width, &bits))
+            {
+                return false;
+            }
+            dod = gorilla_sign_extend(bits, width);
+        }
+        decoder->delta += dod;
+        decoder->time += decoder->delta;
+
+        /* Value */
+        if (!gorilla_get(decoder, 1, &bits))
+        {
+            return false;
+        }
+        if (bits != 0)
+        {
+            if (!gorilla_get(decoder, 1, &bits))
+            {
+                return false;
+            }
+            if (bits != 0)
+            {
+                if (!gorilla_get(decoder, 10, &bits))
+                {
+                    return false;
+                }
+                int len = (bits & 0x1f) + 1;
+                decoder->leading = bits >> 5;
+                if (decoder->leading + len > 32)
+                {
+                    return false;
+                }
+                decoder->trailing = 32 - decoder->leading - len;
+            }
+            else if (decoder->leading == GORILLA_NO_WINDOW)
+            {
+                return false;
+            }
+
+            int len = 32 - decoder->leading - decoder->trailing;
+            if (!gorilla_get(decoder, len, &bits))
+            {
+                return false;
+            }
+            decoder->value ^= (uint32_t)bits << decoder->trailing;
+        }
+    }
+
+    --decoder->remaining;
+    ++decoder->count;
+    *time = decoder->time;
+    *value = gorilla_bits_float(decoder->value);
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,604 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "node_diag.h"
+#include "node_gorilla.h"
+#include "node_history.h"
+#include "node_history_fs.h"
+#include "node_history_log.h"
+#include "node_history_server.h"
+#include "node_network.h"
+#include "node_tasks.h"
+
+enum history_const_internal
+{
+    HISTORY_BLOCK_SIZE = CONFIG_NODE_HISTORY_BLOCK_SIZE,
+    HISTORY_PENDING_BLOCKS = 8,
+    HISTORY_CHECK_MS = CONFIG_NODE_HISTORY_FLUSH_S * 1000 / 4,
+    HISTORY_SERVER_POLL_MS = 100,   /**< Retry of response chunk not accepted by network */
+    HISTORY_TASK_STACK = 4096
+};
+
+static const char *TAG = "history";
+
+/**
+ * Open block of a sensor, compressed in RAM.
+*/
+typedef struct history_series
+{
+    char name[NODE_HISTORY_MAX_NAME_LEN];   /**< Sensor name */
+    int id;                                 /**< Sensor id in the log */
+    node_gorilla_encoder_t encoder;         /**< Block encoder */
+    int64_t first_ms;                       /**< Time of the first sample */
+    int64_t opened_us;                      /**< Uptime of the first sample */
+    uint8_t data[HISTORY_BLOCK_SIZE];       /**< Block buffer */
+} history_series_t;
+
+/**
+ * Full block waiting for the writer.
+*/
+typedef struct history_pending
+{
+    history_block_header_t header;
+    uint8_t data[HISTORY_BLOCK_SIZE];
+} history_pending_t;
+
+static history_series_t history_series[NODE_HISTORY_MAX_SENSORS];
+static int history_series_count = 0;
+
+/** Ring of full blocks. */
+static history_pending_t history_pending[HISTORY_PENDING_BLOCKS];
+static int history_pending_first = 0;
+static int history_pending_count = 0;
+
+/** Block being written, out of the ring. */
+static history_pending_t history_writing;
+
+/**
+ * Samples are stamped with uptime until the clock is synchronised, the
+ * log holds wall clock time only.  Changed by the writer task only.
+*/
+static bool history_uptime = true;
+
+static uint32_t history_samples = 0;
+static uint32_t history_dropped = 0;
+static uint32_t history_errors = 0;
+
+/** Guards series, pending blocks and counters.  Never held on file I/O. */
+static SemaphoreHandle_t history_lock = NULL;
+static StaticSemaphore_t history_lock_buffer;
+
+/** Guards the log.  Taken before history_lock. */
+static SemaphoreHandle_t history_log_lock = NULL;
+static StaticSemaphore_t history_log_lock_buffer;
+
+static TaskHandle_t history_task = NULL;
+
+int64_t
+node_history_now_ms()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void
+history_series_open(history_series_t *series)
+{
+    node_gorilla_encoder_init(&series->encoder, series->data, sizeof(series->data));
+}
+
+/**
+ * Move open block of the series to pending ring.  Called with history_lock.
+*/
+static void
+history_series_seal(history_series_t *series)
+{
+    if (series->encoder.count == 0)
+    {
+        return;
+    }
+
+    if (history_pending_count == HISTORY_PENDING_BLOCKS)
+    {
+        ++history_dropped;
+    }
+    else
+    {
+        int slot = (history_pending_first + history_pending_count++) % HISTORY_PENDING_BLOCKS;
+        history_pending_t *pending = &history_pending[slot];
+        size_t size = node_gorilla_size(&series->encoder);
+        pending->header = (history_block_header_t){
+            .magic = HISTORY_BLOCK_MAGIC,
+            .sensor = series->id,
+            .count = series->encoder.count,
+            .size = size,
+            .first_ms = series->first_ms,
+            .last_ms = series->encoder.time
+        };
+        memcpy(pending->data, series->data, size);
+    }
+    history_series_open(series);
+}
+
+/**
+ * Find the series, add it if new.  Called with history_lock.
+*/
+static history_series_t *
+history_series_find(const char *name)
+{
+    for (int n = 0; n < history_series_count; ++n)
+    {
+        if (strcmp(history_series[n].name, name) == 0)
+        {
+            return &history_series[n];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Add series of new sensor.  Sensor table is a file, so the id is
+ * obtained without history_lock.  Returns with history_lock taken.
+*/
+static history_series_t *
+history_series_add(const char *name)
+{
+    xSemaphoreTake(history_log_lock, portMAX_DELAY);
+    int id = history_log_sensor_id(name);
+    xSemaphoreGive(history_log_lock);
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    history_series_t *series = history_series_find(name);
+    if (series == NULL && id >= 0 && history_series_count < NODE_HISTORY_MAX_SENSORS)
+    {
+        series = &history_series[history_series_count++];
+        strlcpy(series->name, name, sizeof(series->name));
+        series->id = id;
+        history_series_open(series);
+    }
+    return series;
+}
+
+void
+node_history_record(const char *sensor, int64_t time_us, float value)
+{
+    if (history_task == NULL)
+    {
+        return;
+    }
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    history_series_t *series = history_series_find(sensor);
+    if (series == NULL)
+    {
+        xSemaphoreGive(history_lock);
+        series = history_series_add(sensor);
+        if (series == NULL)
+        {
+            xSemaphoreGive(history_lock);
+            return;
+        }
+    }
+
+    int64_t time_ms = history_uptime ? time_us / 1000 : node_network_wall_ms(time_us);
+    bool sealed = false;
+    if (!node_gorilla_append(&series->encoder, time_ms, value))
+    {
+        // Block is full or the clock stepped back
+        history_series_seal(series);
+        node_gorilla_append(&series->encoder, time_ms, value);
+        sealed = true;
+    }
+    if (series->encoder.count == 1)
+    {
+        series->first_ms = time_ms;
+        series->opened_us = esp_timer_get_time();
+    }
+    ++history_samples;
+    xSemaphoreGive(history_lock);
+
+    if (sealed)
+    {
+        xTaskNotifyGive(history_task);
+    }
+}
+
+/**
+ * Seal blocks which stayed open for too long, so a reboot does not lose
+ * more than the flush period of samples.
+*/
+static void
+history_flush_old()
+{
+    int64_t now = esp_timer_get_time();
+    int64_t max_age = (int64_t)CONFIG_NODE_HISTORY_FLUSH_S * 1000000;
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    for (int n = 0; n < history_series_count; ++n)
+    {
+        history_series_t *series = &history_series[n];
+        if (series->encoder.count != 0 && now - series->opened_us >= max_age)
+        {
+            history_series_seal(series);
+        }
+    }
+    xSemaphoreGive(history_lock);
+}
+
+/**
+ * Move blocks stamped with uptime to wall clock time once the clock is
+ * synchronised, from then on samples are stamped with wall clock time.
+*/
+static void
+history_restamp()
+{
+    if (!history_uptime || !node_network_time_synced())
+    {
+        return;
+    }
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    int64_t now_us = esp_timer_get_time();
+    int64_t offset_ms = node_network_wall_ms(now_us) - now_us / 1000;
+    for (int n = 0; n < history_pending_count; ++n)
+    {
+        history_pending_t *pending =
+            &history_pending[(history_pending_first + n) % HISTORY_PENDING_BLOCKS];
+        node_gorilla_shift(pending->data, offset_ms);
+        pending->header.first_ms += offset_ms;
+        pending->header.last_ms += offset_ms;
+    }
+    for (int n = 0; n < history_series_count; ++n)
+    {
+        history_series_t *series = &history_series[n];
+        if (series->encoder.count != 0)
+        {
+            node_gorilla_shift(series->data, offset_ms);
+            series->first_ms += offset_ms;
+            series->encoder.time += offset_ms;
+        }
+    }
+    int pending = history_pending_count;
+    history_uptime = false;
+    xSemaphoreGive(history_lock);
+
+    ESP_LOGI(TAG, "Clock set, %d pending blocks moved to wall clock time", pending);
+}
+
+/**
+ * Write pending blocks.  Block leaves the ring under the log lock, so
+ * queries always see it either in the ring or in the log.
+*/
+static void
+history_write_pending()
+{
+    while (true)
+    {
+        xSemaphoreTake(history_log_lock, portMAX_DELAY);
+
+        xSemaphoreTake(history_lock, portMAX_DELAY);
+        bool empty = history_pending_count == 0;
+        if (!empty)
+        {
+            history_writing = history_pending[history_pending_first];
+            history_pending_first = (history_pending_first + 1) % HISTORY_PENDING_BLOCKS;
+            --history_pending_count;
+        }
+        xSemaphoreGive(history_lock);
+
+        if (empty)
+        {
+            xSemaphoreGive(history_log_lock);
+            return;
+        }
+
+        bool written = history_log_append(&history_writing.header, history_writing.data);
+        xSemaphoreGive(history_log_lock);
+
+        if (!written)
+        {
+            xSemaphoreTake(history_lock, portMAX_DELAY);
+            ++history_errors;
+            xSemaphoreGive(history_lock);
+            ESP_LOGE(TAG, "Cannot write block of sensor %u", history_writing.header.sensor);
+        }
+    }
+}
+
+/**
+ * Writes blocks and serves queries over MQTT, queries yield to writes.
+*/
+static void
+history_writer_task(void *arg)
+{
+    history_server_start(xTaskGetCurrentTaskHandle());
+
+    bool serving = false;
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(serving ? HISTORY_SERVER_POLL_MS : HISTORY_CHECK_MS));
+        history_flush_old();
+        history_restamp();
+        if (!history_uptime)
+        {
+            history_write_pending();
+        }
+        serving = history_server_poll();
+    }
+}
+
+/**
+ * Query state.
+ *
+ * Samples of a sensor are blocks in the log followed by blocks still in
+ * RAM.  Blocks leave RAM in order to the end of the log, so blocks past
+ * a log position are counted wherever they are by now.
+*/
+typedef struct history_query
+{
+    const char *sensor;
+    int id;
+    int64_t from_ms;
+    int64_t to_ms;
+    node_history_cb_t cb;
+    void *arg;
+    history_log_pos_t log;  /**< Log position of the next block */
+    uint32_t blocks;        /**< Blocks past the log position already read */
+    uint32_t samples;       /**< Samples of the next block already read */
+    uint32_t count;
+    bool stopped;
+} history_query_t;
+
+/**
+ * Block of the sensor overlaps the query range.
+*/
+static bool
+history_query_match(const history_query_t *query, const history_block_header_t *header)
+{
+    return header->sensor == query->id
+           && header->last_ms >= query->from_ms
+           && header->first_ms <= query->to_ms;
+}
+
+/**
+ * Copy the next block of the query and advance the query position.
+ *
+ * Locks are held only while copying, so the callback never delays
+ * recording or the writer.
+*/
+static bool
+history_query_next(history_query_t *query, history_block_header_t *header, uint8_t *data)
+{
+    bool found = false;
+    xSemaphoreTake(history_log_lock, portMAX_DELAY);
+    while (!found
+           && history_log_read_next(query->id, query->from_ms, query->to_ms,
+                                    &query->log, header, data))
+    {
+        if (query->blocks > 0)
+        {
+            // Was read from RAM before it was written
+            --query->blocks;
+        }
+        else
+        {
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        // Past the end of the log: blocks not written yet, oldest first
+        xSemaphoreTake(history_lock, portMAX_DELAY);
+        uint32_t skip = query->blocks;
+        for (int n = 0; n < history_pending_count && !found; ++n)
+        {
+            const history_pending_t *pending =
+                &history_pending[(history_pending_first + n) % HISTORY_PENDING_BLOCKS];
+            if (!history_query_match(query, &pending->header))
+            {
+                continue;
+            }
+            if (skip > 0)
+            {
+                --skip;
+                continue;
+            }
+            *header = pending->header;
+            memcpy(data, pending->data, header->size);
+            found = true;
+        }
+
+        history_series_t *series = history_series_find(query->sensor);
+        if (!found && series != NULL && series->encoder.count != 0)
+        {
+            history_block_header_t open = {
+                .magic = HISTORY_BLOCK_MAGIC,
+                .sensor = series->id,
+                .count = series->encoder.count,
+                .size = node_gorilla_size(&series->encoder),
+                .first_ms = series->first_ms,
+                .last_ms = series->encoder.time
+            };
+            if (history_query_match(query, &open) && skip == 0)
+            {
+                *header = open;
+                memcpy(data, series->data, header->size);
+                found = true;
+            }
+        }
+        xSemaphoreGive(history_lock);
+
+        if (found)
+        {
+            ++query->blocks;
+        }
+    }
+    xSemaphoreGive(history_log_lock);
+    return found;
+}
+
+static void
+history_query_block(const history_block_header_t *header, const uint8_t *data, history_query_t *query)
+{
+    node_gorilla_decoder_t decoder;
+    node_gorilla_decoder_init(&decoder, data, header->size, header->count);
+
+    int64_t time;
+    float value;
+    for (uint32_t n = 0; node_gorilla_next(&decoder, &time, &value); ++n)
+    {
+        if (n < query->samples || time < query->from_ms || time > query->to_ms)
+        {
+            continue;
+        }
+        ++query->count;
+        if (!query->cb(time, value, query->arg))
+        {
+            // Resume on this sample
+            query->samples = n;
+            query->stopped = true;
+            return;
+        }
+    }
+    query->samples = 0;
+}
+
+uint32_t
+node_history_query(const char *sensor,
+                   int64_t from_ms,
+                   int64_t to_ms,
+                   node_history_cursor_t *cursor,
+                   node_history_cb_t cb,
+                   void *arg)
+{
+    if (history_task == NULL)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(history_log_lock, portMAX_DELAY);
+    int id = history_log_find_sensor(sensor);
+    xSemaphoreGive(history_log_lock);
+    if (id < 0)
+    {
+        return 0;
+    }
+
+    history_query_t query = {
+        .sensor = sensor,
+        .id = id,
+        .from_ms = from_ms,
+        .to_ms = to_ms,
+        .cb = cb,
+        .arg = arg
+    };
+    if (cursor != NULL)
+    {
+        query.log.seq = cursor->seq;
+        query.log.offset = cursor->offset;
+        query.blocks = cursor->blocks;
+        query.samples = cursor->samples;
+    }
+
+    history_block_header_t header;
+    uint8_t data[HISTORY_BLOCK_SIZE];
+    while (!query.stopped)
+    {
+        history_log_pos_t log = query.log;
+        uint32_t blocks = query.blocks;
+        if (!history_query_next(&query, &header, data))
+        {
+            break;
+        }
+        history_query_block(&header, data, &query);
+        if (query.stopped)
+        {
+            // Resume on this block
+            query.log = log;
+            query.blocks = blocks;
+        }
+    }
+
+    if (cursor != NULL)
+    {
+        cursor->seq = query.log.seq;
+        cursor->offset = query.log.offset;
+        cursor->blocks = query.blocks;
+        cursor->samples = query.samples;
+    }
+    return query.count;
+}
+
+void
+node_history_get_stats(node_history_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (history_task == NULL)
+    {
+        return;
+    }
+
+    xSemaphoreTake(history_log_lock, portMAX_DELAY);
+    history_log_get_stats(stats);
+    xSemaphoreGive(history_log_lock);
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    stats->samples = history_samples;
+    stats->pending = history_pending_count;
+    stats->dropped = history_dropped;
+    stats->errors = history_errors;
+    xSemaphoreGive(history_lock);
+}
+
+static void
+history_diag(node_diag_emit_t emit)
+{
+    node_history_stats_t stats;
+    node_history_get_stats(&stats);
+
+    char data[NODE_DIAG_MAX_DATA_LEN];
+    snprintf(data, sizeof(data),
+             "{\"segments\":%" PRIu32 ",\"bytes\":%" PRIu32 ",\"samples\":%" PRIu32
+             ",\"pending\":%" PRIu32 ",\"dropped\":%" PRIu32 ",\"errors\":%" PRIu32 "}",
+             stats.segments, stats.bytes, stats.samples,
+             stats.pending, stats.dropped, stats.errors);
+    emit("history", data);
+}
+
+static StackType_t history_task_stack[HISTORY_TASK_STACK];
+
+bool
+node_history_start()
+{
+    if (history_task != NULL)
+    {
+        return true;
+    }
+
+    const char *path = history_fs_mount();
+    if (path == NULL || !history_log_open(path))
+    {
+        ESP_LOGE(TAG, "History storage is not available");
+        return false;
+    }
+
+    history_lock = xSemaphoreCreateMutexStatic(&history_lock_buffer);
+    history_log_lock = xSemaphoreCreateMutexStatic(&history_log_lock_buffer);
+    history_task = node_task_start(NODE_TASK_HISTORY, &history_writer_task, NULL,
+                                   history_task_stack, sizeof(history_task_stack));
+    if (history_task == NULL)
+    {
+        return false;
+    }
+
+    node_diag_register(&history_diag);
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+/**
+ * Microbenchmarks of compressed series encoding and decoding.
+ *
+ * Series imitates a temperature probe: 1 s period with a few ms of
+ * jitter, slow sine with 1/16 degree quantization.
+*/
+#include <math.h>
+#include "node_bench.h"
+#include "node_gorilla.h"
+#include "node_history.h"
+
+enum history_bench_const_internal
+{
+    HISTORY_BENCH_SAMPLES = 256,
+    HISTORY_BENCH_BLOCK_SIZE = 1024
+};
+
+static int64_t bench_times[HISTORY_BENCH_SAMPLES];
+static float bench_values[HISTORY_BENCH_SAMPLES];
+static uint8_t bench_block[HISTORY_BENCH_BLOCK_SIZE];
+static uint32_t bench_count;
+static size_t bench_size;
+
+static void history_bench_setup()
+{
+    uint32_t noise = 1;
+    int64_t time = 0;
+    for (int n = 0; n < HISTORY_BENCH_SAMPLES; ++n)
+    {
+        noise ^= noise << 13;
+        noise ^= noise >> 17;
+        noise ^= noise << 5;
+        time += 1000 + (int)(noise % 7) - 3;
+        bench_times[n] = time;
+        bench_values[n] = roundf((21.0f + 3.0f * sinf(n / 50.0f)) * 16.0f) / 16.0f;
+    }
+
+    node_gorilla_encoder_t encoder;
+    node_gorilla_encoder_init(&encoder, bench_block, sizeof(bench_block));
+    for (int n = 0; n < HISTORY_BENCH_SAMPLES; ++n)
+    {
+        node_gorilla_append(&encoder, bench_times[n], bench_values[n]);
+    }
+    bench_count = encoder.count;
+    bench_size = node_gorilla_size(&encoder);
+}
+
+static void history_bench_append(uint32_t n)
+{
+    static uint8_t block[HISTORY_BENCH_BLOCK_SIZE];
+    node_gorilla_encoder_t encoder;
+    node_gorilla_encoder_init(&encoder, block, sizeof(block));
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        uint32_t k = i % HISTORY_BENCH_SAMPLES;
+        if (k == 0)
+        {
+            node_gorilla_encoder_init(&encoder, block, sizeof(block));
+        }
+        node_gorilla_append(&encoder, bench_times[k], bench_values[k]);
+        NODE_BENCH_CLOBBER();
+    }
+}
+
+static void history_bench_decode(uint32_t n)
+{
+    node_gorilla_decoder_t decoder;
+    node_gorilla_decoder_init(&decoder, bench_block, bench_size, bench_count);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        int64_t time;
+        float value;
+        if (!node_gorilla_next(&decoder, &time, &value))
+        {
+            node_gorilla_decoder_init(&decoder, bench_block, bench_size, bench_count);
+            node_gorilla_next(&decoder, &time, &value);
+        }
+        NODE_BENCH_CLOBBER();
+    }
+}
+
+static const node_bench_case_t history_bench_cases[] =
+{
+    {
+        .name = "history.gorilla_append",
+        .iterations = 1024,
+        .setup = &history_bench_setup,
+        .run = &history_bench_append
+    },
+    {
+        .name = "history.gorilla_decode",
+        .iterations = 1024,
+        .setup = &history_bench_setup,
+        .run = &history_bench_decode
+    }
+};
+
+void
+node_history_bench_register()
+{
+    for (int n = 0; n < sizeof(history_bench_cases) / sizeof(history_bench_cases[0]); ++n)
+    {
+        node_bench_register(&history_bench_cases[n]);
+    }
+}
\ No newline at end of file
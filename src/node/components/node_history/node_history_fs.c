@@ -0,0 +1,48 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "node_history_fs.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_littlefs.h"
+#endif
+
+static const char *TAG = "history";
+
+#if CONFIG_IDF_TARGET_LINUX
+static const char *HISTORY_FS_PATH = "history";
+#else
+static const char *HISTORY_FS_PATH = "/history";
+static const char *HISTORY_FS_PARTITION = "history";
+#endif
+
+const char *
+history_fs_mount()
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    esp_vfs_littlefs_conf_t conf = {
+        .base_path = HISTORY_FS_PATH,
+        .partition_label = HISTORY_FS_PARTITION,
+        .format_if_mount_failed = true
+    };
+    esp_err_t err = esp_vfs_littlefs_register(&conf);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot mount partition %s: %s",
+                 HISTORY_FS_PARTITION, esp_err_to_name(err));
+        return NULL;
+    }
+
+    size_t total = 0;
+    size_t used = 0;
+    esp_littlefs_info(HISTORY_FS_PARTITION, &total, &used);
+    ESP_LOGI(TAG, "Partition %s: %u of %u bytes used", HISTORY_FS_PARTITION, used, total);
+#else
+    if (mkdir(HISTORY_FS_PATH, 0755) != 0 && errno != EEXIST)
+    {
+        ESP_LOGE(TAG, "Cannot create %s: %s", HISTORY_FS_PATH, strerror(errno));
+        return NULL;
+    }
+#endif
+    return HISTORY_FS_PATH;
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+/**
+ * Storage of the history log.
+ *
+ * On target the 'history' data partition is mounted with LittleFS,
+ * which is power-loss safe and spreads writes over the flash.  Host
+ * build keeps the log in a directory of the working directory.
+*/
+
+/**
+ * Mount history storage.
+ *
+ * @return path of the log directory, NULL on failure.
+*/
+const char *
+history_fs_mount();
\ No newline at end of file
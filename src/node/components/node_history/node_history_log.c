@@ -0,0 +1,479 @@
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "node_history_log.h"
+
+enum history_log_const_internal
+{
+    HISTORY_SEGMENT_SIZE = CONFIG_NODE_HISTORY_SEGMENT_KB * 1024,
+    HISTORY_MAX_SEGMENTS = CONFIG_NODE_HISTORY_SEGMENTS,
+    HISTORY_BLOCK_SIZE = CONFIG_NODE_HISTORY_BLOCK_SIZE,
+    HISTORY_MAX_PATH = 64,
+    /** Index record: header and sensors bitmap */
+    HISTORY_INDEX_SIZE = sizeof(history_block_header_t) + sizeof(uint64_t)
+};
+
+static const char *TAG = "history";
+
+/**
+ * In-memory index of a segment.
+*/
+typedef struct history_segment
+{
+    uint32_t seq;       /**< Sequence number, file name */
+    uint32_t size;      /**< File size */
+    uint32_t blocks;    /**< Number of blocks */
+    int64_t first_ms;   /**< Time of the first sample */
+    int64_t last_ms;    /**< Time of the last sample */
+    uint64_t sensors;   /**< Bitmap of sensor ids */
+} history_segment_t;
+
+static char log_path[HISTORY_MAX_PATH];
+
+/** Segments ring, oldest first, the last one is active. */
+static history_segment_t log_segments[HISTORY_MAX_SEGMENTS];
+static int log_first = 0;
+static int log_count = 0;
+
+/** Active segment. */
+static FILE *log_file = NULL;
+/** Sequence number to retry when the active segment could not be created. */
+static uint32_t log_next_seq = 0;
+
+static char log_sensors[NODE_HISTORY_MAX_SENSORS][NODE_HISTORY_MAX_NAME_LEN];
+static int log_sensors_count = 0;
+
+static history_segment_t *
+history_log_segment(int n)
+{
+    return &log_segments[(log_first + n) % HISTORY_MAX_SEGMENTS];
+}
+
+static history_segment_t *
+history_log_active()
+{
+    return log_count ? history_log_segment(log_count - 1) : NULL;
+}
+
+static void
+history_log_segment_path(uint32_t seq, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%08" PRIu32 ".seg", log_path, seq);
+}
+
+static void
+history_log_index_add(history_segment_t *segment, const history_block_header_t *header)
+{
+    if (segment->blocks == 0 || header->first_ms < segment->first_ms)
+    {
+        segment->first_ms = header->first_ms;
+    }
+    if (segment->blocks == 0 || header->last_ms > segment->last_ms)
+    {
+        segment->last_ms = header->last_ms;
+    }
+    segment->sensors |= (uint64_t)1 << header->sensor;
+    ++segment->blocks;
+}
+
+/**
+ * Build index of a segment from its index record, or by scanning blocks
+ * if the segment was not sealed (e.g. power loss).
+*/
+static void
+history_log_load_segment(history_segment_t *segment)
+{
+    char path[HISTORY_MAX_PATH + 16];
+    history_log_segment_path(segment->seq, path, sizeof(path));
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return;
+    }
+
+    history_block_header_t header;
+    uint64_t sensors;
+    if (fseek(file, -(long)HISTORY_INDEX_SIZE, SEEK_END) == 0
+        && fread(&header, sizeof(header), 1, file) == 1
+        && fread(&sensors, sizeof(sensors), 1, file) == 1
+        && header.magic == HISTORY_INDEX_MAGIC)
+    {
+        segment->size = ftell(file);
+        segment->blocks = header.count;
+        segment->first_ms = header.first_ms;
+        segment->last_ms = header.last_ms;
+        segment->sensors = sensors;
+        fclose(file);
+        return;
+    }
+
+    // Recovery stops at the first invalid block, a torn write at the end
+    // leaves a header with garbage or missing data behind
+    long length = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : 0;
+    fseek(file, 0, SEEK_SET);
+    while (fread(&header, sizeof(header), 1, file) == 1
+           && header.magic == HISTORY_BLOCK_MAGIC
+           && header.sensor < NODE_HISTORY_MAX_SENSORS
+           && header.size <= HISTORY_BLOCK_SIZE
+           && (long)(segment->size + sizeof(header) + header.size) <= length
+           && fseek(file, header.size, SEEK_CUR) == 0)
+    {
+        history_log_index_add(segment, &header);
+        segment->size = ftell(file);
+    }
+    fclose(file);
+    ESP_LOGW(TAG, "Segment %" PRIu32 " was not sealed, %" PRIu32 " blocks recovered",
+             segment->seq, segment->blocks);
+}
+
+static void
+history_log_load_sensors()
+{
+    char path[HISTORY_MAX_PATH + 16];
+    snprintf(path, sizeof(path), "%s/sensors", log_path);
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return;
+    }
+
+    char line[NODE_HISTORY_MAX_NAME_LEN + 2];
+    while (log_sensors_count < NODE_HISTORY_MAX_SENSORS && fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        strlcpy(log_sensors[log_sensors_count++], line, NODE_HISTORY_MAX_NAME_LEN);
+    }
+    fclose(file);
+}
+
+static int
+history_log_compare_seq(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool
+history_log_start_segment(uint32_t seq)
+{
+    if (log_count == HISTORY_MAX_SEGMENTS)
+    {
+        char path[HISTORY_MAX_PATH + 16];
+        history_log_segment_path(log_segments[log_first].seq, path, sizeof(path));
+        unlink(path);
+        log_first = (log_first + 1) % HISTORY_MAX_SEGMENTS;
+        --log_count;
+    }
+
+    history_segment_t *segment = history_log_segment(log_count);
+    memset(segment, 0, sizeof(*segment));
+    segment->seq = seq;
+
+    char path[HISTORY_MAX_PATH + 16];
+    history_log_segment_path(seq, path, sizeof(path));
+    log_file = fopen(path, "wb");
+    if (log_file == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot create %s: %s", path, strerror(errno));
+        log_next_seq = seq;
+        return false;
+    }
+    ++log_count;
+    return true;
+}
+
+/**
+ * Write index record and close active segment.
+*/
+static void
+history_log_seal()
+{
+    history_segment_t *segment = history_log_active();
+    history_block_header_t header = {
+        .magic = HISTORY_INDEX_MAGIC,
+        .count = segment->blocks,
+        .first_ms = segment->first_ms,
+        .last_ms = segment->last_ms
+    };
+    fwrite(&header, sizeof(header), 1, log_file);
+    fwrite(&segment->sensors, sizeof(segment->sensors), 1, log_file);
+    segment->size += HISTORY_INDEX_SIZE;
+    fclose(log_file);
+    log_file = NULL;
+}
+
+bool
+history_log_open(const char *path)
+{
+    strlcpy(log_path, path, sizeof(log_path));
+    if (log_file != NULL)
+    {
+        fclose(log_file);
+        log_file = NULL;
+    }
+    log_first = 0;
+    log_count = 0;
+    log_sensors_count = 0;
+    history_log_load_sensors();
+
+    DIR *dir = opendir(log_path);
+    if (dir == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot open %s", log_path);
+        return false;
+    }
+
+    /* Keep the newest segments, previous run may have had larger limit */
+    static uint32_t seqs[HISTORY_MAX_SEGMENTS * 2];
+    int found = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char *end;
+        uint32_t seq = strtoul(entry->d_name, &end, 10);
+        if (end != entry->d_name && strcmp(end, ".seg") == 0)
+        {
+            if (found == sizeof(seqs) / sizeof(seqs[0]))
+            {
+                qsort(seqs, found, sizeof(seqs[0]), &history_log_compare_seq);
+                found = HISTORY_MAX_SEGMENTS;
+                memmove(seqs, seqs + HISTORY_MAX_SEGMENTS, found * sizeof(seqs[0]));
+            }
+            seqs[found++] = seq;
+        }
+    }
+    closedir(dir);
+    qsort(seqs, found, sizeof(seqs[0]), &history_log_compare_seq);
+
+    /* One slot stays free for the new active segment */
+    int skip = found >= HISTORY_MAX_SEGMENTS ? found - HISTORY_MAX_SEGMENTS + 1 : 0;
+    for (int n = 0; n < found; ++n)
+    {
+        if (n < skip)
+        {
+            char file[HISTORY_MAX_PATH + 16];
+            history_log_segment_path(seqs[n], file, sizeof(file));
+            unlink(file);
+            continue;
+        }
+        history_segment_t *segment = history_log_segment(log_count++);
+        memset(segment, 0, sizeof(*segment));
+        segment->seq = seqs[n];
+        history_log_load_segment(segment);
+    }
+
+    ESP_LOGI(TAG, "%d segments, %d sensors", log_count, log_sensors_count);
+    return history_log_start_segment(found ? seqs[found - 1] + 1 : 0);
+}
+
+int
+history_log_find_sensor(const char *name)
+{
+    for (int n = 0; n < log_sensors_count; ++n)
+    {
+        if (strcmp(log_sensors[n], name) == 0)
+        {
+            return n;
+        }
+    }
+    return -1;
+}
+
+int
+history_log_sensor_id(const char *name)
+{
+    int id = history_log_find_sensor(name);
+    if (id >= 0 || log_sensors_count == NODE_HISTORY_MAX_SENSORS)
+    {
+        return id;
+    }
+
+    char path[HISTORY_MAX_PATH + 16];
+    snprintf(path, sizeof(path), "%s/sensors", log_path);
+    FILE *file = fopen(path, "a");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    fprintf(file, "%s\n", name);
+    fclose(file);
+
+    strlcpy(log_sensors[log_sensors_count], name, NODE_HISTORY_MAX_NAME_LEN);
+    return log_sensors_count++;
+}
+
+/**
+ * Drop a partially written block: cut the active segment back to its
+ * last complete block and reopen it for append.
+ *
+ * If the segment cannot be cut, it is left as is and the next append
+ * starts a new one.
+*/
+static void
+history_log_truncate(const history_segment_t *segment)
+{
+    char path[HISTORY_MAX_PATH + 16];
+    history_log_segment_path(segment->seq, path, sizeof(path));
+    fclose(log_file);
+    log_file = NULL;
+    log_next_seq = segment->seq + 1;
+
+    if (truncate(path, segment->size) != 0)
+    {
+        ESP_LOGE(TAG, "Cannot truncate %s: %s", path, strerror(errno));
+        return;
+    }
+    log_file = fopen(path, "ab");
+    if (log_file == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot reopen %s: %s", path, strerror(errno));
+    }
+}
+
+bool
+history_log_append(const history_block_header_t *header, const uint8_t *data)
+{
+    if (log_file == NULL && !history_log_start_segment(log_next_seq))
+    {
+        return false;
+    }
+
+    history_segment_t *segment = history_log_active();
+    uint32_t size = sizeof(*header) + header->size;
+    if (segment->size + size + HISTORY_INDEX_SIZE > HISTORY_SEGMENT_SIZE)
+    {
+        history_log_seal();
+        if (!history_log_start_segment(segment->seq + 1))
+        {
+            return false;
+        }
+        segment = history_log_active();
+    }
+
+    if (fwrite(header, sizeof(*header), 1, log_file) != 1
+        || fwrite(data, header->size, 1, log_file) != 1
+        || fflush(log_file) != 0)
+    {
+        history_log_truncate(segment);
+        return false;
+    }
+    /* One filesystem commit per block bounds write amplification */
+    fsync(fileno(log_file));
+
+    segment->size += size;
+    history_log_index_add(segment, header);
+    return true;
+}
+
+bool
+history_log_read_next(int sensor,
+                      int64_t from_ms,
+                      int64_t to_ms,
+                      history_log_pos_t *pos,
+                      history_block_header_t *header,
+                      uint8_t *data)
+{
+    for (int n = 0; n < log_count; ++n)
+    {
+        const history_segment_t *segment = history_log_segment(n);
+        if (segment->seq < pos->seq)
+        {
+            continue;
+        }
+        if (segment->seq > pos->seq)
+        {
+            pos->seq = segment->seq;
+            pos->offset = 0;
+        }
+        if (pos->offset >= segment->size
+            || segment->blocks == 0
+            || (segment->sensors & ((uint64_t)1 << sensor)) == 0
+            || segment->last_ms < from_ms
+            || segment->first_ms > to_ms)
+        {
+            pos->offset = segment->size;
+            continue;
+        }
+
+        char path[HISTORY_MAX_PATH + 16];
+        history_log_segment_path(segment->seq, path, sizeof(path));
+        FILE *file = fopen(path, "rb");
+        if (file == NULL)
+        {
+            pos->offset = segment->size;
+            continue;
+        }
+
+        bool found = false;
+        bool more = fseek(file, pos->offset, SEEK_SET) == 0;
+        while (more
+               && pos->offset < segment->size
+               && fread(header, sizeof(*header), 1, file) == 1
+               && header->magic == HISTORY_BLOCK_MAGIC
+               && header->size <= HISTORY_BLOCK_SIZE)
+        {
+            if (header->sensor == sensor
+                && header->last_ms >= from_ms
+                && header->first_ms <= to_ms)
+            {
+                found = fread(data, header->size, 1, file) == 1;
+                more = false;
+            }
+            else
+            {
+                more = fseek(file, header->size, SEEK_CUR) == 0;
+            }
+            if (found || more)
+            {
+                pos->offset += sizeof(*header) + header->size;
+            }
+        }
+        fclose(file);
+
+        if (found)
+        {
+            return true;
+        }
+        // End of blocks: index record, end of the active segment or damage
+        pos->offset = segment->size;
+    }
+    return false;
+}
+
+void
+history_log_get_stats(node_history_stats_t *stats)
+{
+    stats->segments = log_count;
+    stats->bytes = 0;
+    stats->blocks = 0;
+    stats->first_ms = 0;
+    stats->last_ms = 0;
+    stats->sensors = log_sensors_count;
+    for (int n = 0; n < log_count; ++n)
+    {
+        const history_segment_t *segment = history_log_segment(n);
+        stats->bytes += segment->size;
+        stats->blocks += segment->blocks;
+        if (segment->blocks == 0)
+        {
+            continue;
+        }
+        if (stats->first_ms == 0 || segment->first_ms < stats->first_ms)
+        {
+            stats->first_ms = segment->first_ms;
+        }
+        if (segment->last_ms > stats->last_ms)
+        {
+            stats->last_ms = segment->last_ms;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+/**
+ * Segmented log of compressed history blocks.
+ *
+ * The log is a directory of segment files "NNNNNNNN.seg" written append
+ * only.  Each block is a header and a compressed series of one sensor.
+ * When a segment reaches its size limit it is sealed with an index
+ * record (time range and set of sensors) and the next segment is
+ * started; the oldest segment is removed when there are too many.
+ *
+ * Range queries check in-memory copies of segment indexes and read only
+ * segments which may hold matching blocks.
+ *
+ * Functions are not thread-safe, the caller serializes access.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include "node_history.h"
+
+enum history_log_const
+{
+    HISTORY_BLOCK_MAGIC = 0x4248,   /**< "HB" */
+    HISTORY_INDEX_MAGIC = 0x4948    /**< "HI" */
+};
+
+/**
+ * Header of a record in a segment.
+ *
+ * Index record has the same layout, sensor field is unused, count is
+ * the number of blocks, size is 0, sensors bitmap follows the header.
+*/
+typedef struct history_block_header
+{
+    uint16_t magic;     /**< HISTORY_BLOCK_MAGIC or HISTORY_INDEX_MAGIC */
+    uint8_t sensor;     /**< Sensor id */
+    uint8_t reserved;   /**< Zero */
+    uint16_t count;     /**< Samples in block */
+    uint16_t size;      /**< Compressed data size, bytes */
+    int64_t first_ms;   /**< Time of the first sample */
+    int64_t last_ms;    /**< Time of the last sample */
+} history_block_header_t;
+
+/**
+ * Position in the log.
+*/
+typedef struct history_log_pos
+{
+    uint32_t seq;       /**< Segment sequence number */
+    uint32_t offset;    /**< Offset in the segment */
+} history_log_pos_t;
+
+/**
+ * Open the log in the directory, seal segment left by previous run.
+*/
+bool
+history_log_open(const char *path);
+
+/**
+ * Get id of the sensor, add it to the sensor table if new.
+ *
+ * @return id or -1 if the table is full.
+*/
+int
+history_log_sensor_id(const char *name);
+
+/**
+ * Find id of known sensor.
+ *
+ * @return id or -1 if not found.
+*/
+int
+history_log_find_sensor(const char *name);
+
+/**
+ * Append compressed block, rotate segments if needed.
+*/
+bool
+history_log_append(const history_block_header_t *header, const uint8_t *data);
+
+/**
+ * Read the next block of the sensor overlapping [from_ms, to_ms].
+ *
+ * Position before the oldest segment starts from the oldest one.
+ *
+ * @pos     where to start, moved past the block read, or to the end of
+ *          the log if there are no more blocks
+ * @header  filled with the block header
+ * @data    buffer of CONFIG_NODE_HISTORY_BLOCK_SIZE bytes
+ * @return false if there are no more blocks.
+*/
+bool
+history_log_read_next(int sensor,
+                      int64_t from_ms,
+                      int64_t to_ms,
+                      history_log_pos_t *pos,
+                      history_block_header_t *header,
+                      uint8_t *data);
+
+/**
+ * Fill segment counters of the statistics.
+*/
+void
+history_log_get_stats(node_history_stats_t *stats);
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "node_history.h"
+#include "node_history_server.h"
+#include "node_network.h"
+
+enum history_server_const_internal
+{
+    HISTORY_SERVER_MAX_ID = 24,
+    HISTORY_SERVER_MAX_REQUEST = 192,
+    HISTORY_SERVER_SAMPLE_LEN = 48,
+    HISTORY_SERVER_TAIL_LEN = 48    /**< Room for closing the chunk */
+};
+
+static const char *TAG = "history";
+
+static const char *HISTORY_REQUEST_TOPIC = "nodes/node1/history/request";
+
+/**
+ * Parsed request.
+*/
+typedef struct history_request
+{
+    char id[HISTORY_SERVER_MAX_ID];             /**< Request id, last part of response topic */
+    char sensor[NODE_HISTORY_MAX_NAME_LEN];     /**< Sensor name */
+    int64_t from_ms;                            /**< Range start */
+    int64_t to_ms;                              /**< Range end */
+} history_request_t;
+
+/**
+ * Chunk being filled by query callback.
+*/
+typedef struct history_chunk
+{
+    char *data;         /**< Chunk buffer */
+    size_t size;        /**< Buffer size */
+    size_t len;         /**< Text length */
+    int64_t prev_ms;    /**< Time of the previous sample */
+    uint32_t count;     /**< Samples in chunk */
+    bool full;          /**< Last sample did not fit */
+} history_chunk_t;
+
+static TaskHandle_t server_task = NULL;
+
+/** Request received by MQTT task, waiting for the server. */
+static history_request_t server_inbox;
+static bool server_inbox_full = false;
+static portMUX_TYPE server_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** Query in progress. */
+static history_request_t server_query;
+static bool server_active = false;
+static node_history_cursor_t server_cursor;    /**< Start of the next chunk */
+static int64_t server_prev_ms;                  /**< Time of the last sample sent */
+static uint32_t server_seq;
+static uint32_t server_count;
+static bool server_chunk_ready = false;
+static bool server_chunk_last = false;
+
+static char server_topic[MQTT_MAX_TOPIC_LEN];
+static char server_chunk[NODE_NETWORK_BULK_MAX_LEN];
+
+/**
+ * Find value of the key in flat JSON object.
+*/
+static const char *
+history_json_value(const char *json, const char *key)
+{
+    char pattern[16];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *p = strstr(json, pattern);
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    p += strlen(pattern);
+    while (*p == ' ')
+    {
+        ++p;
+    }
+    if (*p++ != ':')
+    {
+        return NULL;
+    }
+    while (*p == ' ')
+    {
+        ++p;
+    }
+    return p;
+}
+
+/**
+ * Get string value, only characters safe in a topic level are allowed.
+*/
+static bool
+history_json_string(const char *json, const char *key, char *out, size_t size)
+{
+    const char *p = history_json_value(json, key);
+    if (p == NULL || *p++ != '"')
+    {
+        return false;
+    }
+
+    size_t len = 0;
+    for (; *p != '"'; ++p)
+    {
+        bool safe = (*p >= '0' && *p <= '9')
+                    || (*p >= 'a' && *p <= 'z')
+                    || (*p >= 'A' && *p <= 'Z')
+                    || *p == '_' || *p == '-' || *p == '.';
+        if (!safe || len + 1 >= size)
+        {
+            return false;
+        }
+        out[len++] = *p;
+    }
+    out[len] = '\0';
+    return len > 0;
+}
+
+static bool
+history_json_int64(const char *json, const char *key, int64_t *out)
+{
+    const char *p = history_json_value(json, key);
+    if (p == NULL)
+    {
+        return false;
+    }
+
+    char *end;
+    long long value = strtoll(p, &end, 10);
+    if (end == p)
+    {
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+static void
+history_server_reply_error(const history_request_t *request, const char *error)
+{
+    char topic[MQTT_MAX_TOPIC_LEN];
+    char data[MQTT_MAX_DATA_LEN];
+    snprintf(topic, sizeof(topic), "nodes/node1/history/response/%s", request->id);
+    snprintf(data, sizeof(data),
+             "{\"id\": \"%s\", \"seq\": 0, \"last\": true, \"count\": 0, \"error\": \"%s\"}",
+             request->id, error);
+    if (!node_network_send_bulk(topic, data))
+    {
+        ESP_LOGW(TAG, "Query %s: %s, reply dropped", request->id, error);
+    }
+}
+
+/**
+ * Parse request and pass it to the server task.  Runs in MQTT task.
+*/
+static void
+history_server_request(const char *topic, int topic_len, const char *data, int data_len, void *arg)
+{
+    char json[HISTORY_SERVER_MAX_REQUEST];
+    if (data_len >= sizeof(json))
+    {
+        ESP_LOGW(TAG, "Request too long, %d bytes", data_len);
+        return;
+    }
+    memcpy(json, data, data_len);
+    json[data_len] = '\0';
+
+    history_request_t request = {
+        .from_ms = 0,
+        .to_ms = node_history_now_ms()
+    };
+    if (!history_json_string(json, "id", request.id, sizeof(request.id)))
+    {
+        ESP_LOGW(TAG, "Request without valid id ignored");
+        return;
+    }
+    if (!history_json_string(json, "sensor", request.sensor, sizeof(request.sensor)))
+    {
+        history_server_reply_error(&request, "bad sensor");
+        return;
+    }
+    history_json_int64(json, "from", &request.from_ms);
+    history_json_int64(json, "to", &request.to_ms);
+    if (request.from_ms > request.to_ms)
+    {
+        history_server_reply_error(&request, "bad range");
+        return;
+    }
+
+    bool accepted = false;
+    portENTER_CRITICAL(&server_lock);
+    if (!server_inbox_full)
+    {
+        server_inbox = request;
+        server_inbox_full = true;
+        accepted = true;
+    }
+    portEXIT_CRITICAL(&server_lock);
+
+    if (accepted)
+    {
+        xTaskNotifyGive(server_task);
+    }
+    else
+    {
+        history_server_reply_error(&request, "busy");
+    }
+}
+
+static bool
+history_server_sample(int64_t time_ms, float value, void *arg)
+{
+    history_chunk_t *chunk = (history_chunk_t *)arg;
+    char sample[HISTORY_SERVER_SAMPLE_LEN];
+    int len = snprintf(sample, sizeof(sample),
+                       "%s[%" PRId64 ",%.7g]",
+                       chunk->count ? "," : "",
+                       time_ms - chunk->prev_ms,
+                       value);
+    if (chunk->len + len + HISTORY_SERVER_TAIL_LEN >= chunk->size)
+    {
+        chunk->full = true;
+        return false;
+    }
+
+    memcpy(chunk->data + chunk->len, sample, len);
+    chunk->len += len;
+    chunk->prev_ms = time_ms;
+    ++chunk->count;
+    return true;
+}
+
+/**
+ * Fill the next chunk starting from the cursor.
+*/
+static void
+history_server_build_chunk()
+{
+    history_chunk_t chunk = {
+        .data = server_chunk,
+        .size = sizeof(server_chunk),
+        .prev_ms = server_prev_ms
+    };
+    chunk.len = snprintf(server_chunk, sizeof(server_chunk),
+                         "{\"id\": \"%s\", \"seq\": %" PRIu32 ", \"t\": %" PRId64 ", \"s\": [",
+                         server_query.id, server_seq, server_prev_ms);
+
+    // The cursor stops on the sample which did not fit, next chunk starts with it
+    node_history_query(server_query.sensor,
+                       server_query.from_ms,
+                       server_query.to_ms,
+                       &server_cursor,
+                       &history_server_sample,
+                       &chunk);
+    server_count += chunk.count;
+    server_prev_ms = chunk.prev_ms;
+
+    if (chunk.full)
+    {
+        snprintf(server_chunk + chunk.len, sizeof(server_chunk) - chunk.len, "]}");
+        server_chunk_last = false;
+    }
+    else
+    {
+        snprintf(server_chunk + chunk.len, sizeof(server_chunk) - chunk.len,
+                 "], \"last\": true, \"count\": %" PRIu32 "}",
+                 server_count);
+        server_chunk_last = true;
+    }
+    server_chunk_ready = true;
+}
+
+bool
+history_server_poll()
+{
+    if (server_active && !node_network_is_ready())
+    {
+        ESP_LOGW(TAG, "Query %s aborted, network is down", server_query.id);
+        server_active = false;
+    }
+
+    if (!server_active)
+    {
+        portENTER_CRITICAL(&server_lock);
+        if (server_inbox_full)
+        {
+            server_query = server_inbox;
+            server_inbox_full = false;
+            server_active = true;
+        }
+        portEXIT_CRITICAL(&server_lock);
+
+        if (!server_active)
+        {
+            return false;
+        }
+
+        ESP_LOGI(TAG, "Query %s: %s %" PRId64 "..%" PRId64,
+                 server_query.id, server_query.sensor, server_query.from_ms, server_query.to_ms);
+        snprintf(server_topic, sizeof(server_topic),
+                 "nodes/node1/history/response/%s", server_query.id);
+        memset(&server_cursor, 0, sizeof(server_cursor));
+        server_prev_ms = server_query.from_ms;
+        server_seq = 0;
+        server_count = 0;
+        server_chunk_ready = false;
+    }
+
+    // Send while the network layer accepts bulk messages
+    while (true)
+    {
+        if (!server_chunk_ready)
+        {
+            history_server_build_chunk();
+        }
+        if (!node_network_send_bulk(server_topic, server_chunk))
+        {
+            return true;
+        }
+
+        server_chunk_ready = false;
+        ++server_seq;
+        if (server_chunk_last)
+        {
+            ESP_LOGI(TAG, "Query %s: %" PRIu32 " samples in %" PRIu32 " chunks",
+                     server_query.id, server_count, server_seq);
+            server_active = false;
+            return server_inbox_full;
+        }
+    }
+}
+
+void
+history_server_start(TaskHandle_t task)
+{
+    server_task = task;
+    node_network_handle(HISTORY_REQUEST_TOPIC, &history_server_request, NULL);
+}
\ No newline at end of file
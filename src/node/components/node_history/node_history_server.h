@@ -0,0 +1,40 @@
+#pragma once
+/**
+ * History range queries over MQTT.
+ *
+ * Request is published on nodes/node1/history/request:
+ *
+ *   {"id": "q42", "sensor": "28ff641e8216c3a1", "from": 1697000000000, "to": 1697003600000}
+ *
+ * Times are ms since epoch, "to" defaults to now.  Response is a sequence
+ * of chunks on nodes/node1/history/response/<id>:
+ *
+ *   {"id": "q42", "seq": 0, "t": 1697000000512, "s": [[0,21.5],[1001,21.5625]]}
+ *
+ * Sample time is the delta from the previous sample, the first from "t".
+ * The last chunk has "last": true and the total "count"; errors are
+ * reported with "error" in a single last chunk.
+ *
+ * One query is served at a time.  Chunks are sent as bulk messages,
+ * which yield to live telemetry.
+*/
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * Subscribe to requests.
+ *
+ * @task    task which serves the queries, notified on request
+*/
+void
+history_server_start(TaskHandle_t task);
+
+/**
+ * Serve pending request and send next chunk of the current query.
+ *
+ * @return true if a query is in progress and the server needs to be
+ *         polled again soon.
+*/
+bool
+history_server_poll();
\ No newline at end of file
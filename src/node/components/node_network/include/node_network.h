@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "node_hist.h"
 
 /**
  * Public interface of the network layer.
@@ -16,6 +18,56 @@ enum mqtt_const
     MQTT_MAX_DATA_LEN = 128     /** Data buffer length */
 };
 
+/**
+ * Constants for network state subscriptions.
+ */
+enum node_network_const
+{
+    NODE_NETWORK_MAX_SUBSCRIBERS = 8,   /** Subscribers limit */
+    NODE_NETWORK_MAX_HANDLERS = 4,      /** Incoming topic handlers limit */
+    NODE_NETWORK_BULK_MAX_LEN = 768,    /** Bulk message data limit */
+    NODE_NETWORK_MAX_BROKERS = 3,       /** Primary broker and fallbacks */
+    NODE_NETWORK_BROKER_URI_LEN = 96    /** Broker URI buffer length */
+};
+
+/**
+ * State of the network layer.
+ */
+typedef enum node_network_state
+{
+    NODE_NETWORK_DISCONNECTED,  /** Messages cannot be transported */
+    NODE_NETWORK_CONNECTED      /** Connected to MQTT broker */
+} node_network_state_t;
+
+/**
+ * Network state change callback.
+ *
+ * Called from network event loop, must not block.  Typical use is
+ * notifying the subscribed task.
+ *
+ * @state   new state
+ * @arg     argument given at subscription
+ */
+typedef void (*node_network_state_cb_t)(node_network_state_t state, void *arg);
+
+/**
+ * Incoming message callback.
+ *
+ * Called from MQTT client task, must not block.  Topic and data are not
+ * NUL-terminated and valid during the call only.
+ *
+ * @topic       message topic
+ * @topic_len   topic length
+ * @data        message data
+ * @data_len    data length
+ * @arg         argument given at registration
+ */
+typedef void (*node_network_message_cb_t)(const char *topic,
+                                          int topic_len,
+                                          const char *data,
+                                          int data_len,
+                                          void *arg);
+
 /**
  * MQTT message to be published.
  * 
@@ -30,6 +82,111 @@ typedef struct mqtt_message
     char data[MQTT_MAX_DATA_LEN];   /** Data buffer */
 } mqtt_message_t;                   /** Alias for message structure */
 
+/**
+ * Number of buckets in burst size histogram.
+ */
+enum node_network_burst_const
+{
+    NODE_NETWORK_BURST_BUCKETS = 6 /** 1, 2-3, 4-7, 8-15, 16-31, 32+ messages */
+};
+
+/**
+ * Statistics of MQTT publish bursts.
+ *
+ * Messages are gathered in the queue and published in bursts, the radio
+ * sleeps between them.  Active time is measured from the first to the last
+ * publish of a burst and approximates radio-on time spent on transmission.
+ */
+typedef struct node_network_burst_stats
+{
+    uint32_t interval_ms;       /** Effective burst interval */
+    uint32_t bursts;            /** Number of bursts published */
+    uint32_t messages;          /** Number of messages published */
+    uint32_t max_burst;         /** Largest burst, messages */
+    uint32_t early_bursts;      /** Bursts forced by full queue */
+    uint32_t dropped;           /** Messages dropped on full queue */
+    uint64_t active_us;         /** Total burst active time, us */
+    uint32_t max_active_us;     /** Longest burst active time, us */
+    uint32_t size_hist[NODE_NETWORK_BURST_BUCKETS]; /** Burst size histogram */
+} node_network_burst_stats_t;
+
+/**
+ * Statistics of message delivery latency.
+ *
+ * Latency is measured from enqueueing of the message till PUBACK from
+ * the broker, in microseconds.
+ */
+typedef struct node_network_latency_stats
+{
+    node_log_hist_t hist;   /** Latency histogram, us */
+    uint32_t unmatched;     /** Published messages never acknowledged */
+} node_network_latency_stats_t;
+
+/**
+ * Statistics of alarm delivery.
+ *
+ * Latency is measured from enqueueing of the alarm till PUBACK from
+ * the broker, in microseconds.
+ */
+typedef struct node_network_alarm_stats
+{
+    node_log_hist_t hist;   /** Latency histogram, us */
+    uint32_t queued;        /** Alarms queued */
+    uint32_t dropped;       /** Alarms dropped on full alarm queue */
+    uint32_t unmatched;     /** Published alarms never acknowledged */
+} node_network_alarm_stats_t;
+
+/**
+ * Statistics of connections to the broker.
+ *
+ * Connect time is measured from the start of an attempt till CONNACK,
+ * it includes TCP and TLS handshakes.  Heap is the drop of the free heap
+ * low watermark during the attempt, so an attempt is accounted only when
+ * it took more heap than anything before it.
+ */
+typedef struct node_network_connect_stats
+{
+    node_log_hist_t full;       /** Connect time without a cached TLS session, us */
+    node_log_hist_t offered;    /** Connect time offering a cached TLS session, us */
+    uint32_t attempts;          /** Connection attempts */
+    uint32_t failed;            /** Attempts which did not get CONNACK */
+    uint32_t heap_full;         /** Largest heap taken by a full connect, bytes */
+    uint32_t heap_offered;      /** Largest heap taken by a connect offering a session, bytes */
+    bool tls;                   /** Broker URI is mqtts:// */
+    bool resumption;            /** TLS session is cached between connections */
+} node_network_connect_stats_t;
+
+/**
+ * Health of a broker.
+ *
+ * Times are smoothed over the last few samples, zero until the broker
+ * has been connected.
+ */
+typedef struct node_network_broker_stats
+{
+    char uri[NODE_NETWORK_BROKER_URI_LEN]; /** Broker URI */
+    uint32_t connects;      /** Successful connections */
+    uint32_t failures;      /** Failed attempts and lost connections */
+    uint32_t consecutive;   /** Failures since the last successful connection */
+    uint32_t connect_us;    /** Connect time, us */
+    uint32_t rtt_us;        /** PUBACK round trip time, us */
+    uint32_t retry_ms;      /** Time till the broker may be tried again, 0 if now */
+    bool current;           /** Client uses this broker */
+} node_network_broker_stats_t;
+
+/**
+ * Statistics of failover between brokers.
+ *
+ * Outage is measured from losing or leaving a broker till CONNACK of
+ * the next connection, to whichever broker it is.
+ */
+typedef struct node_network_failover_stats
+{
+    node_log_hist_t outage; /** Outage histogram, us */
+    uint32_t failovers;     /** Connections to another broker than the last one */
+    uint32_t switches;      /** Live connections left for a healthier broker */
+} node_network_failover_stats_t;
+
 /**
  * Start network layer.
  * 
@@ -51,9 +208,176 @@ node_network_start();
 bool
 node_network_ready_wait(int timeoutMS);
 
+/**
+ * Check whether network is ready to transport messages.
+ *
+ * @return true if network layer is ready for messaging, false otherwise
+*/
+bool
+node_network_is_ready();
+
+/**
+ * Subscribe to network state changes.
+ *
+ * Callback is called on every connected/disconnected transition.  If the
+ * network is already connected, callback is called immediately.
+ *
+ * @cb      state change callback
+ * @arg     callback argument
+ * @return true if subscribed, false if subscribers limit is reached.
+*/
+bool
+node_network_subscribe(node_network_state_cb_t cb, void *arg);
+
+/**
+ * Handle incoming messages.
+ *
+ * Node subscribes to the topic filter on every connection to the broker.
+ * Filter is either exact topic or a prefix ending with "/#".
+ *
+ * @topic   topic filter, must stay valid
+ * @cb      message callback
+ * @arg     callback argument
+ * @return true if registered, false if handlers limit is reached.
+ */
+bool
+node_network_handle(const char *topic, node_network_message_cb_t cb, void *arg);
+
+/**
+ * Queue bulk message, e.g. a chunk of a large response.
+ *
+ * Bulk messages are published in the same bursts as regular ones, but
+ * are accepted only while the queue is at most half full and a bulk
+ * buffer is free, so they never take queue space needed by telemetry.
+ * The sender retries later when the message is not accepted.
+ *
+ * @topic   message topic
+ * @data    message data, up to NODE_NETWORK_BULK_MAX_LEN - 1 characters
+ * @return true if queued.
+ */
+bool
+node_network_send_bulk(const char *topic, const char *data);
+
+/**
+ * Queue alarm message, e.g. a threshold breach or a sensor failure.
+ *
+ * Alarms have own small queue, which the publishing task drains ahead
+ * of telemetry and without waiting for the burst schedule.  They are
+ * published with QoS 1.
+ *
+ * @msg     message
+ * @retain  broker keeps the message as the current state of the topic
+ * @return true if queued, false if alarm queue is full.
+ */
+bool
+node_network_send_alarm(const mqtt_message_t *msg, bool retain);
+
+/**
+ * Get statistics of publish bursts.
+ *
+ * @stats   structure to be filled
+ */
+void
+node_network_get_burst_stats(node_network_burst_stats_t *stats);
+
+/**
+ * Get statistics of delivery latency.
+ *
+ * @stats   structure to be filled
+ */
+void
+node_network_get_latency_stats(node_network_latency_stats_t *stats);
+
+/**
+ * Get statistics of alarm delivery.
+ *
+ * @stats   structure to be filled
+ */
+void
+node_network_get_alarm_stats(node_network_alarm_stats_t *stats);
+
+/**
+ * Get statistics of connections to the broker.
+ *
+ * @stats   structure to be filled
+ */
+void
+node_network_get_connect_stats(node_network_connect_stats_t *stats);
+
+/**
+ * Get health of a broker.
+ *
+ * @index   broker index, 0 is the primary one
+ * @stats   structure to be filled
+ * @return false if there is no broker with this index.
+ */
+bool
+node_network_get_broker_stats(int index, node_network_broker_stats_t *stats);
+
+/**
+ * Get statistics of failover between brokers.
+ *
+ * @stats   structure to be filled
+ */
+void
+node_network_get_failover_stats(node_network_failover_stats_t *stats);
+
+/**
+ * Replace broker list.
+ *
+ * The list is stored in NVS and the node reconnects to the healthiest
+ * broker of it.  Brokers are preferred in the list order.  An empty list
+ * restores CONFIG_NODE_MQTT_BROKER_URI.
+ *
+ * @uris    broker URIs, mqtt:// or mqtts:// with the port
+ * @count   number of URIs, up to NODE_NETWORK_MAX_BROKERS
+ * @return false if the list is invalid or cannot be stored.
+ */
+bool
+node_network_set_brokers(const char *const *uris, int count);
+
+/**
+ * Reset burst, latency, alarm, connection and failover statistics.
+ */
+void
+node_network_reset_stats();
+
+/**
+ * Register microbenchmarks of message formatting and queueing.
+ */
+void
+node_network_bench_register();
+
+/**
+ * Check if the clock has been synchronised over SNTP.
+ */
+bool
+node_network_time_synced();
+
+/**
+ * Wall clock time of a moment taken with esp_timer_get_time().
+ *
+ * Moments taken before the first synchronisation are converted as well,
+ * once the clock is synchronised.
+ *
+ * @time_us monotonic time, us since boot
+ * @return ms since epoch, -1 if the clock is not synchronised yet.
+ */
+int64_t
+node_network_wall_ms(int64_t time_us);
+
+/**
+ * Queue sensor reading.
+ *
+ * Payload carries capture time as "t", ms since epoch, or as "up", ms
+ * since boot, while the clock is not synchronised.
+ *
+ * @time_us capture time, esp_timer_get_time() at conversion
+ */
 void node_mqtt_send_sensor_value(const char *name,
                                  const char *quantity,
                                  const char *unit,
-                                 float value);
+                                 float value,
+                                 int64_t time_us);
 
 void node_mqtt_send_message(const mqtt_message_t *msg);
@@ -2,11 +2,19 @@
 
 #include <stdbool.h>
 
+enum wifi_const
+{
+    WIFI_WAIT_FOREVER = -1  /** Timeout for infinite wait */
+};
+
 void wifi_init();
 
 bool wifi_run();
 
-void wifi_scan();
+/**
+ * Print APs seen by the background scan, instantly.
+ */
+void wifi_list();
 
 bool wifi_connect(const char *ssid, const char *pass);
 
@@ -0,0 +1,497 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "nvs.h"
+#endif
+#include "node_broker.h"
+#include "node_diag.h"
+
+enum broker_const_internal
+{
+    BROKER_BACKOFF_MIN_MS = CONFIG_NODE_MQTT_BACKOFF_MIN_MS,
+    BROKER_BACKOFF_MAX_MS = CONFIG_NODE_MQTT_BACKOFF_MAX_MS,
+    BROKER_FAILOVER_RTT_MS = CONFIG_NODE_MQTT_FAILOVER_RTT_MS,
+    BROKER_FAILBACK_S = CONFIG_NODE_MQTT_FAILBACK_S,
+    BROKER_MARGIN_MS = CONFIG_NODE_MQTT_FAILOVER_MARGIN_MS,
+    /** Health of the current broker is checked that often while connected. */
+    BROKER_CHECK_MS = 1000,
+    /** New sample weighs 1/4 in smoothed times. */
+    BROKER_SMOOTHING = 4,
+    BROKER_LIST_LEN = NODE_NETWORK_MAX_BROKERS * NODE_NETWORK_BROKER_URI_LEN
+};
+
+typedef enum broker_state
+{
+    BROKER_IDLE,        /** Client stopped or about to be, no broker chosen */
+    BROKER_CONNECTING,  /** Client started, no CONNACK yet */
+    BROKER_CONNECTED    /** CONNACK received */
+} broker_state_t;
+
+typedef struct broker
+{
+    node_network_broker_stats_t stats;  /** Health, current flag is not kept */
+    int64_t retry_us;                   /** Earliest next attempt, 0 if any time */
+} broker_t;
+
+static const char *TAG = "broker";
+static const char *BROKER_NVS_NAMESPACE = "mqtt";
+static const char *BROKER_NVS_KEY = "brokers";
+
+static broker_t brokers[NODE_NETWORK_MAX_BROKERS];
+static int brokers_count = 0;
+static broker_state_t broker_state = BROKER_IDLE;
+/** Broker the client uses, or is about to use when idle. */
+static int broker_current = 0;
+/** Broker of the last connection, -1 if none yet. */
+static int broker_last = -1;
+static int64_t broker_connected_us = 0;
+/** Start of the current outage, 0 if none. */
+static int64_t broker_outage_us = 0;
+static node_network_failover_stats_t broker_failover;
+static char broker_uri_buf[NODE_NETWORK_BROKER_URI_LEN];
+static portMUX_TYPE broker_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool broker_is_tls(const char *uri)
+{
+    return strncmp(uri, "mqtts://", 8) == 0;
+}
+
+static bool broker_valid(const char *uri, bool tls_only)
+{
+    size_t len = strlen(uri);
+    if (len == 0 || len >= NODE_NETWORK_BROKER_URI_LEN || strchr(uri, ' ') != NULL)
+    {
+        return false;
+    }
+    return broker_is_tls(uri) || (!tls_only && strncmp(uri, "mqtt://", 7) == 0);
+}
+
+/**
+ * Fill broker table from space separated list.
+ *
+ * @return number of brokers.
+ */
+static int broker_parse(const char *list, broker_t *table)
+{
+    int count = 0;
+    while (*list != '\0' && count < NODE_NETWORK_MAX_BROKERS)
+    {
+        size_t len = strcspn(list, " ");
+        if (len > 0 && len < NODE_NETWORK_BROKER_URI_LEN)
+        {
+            memset(&table[count], 0, sizeof(table[count]));
+            memcpy(table[count].stats.uri, list, len);
+            ++count;
+        }
+        list += len;
+        list += strspn(list, " ");
+    }
+    return count;
+}
+
+/**
+ * Smooth a time sample, the first one is taken as is.
+ */
+static uint32_t broker_smooth(uint32_t average, uint32_t sample)
+{
+    if (average == 0)
+    {
+        return sample;
+    }
+    return average - average / BROKER_SMOOTHING + sample / BROKER_SMOOTHING;
+}
+
+/**
+ * Exponential backoff with up to a quarter of jitter, so nodes which
+ * lost the same broker do not come back to it in step.
+ */
+static int64_t broker_backoff_us(uint32_t consecutive, int64_t now_us)
+{
+    int shift = consecutive > 16 ? 16 : (int)consecutive - 1;
+    int64_t backoff_ms = (int64_t)BROKER_BACKOFF_MIN_MS << (shift > 0 ? shift : 0);
+    if (backoff_ms > BROKER_BACKOFF_MAX_MS)
+    {
+        backoff_ms = BROKER_BACKOFF_MAX_MS;
+    }
+    int64_t backoff_us = backoff_ms * 1000;
+    return backoff_us + now_us % (backoff_us / 4 + 1);
+}
+
+/**
+ * Choose the healthiest broker which is not backing off.
+ *
+ * Score is connect time plus PUBACK round trip time, and a margin per
+ * position in the list, so the primary is preferred unless a fallback
+ * is faster by more than the margin.  Brokers never connected are taken
+ * as healthy as the best known one, so they are tried in the list order
+ * and do not win over a known broker ahead of them.
+ * Called with broker_lock.
+ *
+ * @wait_us filled with time till the first broker may be tried, if none may now
+ * @return broker index, -1 if all are backing off.
+ */
+static int broker_select(int64_t now_us, int64_t *wait_us)
+{
+    int64_t known = -1;
+    for (int n = 0; n < brokers_count; ++n)
+    {
+        const broker_t *broker = &brokers[n];
+        int64_t health = (int64_t)broker->stats.connect_us + broker->stats.rtt_us;
+        if (broker->retry_us <= now_us && broker->stats.connects > 0 && (known < 0 || health < known))
+        {
+            known = health;
+        }
+    }
+
+    int best = -1;
+    int64_t best_score = 0;
+    int64_t retry_us = INT64_MAX;
+    for (int n = 0; n < brokers_count; ++n)
+    {
+        const broker_t *broker = &brokers[n];
+        if (broker->retry_us > now_us)
+        {
+            if (broker->retry_us < retry_us)
+            {
+                retry_us = broker->retry_us;
+            }
+            continue;
+        }
+        int64_t health = broker->stats.connects > 0
+                         ? (int64_t)broker->stats.connect_us + broker->stats.rtt_us
+                         : (known > 0 ? known : 0);
+        int64_t score = health + (int64_t)n * BROKER_MARGIN_MS * 1000;
+        if (best < 0 || score < best_score)
+        {
+            best = n;
+            best_score = score;
+        }
+    }
+    *wait_us = best < 0 ? retry_us - now_us : 0;
+    return best;
+}
+
+/**
+ * Leave the current broker for a healthier one.
+ *
+ * A broker with PUBACK round trip over the limit is left as if it failed.
+ * Otherwise the node returns to a better broker once the connection has
+ * lasted the failback time, so a flapping broker is not chosen over and
+ * over, and a fallback never connected is not probed while the current
+ * one works.  Called with broker_lock.
+ *
+ * @return true if the client has to be restarted.
+ */
+static bool broker_check(int64_t now_us)
+{
+    broker_t *current = &brokers[broker_current];
+    bool slow = BROKER_FAILOVER_RTT_MS > 0
+                && current->stats.rtt_us > (uint32_t)BROKER_FAILOVER_RTT_MS * 1000;
+    bool settled = now_us - broker_connected_us >= (int64_t)BROKER_FAILBACK_S * 1000000;
+    if (!slow && !settled)
+    {
+        return false;
+    }
+
+    if (slow)
+    {
+        current->retry_us = now_us + broker_backoff_us(current->stats.consecutive + 1, now_us);
+    }
+    int64_t wait_us;
+    int next = broker_select(now_us, &wait_us);
+    if (next >= 0
+        && next != broker_current
+        && (slow || next < broker_current || brokers[next].stats.connects > 0))
+    {
+        broker_current = next;
+        return true;
+    }
+    current->retry_us = 0;
+    return false;
+}
+
+/**
+ * Diagnostics provider: broker health and failover.
+*/
+static void broker_diag(node_diag_emit_t emit)
+{
+    char name[16];
+    char data[NODE_DIAG_MAX_DATA_LEN];
+    node_network_broker_stats_t stats;
+    for (int n = 0; broker_get_stats(n, &stats); ++n)
+    {
+        snprintf(name, sizeof(name), "broker/%d", n);
+        snprintf(data,
+                 sizeof(data),
+                 "{\"connects\":%" PRIu32 ",\"failures\":%" PRIu32 ",\"connect_ms\":%" PRIu32
+                 ",\"rtt_ms\":%" PRIu32 ",\"current\":%s}",
+                 stats.connects,
+                 stats.failures,
+                 stats.connect_us / 1000,
+                 stats.rtt_us / 1000,
+                 stats.current ? "true" : "false");
+        emit(name, data);
+    }
+
+    node_network_failover_stats_t failover;
+    broker_get_failover_stats(&failover);
+    snprintf(data,
+             sizeof(data),
+             "{\"failovers\":%" PRIu32 ",\"switches\":%" PRIu32 ",\"outage_p50_ms\":%" PRIu32
+             ",\"outage_p99_ms\":%" PRIu32 "}",
+             failover.failovers,
+             failover.switches,
+             node_log_hist_percentile(&failover.outage, 500) / 1000,
+             node_log_hist_percentile(&failover.outage, 990) / 1000);
+    emit("failover", data);
+}
+
+void broker_init()
+{
+    char list[BROKER_LIST_LEN] = "";
+#if !CONFIG_IDF_TARGET_LINUX
+    nvs_handle_t nvs;
+    if (nvs_open(BROKER_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK)
+    {
+        size_t size = sizeof(list);
+        if (nvs_get_str(nvs, BROKER_NVS_KEY, list, &size) != ESP_OK)
+        {
+            list[0] = '\0';
+        }
+        nvs_close(nvs);
+    }
+#endif
+    brokers_count = broker_parse(list, brokers);
+    if (brokers_count == 0)
+    {
+        brokers_count = broker_parse(CONFIG_NODE_MQTT_BROKER_URI, brokers);
+    }
+    node_log_hist_init(&broker_failover.outage);
+    node_diag_register(&broker_diag);
+    ESP_LOGI(TAG, "%d broker(s), primary %s", brokers_count, brokers[0].stats.uri);
+}
+
+broker_action_t broker_poll(int64_t now_us, int64_t *wait_us)
+{
+    broker_action_t action = BROKER_KEEP;
+    *wait_us = -1;
+
+    portENTER_CRITICAL(&broker_lock);
+    if (broker_state == BROKER_CONNECTED && brokers_count > 1)
+    {
+        *wait_us = (int64_t)BROKER_CHECK_MS * 1000;
+        if (broker_check(now_us))
+        {
+            broker_failover.switches++;
+            broker_outage_us = now_us;
+            broker_state = BROKER_IDLE;
+            action = BROKER_START;
+        }
+    }
+
+    if (broker_state == BROKER_IDLE && action == BROKER_KEEP)
+    {
+        int next = broker_select(now_us, wait_us);
+        if (next >= 0)
+        {
+            broker_current = next;
+            action = BROKER_START;
+        }
+        else
+        {
+            action = BROKER_STOP;
+        }
+    }
+    portEXIT_CRITICAL(&broker_lock);
+
+    return action;
+}
+
+const char *broker_start()
+{
+    portENTER_CRITICAL(&broker_lock);
+    strlcpy(broker_uri_buf, brokers[broker_current].stats.uri, sizeof(broker_uri_buf));
+    broker_state = BROKER_CONNECTING;
+    portEXIT_CRITICAL(&broker_lock);
+
+    ESP_LOGI(TAG, "Connecting to %s", broker_uri_buf);
+    return broker_uri_buf;
+}
+
+bool broker_all_tls()
+{
+    bool tls = true;
+    portENTER_CRITICAL(&broker_lock);
+    for (int n = 0; n < brokers_count; ++n)
+    {
+        tls = tls && broker_is_tls(brokers[n].stats.uri);
+    }
+    portEXIT_CRITICAL(&broker_lock);
+    return tls;
+}
+
+void broker_connected(uint32_t connect_us)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&broker_lock);
+    broker_t *broker = &brokers[broker_current];
+    broker->stats.connects++;
+    broker->stats.consecutive = 0;
+    broker->stats.connect_us = broker_smooth(broker->stats.connect_us, connect_us);
+    broker->retry_us = 0;
+    if (broker_outage_us != 0)
+    {
+        node_log_hist_add(&broker_failover.outage, (uint32_t)(now - broker_outage_us));
+        broker_outage_us = 0;
+    }
+    if (broker_last >= 0 && broker_last != broker_current)
+    {
+        broker_failover.failovers++;
+    }
+    broker_last = broker_current;
+    broker_connected_us = now;
+    broker_state = BROKER_CONNECTED;
+    portEXIT_CRITICAL(&broker_lock);
+}
+
+void broker_disconnected(bool failed)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&broker_lock);
+    // Events of a client stopped by the policy are not the broker's fault
+    if (broker_state != BROKER_IDLE)
+    {
+        broker_t *broker = &brokers[broker_current];
+        if (failed)
+        {
+            broker->stats.failures++;
+            broker->stats.consecutive++;
+            broker->retry_us = now + broker_backoff_us(broker->stats.consecutive, now);
+        }
+        if (broker_state == BROKER_CONNECTED || broker_outage_us == 0)
+        {
+            broker_outage_us = now;
+        }
+        broker_state = BROKER_IDLE;
+    }
+    portEXIT_CRITICAL(&broker_lock);
+}
+
+void broker_rtt(uint32_t rtt_us)
+{
+    portENTER_CRITICAL(&broker_lock);
+    if (broker_state == BROKER_CONNECTED)
+    {
+        node_network_broker_stats_t *stats = &brokers[broker_current].stats;
+        stats->rtt_us = broker_smooth(stats->rtt_us, rtt_us);
+    }
+    portEXIT_CRITICAL(&broker_lock);
+}
+
+bool broker_set(const char *const *uris, int count, bool tls_only)
+{
+    if (count > NODE_NETWORK_MAX_BROKERS)
+    {
+        return false;
+    }
+
+    char list[BROKER_LIST_LEN] = "";
+    for (int n = 0; n < count; ++n)
+    {
+        if (!broker_valid(uris[n], tls_only))
+        {
+            return false;
+        }
+        if (n > 0)
+        {
+            strlcat(list, " ", sizeof(list));
+        }
+        strlcat(list, uris[n], sizeof(list));
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
+    nvs_handle_t nvs;
+    if (nvs_open(BROKER_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        return false;
+    }
+    esp_err_t err = count > 0 ? nvs_set_str(nvs, BROKER_NVS_KEY, list)
+                              : nvs_erase_key(nvs, BROKER_NVS_KEY);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        err = ESP_OK;
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot store broker list: %s", esp_err_to_name(err));
+        return false;
+    }
+#endif
+
+    broker_t table[NODE_NETWORK_MAX_BROKERS];
+    int parsed = broker_parse(count > 0 ? list : CONFIG_NODE_MQTT_BROKER_URI, table);
+
+    int64_t now = esp_timer_get_time();
+
+    // Idle state makes the next poll reconnect to the best broker of the list
+    portENTER_CRITICAL(&broker_lock);
+    memcpy(brokers, table, sizeof(table[0]) * parsed);
+    brokers_count = parsed;
+    broker_current = 0;
+    broker_last = -1;
+    if (broker_state == BROKER_CONNECTED)
+    {
+        broker_outage_us = now;
+    }
+    broker_state = BROKER_IDLE;
+    portEXIT_CRITICAL(&broker_lock);
+
+    return true;
+}
+
+bool broker_get_stats(int index, node_network_broker_stats_t *stats)
+{
+    int64_t now = esp_timer_get_time();
+    bool found = false;
+
+    portENTER_CRITICAL(&broker_lock);
+    if (index >= 0 && index < brokers_count)
+    {
+        const broker_t *broker = &brokers[index];
+        *stats = broker->stats;
+        stats->retry_ms = broker->retry_us > now ? (uint32_t)((broker->retry_us - now) / 1000) : 0;
+        stats->current = index == broker_current && broker_state != BROKER_IDLE;
+        found = true;
+    }
+    portEXIT_CRITICAL(&broker_lock);
+
+    return found;
+}
+
+void broker_get_failover_stats(node_network_failover_stats_t *stats)
+{
+    portENTER_CRITICAL(&broker_lock);
+    *stats = broker_failover;
+    portEXIT_CRITICAL(&broker_lock);
+}
+
+void broker_reset_stats()
+{
+    portENTER_CRITICAL(&broker_lock);
+    node_log_hist_init(&broker_failover.outage);
+    broker_failover.failovers = 0;
+    broker_failover.switches = 0;
+    portEXIT_CRITICAL(&broker_lock);
+}
\ No newline at end of file
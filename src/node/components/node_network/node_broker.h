@@ -0,0 +1,91 @@
+#pragma once
+
+#include "node_network.h"
+
+/**
+ * Broker list and failover policy.
+ *
+ * The policy runs in the publishing task, which owns the MQTT client.
+ * Client events are reported from MQTT client task, they only update
+ * the state and wake the publishing task up.
+ */
+
+/**
+ * Client action requested by the policy.
+ */
+typedef enum broker_action
+{
+    BROKER_KEEP,        /** Leave the client as it is */
+    BROKER_STOP,        /** Stop the client, wait for the next broker */
+    BROKER_START,       /** Stop the client, then start it on broker_start() */
+} broker_action_t;
+
+/**
+ * Load broker list from NVS, CONFIG_NODE_MQTT_BROKER_URI if there is none.
+ */
+void broker_init();
+
+/**
+ * Run the policy.
+ *
+ * @now_us  current time
+ * @wait_us filled with time until the policy needs to run again
+ * @return action on the client.
+ */
+broker_action_t broker_poll(int64_t now_us, int64_t *wait_us);
+
+/**
+ * Begin connecting to the broker chosen by broker_poll().
+ *
+ * Called once the client is stopped, so events of the old connection
+ * are not accounted to the new broker.
+ *
+ * @return URI of the broker, valid until the next broker_poll().
+ */
+const char *broker_start();
+
+/**
+ * Check if every broker in the list uses TLS.
+ */
+bool broker_all_tls();
+
+/**
+ * Connection established.
+ *
+ * @connect_us  time from the start of the attempt till CONNACK
+ */
+void broker_connected(uint32_t connect_us);
+
+/**
+ * Connection attempt failed or connection was lost.
+ *
+ * @failed  broker is to blame, false if WiFi is down
+ */
+void broker_disconnected(bool failed);
+
+/**
+ * Account PUBACK round trip time of the current broker.
+ */
+void broker_rtt(uint32_t rtt_us);
+
+/**
+ * Replace broker list, store it in NVS and reconnect to the best one.
+ *
+ * @tls_only    reject URIs without TLS
+ */
+bool broker_set(const char *const *uris, int count, bool tls_only);
+
+/**
+ * Get broker health, index 0 is the primary.
+ */
+bool broker_get_stats(int index, node_network_broker_stats_t *stats);
+
+/**
+ * Get failover statistics.
+ */
+void broker_get_failover_stats(node_network_failover_stats_t *stats);
+
+/**
+ * Reset failover statistics, broker health is kept.
+ */
+void broker_reset_stats();
\ No newline at end of file
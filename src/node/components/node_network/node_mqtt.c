@@ -1,12 +1,22 @@
 #include <stdio.h>
+#include <string.h>
+#include "esp_idf_version.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/event_groups.h"
 #include "mqtt_client.h"
+#include "node_broker.h"
 #include "node_mqtt.h"
+#include "node_tasks.h"
+#include "node_tls.h"
 #include "node_wifi.h"
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
 
 static const char *TAG = "mqtt";
 
@@ -15,25 +25,170 @@ static EventGroupHandle_t mqtt_event_group;
 enum mqtt_const_internal
 {
     CONNECTED_BIT = BIT0,
-    DEFAULT_CONNECT_TIMEOUT_MS = 3000
+    DEFAULT_CONNECT_TIMEOUT_MS = 3000,
+    MQTT_TASK_STACK = 4096
 };
 
+#if CONFIG_NODE_MQTT_TLS_CA
+/** Broker CA certificate, embedded from NODE_MQTT_TLS_CA_FILE. */
+extern const char mqtt_ca_pem[] asm("_binary_mqtt_ca_pem_start");
+#define MQTT_CA_PEM mqtt_ca_pem
+#else
+#define MQTT_CA_PEM NULL
+#endif
+
 static
 esp_mqtt_client_config_t mqtt_cfg = {
-    // .host = "192.168.240.2",
-    // .port = 1883
-    .uri = "mqtt://192.168.240.2:1883/"
+#if ESP_IDF_VERSION_MAJOR >= 5
+    .broker.verification.certificate = MQTT_CA_PEM,
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE && !CONFIG_NODE_MQTT_TLS_CA
+    .broker.verification.crt_bundle_attach = esp_crt_bundle_attach,
+#endif
+#else
+    .cert_pem = MQTT_CA_PEM,
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE && !CONFIG_NODE_MQTT_TLS_CA
+    .crt_bundle_attach = esp_crt_bundle_attach,
+#endif
+#endif
 };
 
 enum mqtt_cont_internal
 {
-    MQTT_QUEUE_LENGTH = 8,
-    MQTT_QUEUE_READ_MS = 1000
+    MQTT_QUEUE_LENGTH = 16,
+    MQTT_BURST_FLUSH_SPACES = 4,    /* publish early when queue is that close to full */
+    MQTT_BURST_INTERVAL_MS = CONFIG_NODE_MQTT_BURST_INTERVAL_MS,
+    MQTT_BURST_MAX_LATENCY_MS = CONFIG_NODE_MQTT_BURST_MAX_LATENCY_MS,
+    MQTT_DTIM_PERIOD_MS = CONFIG_NODE_WIFI_DTIM_PERIOD_MS,
+    MQTT_PENDING_LENGTH = 64,       /* messages waiting for PUBACK tracked for latency */
+    MQTT_BULK_SLOTS = 2,            /* bulk messages in flight, at most one burst each */
+    MQTT_ALARM_QUEUE_LENGTH = 8,    /* alarms waiting, published ahead of telemetry */
+    MQTT_WIFI_RETRY_MS = 1000,      /* failover poll while waiting for wifi */
+    MQTT_DROP_LOG_INTERVAL_MS = 10000   /* dropped messages are logged at most that often */
 };
 
+/**
+ * Queued message with its enqueue time.
+ */
+typedef struct mqtt_queue_item
+{
+    mqtt_message_t msg;     /** Message to be published */
+    int64_t enqueued_us;    /** Time of enqueueing */
+    int bulk;               /** Bulk slot + 1, 0 for regular message */
+    bool retain;            /** Broker keeps the message as the topic state */
+} mqtt_queue_item_t;
+
+/**
+ * Bulk message, too large for the queue.  Queue item refers to the slot.
+ */
+typedef struct mqtt_bulk
+{
+    bool used;                              /** Slot is taken */
+    char topic[MQTT_MAX_TOPIC_LEN];         /** Topic buffer */
+    char data[NODE_NETWORK_BULK_MAX_LEN];   /** Data buffer */
+} mqtt_bulk_t;
+
+/**
+ * Message published with QoS 1, waiting for PUBACK.
+ *
+ * PUBACK may be processed by MQTT client task before publishing task
+ * records msg_id, so the slot keeps whichever of the two times comes first.
+ */
+typedef struct mqtt_pending
+{
+    int msg_id;             /** Message id, 0 if slot is free */
+    int64_t enqueued_us;    /** Enqueue time, 0 if not recorded yet */
+    int64_t published_us;   /** Publish time, round trip to the broker starts */
+    int64_t acked_us;       /** PUBACK time, 0 if not received yet */
+    bool alarm;             /** Alarm, accounted separately */
+} mqtt_pending_t;
+
 static QueueHandle_t mqtt_queue_handle;
 static StaticQueue_t mqtt_queue;
-static uint8_t mqtt_queue_buf[ MQTT_QUEUE_LENGTH * sizeof(mqtt_message_t) ];
+static uint8_t mqtt_queue_buf[ MQTT_QUEUE_LENGTH * sizeof(mqtt_queue_item_t) ];
+
+static QueueHandle_t mqtt_alarm_queue_handle;
+static StaticQueue_t mqtt_alarm_queue;
+static uint8_t mqtt_alarm_queue_buf[ MQTT_ALARM_QUEUE_LENGTH * sizeof(mqtt_queue_item_t) ];
+
+static TaskHandle_t mqtt_task_handle;
+/** Publishing task sleeps until a message is queued, senders wake it up. */
+static volatile bool mqtt_task_idle = false;
+static esp_mqtt_client_handle_t mqtt_client = NULL;
+/** Client is started, only publishing task starts and stops it. */
+static bool mqtt_client_running = false;
+/** Failover found wifi down, logged once until it is up again. */
+static bool mqtt_wifi_waiting = false;
+
+static mqtt_bulk_t mqtt_bulk[MQTT_BULK_SLOTS];
+static portMUX_TYPE mqtt_bulk_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static node_network_burst_stats_t mqtt_burst_stats;
+static node_network_latency_stats_t mqtt_latency_stats;
+static node_network_alarm_stats_t mqtt_alarm_stats;
+static node_network_connect_stats_t mqtt_connect_stats;
+/** Messages dropped since the last log, and when it was written. */
+static uint32_t mqtt_drop_unlogged = 0;
+static int64_t mqtt_drop_logged_us = 0;
+/** Current connection attempt, 0 if none. */
+static int64_t mqtt_connect_start_us = 0;
+static uint32_t mqtt_connect_heap_free = 0;
+static uint32_t mqtt_connect_heap_low = 0;
+static mqtt_pending_t mqtt_pending[MQTT_PENDING_LENGTH];
+static portMUX_TYPE mqtt_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Match publish and PUBACK of the message and account its latency.
+ *
+ * Round trip from publish till PUBACK goes to the health of the broker.
+ *
+ * @msg_id          message id
+ * @enqueued_us     enqueue time, 0 when called on PUBACK
+ * @published_us    publish time, 0 when called on PUBACK
+ * @acked_us        PUBACK time, 0 when called on publish
+ * @alarm           message is an alarm, known on publish only
+ */
+static void mqtt_track_latency(int msg_id, int64_t enqueued_us, int64_t published_us, int64_t acked_us, bool alarm)
+{
+    mqtt_pending_t *slot = &mqtt_pending[(unsigned)msg_id % MQTT_PENDING_LENGTH];
+    int64_t rtt_us = -1;
+
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    if (slot->msg_id == msg_id)
+    {
+        int64_t start = enqueued_us ? enqueued_us : slot->enqueued_us;
+        int64_t end = acked_us ? acked_us : slot->acked_us;
+        node_log_hist_add(alarm || slot->alarm ? &mqtt_alarm_stats.hist : &mqtt_latency_stats.hist,
+                          (uint32_t)(end - start));
+        rtt_us = end - (published_us ? published_us : slot->published_us);
+        slot->msg_id = 0;
+    }
+    else
+    {
+        if (slot->msg_id != 0)
+        {
+            /* Older message never matched, PUBACK lost or slot reused. */
+            if (slot->alarm)
+            {
+                mqtt_alarm_stats.unmatched++;
+            }
+            else
+            {
+                mqtt_latency_stats.unmatched++;
+            }
+        }
+        slot->msg_id = msg_id;
+        slot->enqueued_us = enqueued_us;
+        slot->published_us = published_us;
+        slot->acked_us = acked_us;
+        slot->alarm = alarm;
+    }
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+
+    if (rtt_us >= 0)
+    {
+        broker_rtt((uint32_t)rtt_us);
+    }
+}
 
 static void log_error_if_nonzero(const char *message, int error_code)
 {
@@ -42,6 +197,77 @@ static void log_error_if_nonzero(const char *message, int error_code)
     }
 }
 
+/**
+ * Start of a connection attempt, called from MQTT client task.
+ */
+static void mqtt_connect_begin()
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    // Previous attempt did not get as far as DISCONNECTED event
+    mqtt_connect_stats.failed += mqtt_connect_start_us != 0;
+    mqtt_connect_stats.attempts++;
+    mqtt_connect_start_us = now;
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+#if !CONFIG_IDF_TARGET_LINUX
+    mqtt_connect_heap_free = esp_get_free_heap_size();
+    mqtt_connect_heap_low = esp_get_minimum_free_heap_size();
+#endif
+}
+
+/**
+ * End of a connection attempt, called from MQTT client task.
+ *
+ * There is no peak heap counter, the low watermark is compared instead:
+ * the attempt is accounted only when it took the heap lower than ever.
+ *
+ * @connected   CONNACK received, otherwise the attempt failed
+ * @return connect time, us, 0 if the attempt was not started.
+ */
+static uint32_t mqtt_connect_end(bool connected)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t connect_us = 0;
+    uint32_t heap_used = 0;
+#if !CONFIG_IDF_TARGET_LINUX
+    uint32_t heap_low = esp_get_minimum_free_heap_size();
+    if (heap_low < mqtt_connect_heap_low && heap_low < mqtt_connect_heap_free)
+    {
+        heap_used = mqtt_connect_heap_free - heap_low;
+    }
+#endif
+    // The broker may still refuse the session, so this is an offer, not a resumption
+#if NODE_TLS_RESUME
+    bool offered = mqtt_connect_stats.resumption && tls_session_offered();
+#else
+    bool offered = false;
+#endif
+
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    if (mqtt_connect_start_us != 0)
+    {
+        connect_us = (uint32_t)(now - mqtt_connect_start_us);
+        if (connected)
+        {
+            uint32_t *heap = offered ? &mqtt_connect_stats.heap_offered : &mqtt_connect_stats.heap_full;
+            node_log_hist_add(offered ? &mqtt_connect_stats.offered : &mqtt_connect_stats.full,
+                              connect_us);
+            if (heap_used > *heap)
+            {
+                *heap = heap_used;
+            }
+        }
+        else
+        {
+            mqtt_connect_stats.failed++;
+        }
+        mqtt_connect_start_us = 0;
+    }
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+
+    return connect_us;
+}
+
 /*
  * @brief Event handler registered to receive MQTT events
  *
@@ -59,13 +285,24 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     esp_mqtt_client_handle_t client = event->client;
     int msg_id;
     switch ((esp_mqtt_event_id_t)event_id) {
+    // Publishing task runs failover policy on connection changes
+    case MQTT_EVENT_BEFORE_CONNECT:
+        mqtt_connect_begin();
+        break;
     case MQTT_EVENT_CONNECTED:
+        broker_connected(mqtt_connect_end(true));
         xEventGroupSetBits(mqtt_event_group, CONNECTED_BIT);
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+        network_notify_state(NODE_NETWORK_CONNECTED);
+        xTaskNotifyGive(mqtt_task_handle);
         break;
     case MQTT_EVENT_DISCONNECTED:
+        mqtt_connect_end(false);
+        broker_disconnected(wifi_wait_for_connection(0));
         xEventGroupClearBits(mqtt_event_group, CONNECTED_BIT);
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+        network_notify_state(NODE_NETWORK_DISCONNECTED);
+        xTaskNotifyGive(mqtt_task_handle);
         break;
 
     case MQTT_EVENT_SUBSCRIBED:
@@ -76,11 +313,17 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         break;
     case MQTT_EVENT_PUBLISHED:
         //ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        mqtt_track_latency(event->msg_id, 0, 0, esp_timer_get_time(), false);
         break;
     case MQTT_EVENT_DATA:
-        ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-        printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-        printf("DATA=%.*s\r\n", event->data_len, event->data);
+        ESP_LOGD(TAG, "MQTT_EVENT_DATA, topic=%.*s", event->topic_len, event->topic);
+        if (event->current_data_offset != 0 || event->data_len != event->total_data_len)
+        {
+            /* Requests are short, fragmented messages are not expected. */
+            ESP_LOGW(TAG, "Fragmented message ignored, %d bytes", event->total_data_len);
+            break;
+        }
+        network_dispatch_message(event->topic, event->topic_len, event->data, event->data_len);
         break;
     case MQTT_EVENT_ERROR:
         ESP_LOGI(TAG, "MQTT_EVENT_ERROR");
@@ -98,39 +341,275 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
 }
 
-void mqtt_task(void* data)
+/**
+ * Calculate burst interval.
+ *
+ * Configured interval is rounded to the whole number of DTIM periods,
+ * so the radio woken up for DTIM beacon is reused for the burst, but
+ * never exceeds the latency bound.
+ */
+static uint32_t mqtt_burst_interval_ms()
+{
+    if (MQTT_BURST_INTERVAL_MS == 0)
+    {
+        return 0;
+    }
+
+    uint32_t periods = (MQTT_BURST_INTERVAL_MS + MQTT_DTIM_PERIOD_MS / 2) / MQTT_DTIM_PERIOD_MS;
+    while (periods > 1 && periods * MQTT_DTIM_PERIOD_MS > MQTT_BURST_MAX_LATENCY_MS)
+    {
+        --periods;
+    }
+
+    return (periods > 0 ? periods : 1) * MQTT_DTIM_PERIOD_MS;
+}
+
+static int mqtt_burst_bucket(uint32_t count)
 {
-    while (!wifi_wait_for_connection(DEFAULT_CONNECT_TIMEOUT_MS))
+    int bucket = 0;
+    while (count > 1 && bucket < NODE_NETWORK_BURST_BUCKETS - 1)
     {
-        ESP_LOGW(TAG, "Waiting for wifi connection");
+        count >>= 1;
+        ++bucket;
     }
+    return bucket;
+}
+
+/**
+ * Publish queued alarms, they do not wait for the burst schedule.
+ */
+static void mqtt_publish_alarms(esp_mqtt_client_handle_t client)
+{
+    mqtt_queue_item_t item;
+    while (xQueueReceive(mqtt_alarm_queue_handle, &item, 0) == pdPASS)
+    {
+        int64_t published_us = esp_timer_get_time();
+        int msg_id = esp_mqtt_client_publish(client, item.msg.topic, item.msg.data, 0, 1, item.retain);
+        if (msg_id > 0)
+        {
+            mqtt_track_latency(msg_id, item.enqueued_us, published_us, 0, true);
+        }
+    }
+}
+
+/**
+ * Publish all queued messages at once.
+ *
+ * Alarms queued meanwhile go ahead of the remaining messages.
+ */
+static void mqtt_publish_burst(esp_mqtt_client_handle_t client, bool early)
+{
+    int64_t start = esp_timer_get_time();
+    uint32_t count = 0;
+    mqtt_queue_item_t item;
+
+    while (true)
+    {
+        mqtt_publish_alarms(client);
+        if (xQueueReceive(mqtt_queue_handle, &item, 0) != pdPASS)
+        {
+            break;
+        }
+
+        int msg_id;
+        int64_t published_us = esp_timer_get_time();
+        if (item.bulk)
+        {
+            mqtt_bulk_t *bulk = &mqtt_bulk[item.bulk - 1];
+            msg_id = esp_mqtt_client_publish(client, bulk->topic, bulk->data, 0, 1, 0);
+            portENTER_CRITICAL(&mqtt_bulk_lock);
+            bulk->used = false;
+            portEXIT_CRITICAL(&mqtt_bulk_lock);
+        }
+        else
+        {
+            msg_id = esp_mqtt_client_publish(client, item.msg.topic, item.msg.data, 0, 1, 0);
+        }
+        if (msg_id > 0)
+        {
+            mqtt_track_latency(msg_id, item.enqueued_us, published_us, 0, false);
+        }
+        ++count;
+    }
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint32_t active_us = (uint32_t)(esp_timer_get_time() - start);
+
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    mqtt_burst_stats.bursts++;
+    mqtt_burst_stats.messages += count;
+    mqtt_burst_stats.early_bursts += early ? 1 : 0;
+    mqtt_burst_stats.active_us += active_us;
+    if (count > mqtt_burst_stats.max_burst)
+    {
+        mqtt_burst_stats.max_burst = count;
+    }
+    if (active_us > mqtt_burst_stats.max_active_us)
+    {
+        mqtt_burst_stats.max_active_us = active_us;
+    }
+    mqtt_burst_stats.size_hist[mqtt_burst_bucket(count)]++;
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+}
 
+static esp_mqtt_client_handle_t mqtt_client_create(const char *uri)
+{
+#if ESP_IDF_VERSION_MAJOR >= 5
+    mqtt_cfg.broker.address.uri = uri;
+#else
+    mqtt_cfg.uri = uri;
+#endif
+#if NODE_TLS_RESUME
+    // Custom transport is used whatever the scheme, so only for TLS lists
+    if (broker_all_tls())
+    {
+        mqtt_cfg.network.transport = tls_transport_create(MQTT_CA_PEM);
+        mqtt_connect_stats.resumption = mqtt_cfg.network.transport != NULL;
+    }
+#endif
     esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
     /* The last argument may be used to pass data to the event handler, in this example mqtt_event_handler */
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-    esp_mqtt_client_start(client);
+    return client;
+}
+
+/**
+ * Run failover policy on the client, create the client on the first run.
+ *
+ * @return time till the policy needs to run again, ticks.
+ */
+static TickType_t mqtt_failover()
+{
+    int64_t wait_us;
+    broker_action_t action = broker_poll(esp_timer_get_time(), &wait_us);
+
+    if (action != BROKER_KEEP && mqtt_client_running)
+    {
+        esp_mqtt_client_stop(mqtt_client);
+        mqtt_client_running = false;
+        if (xEventGroupGetBits(mqtt_event_group) & CONNECTED_BIT)
+        {
+            // Stopped client reports no DISCONNECTED event
+            xEventGroupClearBits(mqtt_event_group, CONNECTED_BIT);
+            network_notify_state(NODE_NETWORK_DISCONNECTED);
+        }
+    }
 
-    // Now run message publish loop
+    if (action == BROKER_START)
+    {
+        if (!wifi_wait_for_connection(0))
+        {
+            // Broker stays idle and is selected again on the next poll, the
+            // task keeps serving alarms and notifications meanwhile
+            if (!mqtt_wifi_waiting)
+            {
+                ESP_LOGW(TAG, "Waiting for wifi connection");
+                mqtt_wifi_waiting = true;
+            }
+            return pdMS_TO_TICKS(MQTT_WIFI_RETRY_MS);
+        }
+        mqtt_wifi_waiting = false;
+
+        const char *uri = broker_start();
+        portENTER_CRITICAL(&mqtt_stats_lock);
+        mqtt_connect_stats.tls = strncmp(uri, "mqtts://", 8) == 0;
+        portEXIT_CRITICAL(&mqtt_stats_lock);
+        if (mqtt_client == NULL)
+        {
+            mqtt_client = mqtt_client_create(uri);
+        }
+        else
+        {
+            esp_mqtt_client_set_uri(mqtt_client, uri);
+        }
+        esp_mqtt_client_start(mqtt_client);
+        mqtt_client_running = true;
+    }
+
+    return wait_us < 0 ? portMAX_DELAY : pdMS_TO_TICKS(wait_us / 1000) + 1;
+}
+
+void mqtt_task(void* data)
+{
+    // Now run message publish loop.  Bursts are scheduled on a fixed grid
+    // so the radio wakes at a steady cadence and sleeps in between.
+    const TickType_t interval = pdMS_TO_TICKS(mqtt_burst_interval_ms());
+    TickType_t next_burst = xTaskGetTickCount();
     while (true)
     {
-        mqtt_message_t msg;
-        if (xQueueReceive(mqtt_queue_handle,
-                          &(msg),
-                          MQTT_QUEUE_READ_MS/portTICK_PERIOD_MS) == pdPASS)
+        TickType_t failover_wait = mqtt_failover();
+        if (mqtt_client == NULL)
+        {
+            // Nothing to publish with before the first start, messages
+            // wait in the queues
+            ulTaskNotifyTake(pdTRUE, failover_wait);
+            continue;
+        }
+        mqtt_publish_alarms(mqtt_client);
+
+        // Sleep until a sender queues a message or an alarm, or failover
+        // policy needs to run
+        mqtt_queue_item_t item;
+        mqtt_task_idle = true;
+        bool queued = xQueuePeek(mqtt_queue_handle, &item, 0) == pdPASS;
+        if (!queued && uxQueueMessagesWaiting(mqtt_alarm_queue_handle) == 0)
         {
-            esp_mqtt_client_publish(client, msg.topic, msg.data, 0, 1, 0);
+            ulTaskNotifyTake(pdTRUE, failover_wait);
         }
+        mqtt_task_idle = false;
+        if (!queued)
+        {
+            continue;
+        }
+
+        TickType_t now = xTaskGetTickCount();
+        if (interval > 0 && (int32_t)(now - next_burst) >= 0)
+        {
+            next_burst += ((now - next_burst) / interval + 1) * interval;
+        }
+
+        bool early = false;
+        while (interval > 0 && (int32_t)(next_burst - now) > 0)
+        {
+            if (uxQueueSpacesAvailable(mqtt_queue_handle) <= MQTT_BURST_FLUSH_SPACES)
+            {
+                early = true;
+                break;
+            }
+            ulTaskNotifyTake(pdTRUE, next_burst - now);
+            mqtt_publish_alarms(mqtt_client);
+            now = xTaskGetTickCount();
+        }
+
+        mqtt_publish_burst(mqtt_client, early);
     }
 }
 
+static StackType_t mqtt_task_stack[MQTT_TASK_STACK];
+
 void mqtt_start()
 {
     mqtt_event_group = xEventGroupCreate();
     mqtt_queue_handle = xQueueCreateStatic(MQTT_QUEUE_LENGTH,
-                                           sizeof(mqtt_message_t),
+                                           sizeof(mqtt_queue_item_t),
                                            mqtt_queue_buf,
                                            &mqtt_queue);
-    xTaskCreate(&mqtt_task, "mqtt_task", 8192, NULL, 5, NULL);
+    mqtt_alarm_queue_handle = xQueueCreateStatic(MQTT_ALARM_QUEUE_LENGTH,
+                                                 sizeof(mqtt_queue_item_t),
+                                                 mqtt_alarm_queue_buf,
+                                                 &mqtt_alarm_queue);
+    mqtt_burst_stats.interval_ms = mqtt_burst_interval_ms();
+    node_log_hist_init(&mqtt_latency_stats.hist);
+    node_log_hist_init(&mqtt_alarm_stats.hist);
+    node_log_hist_init(&mqtt_connect_stats.full);
+    node_log_hist_init(&mqtt_connect_stats.offered);
+    broker_init();
+    mqtt_task_handle = node_task_start(NODE_TASK_MQTT, &mqtt_task, NULL,
+                                       mqtt_task_stack, sizeof(mqtt_task_stack));
 }
 
 bool mqtt_wait_for_connection(int timeoutMS)
@@ -139,17 +618,192 @@ bool mqtt_wait_for_connection(int timeoutMS)
                                    CONNECTED_BIT,
                                    pdFALSE,
                                    pdTRUE,
-                                   timeoutMS / portTICK_PERIOD_MS);
+                                   timeoutMS < 0 ? portMAX_DELAY : timeoutMS / portTICK_PERIOD_MS);
     return (bits & CONNECTED_BIT) != 0;
 }
 
+void mqtt_subscribe(const char *topic)
+{
+    if (mqtt_client != NULL && mqtt_wait_for_connection(0))
+    {
+        int msg_id = esp_mqtt_client_subscribe(mqtt_client, topic, 1);
+        ESP_LOGI(TAG, "Subscribe %s, msg_id=%d", topic, msg_id);
+    }
+}
+
+bool mqtt_send_bulk(const char *topic, const char *data)
+{
+    if (uxQueueSpacesAvailable(mqtt_queue_handle) <= MQTT_QUEUE_LENGTH / 2)
+    {
+        /* Leave the rest of the queue to telemetry. */
+        return false;
+    }
+
+    int slot = -1;
+    portENTER_CRITICAL(&mqtt_bulk_lock);
+    for (int n = 0; n < MQTT_BULK_SLOTS; ++n)
+    {
+        if (!mqtt_bulk[n].used)
+        {
+            mqtt_bulk[n].used = true;
+            slot = n;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&mqtt_bulk_lock);
+    if (slot < 0)
+    {
+        return false;
+    }
+
+    mqtt_bulk_t *bulk = &mqtt_bulk[slot];
+    strlcpy(bulk->topic, topic, sizeof(bulk->topic));
+    strlcpy(bulk->data, data, sizeof(bulk->data));
+
+    mqtt_queue_item_t item;
+    item.msg.topic[0] = '\0';
+    item.msg.data[0] = '\0';
+    item.enqueued_us = esp_timer_get_time();
+    item.bulk = slot + 1;
+    item.retain = false;
+    if (xQueueSend(mqtt_queue_handle, &item, 0) != pdTRUE)
+    {
+        portENTER_CRITICAL(&mqtt_bulk_lock);
+        bulk->used = false;
+        portEXIT_CRITICAL(&mqtt_bulk_lock);
+        return false;
+    }
+    if (mqtt_task_idle)
+    {
+        xTaskNotifyGive(mqtt_task_handle);
+    }
+    return true;
+}
+
 void mqtt_send_message(const mqtt_message_t *msg)
 {
+    mqtt_queue_item_t item;
+    item.msg = *msg;
+    item.enqueued_us = esp_timer_get_time();
+    item.bulk = 0;
+    item.retain = false;
+
     BaseType_t rc = xQueueSend(mqtt_queue_handle,
-                               (void *)msg,
+                               (void *)&item,
                                (TickType_t)0);
     if (rc != pdTRUE)
     {
-         ESP_LOGE(TAG, "Queue is full");
-   }
+        // Overloaded sender drops every message, log the first drop and
+        // then a count at most once per interval
+        uint32_t drops = 0;
+        portENTER_CRITICAL(&mqtt_stats_lock);
+        mqtt_burst_stats.dropped++;
+        mqtt_drop_unlogged++;
+        if (mqtt_drop_logged_us == 0 ||
+            item.enqueued_us - mqtt_drop_logged_us >= (int64_t)MQTT_DROP_LOG_INTERVAL_MS * 1000)
+        {
+            drops = mqtt_drop_unlogged;
+            mqtt_drop_unlogged = 0;
+            mqtt_drop_logged_us = item.enqueued_us;
+        }
+        portEXIT_CRITICAL(&mqtt_stats_lock);
+        if (drops > 0)
+        {
+            ESP_LOGE(TAG, "Queue is full, %u messages dropped", (unsigned)drops);
+        }
+    }
+    else if (mqtt_task_idle || uxQueueSpacesAvailable(mqtt_queue_handle) <= MQTT_BURST_FLUSH_SPACES)
+    {
+        /* Start burst schedule, or do not wait for the scheduled burst
+           when queue is almost full. */
+        xTaskNotifyGive(mqtt_task_handle);
+    }
+}
+
+bool mqtt_send_alarm(const mqtt_message_t *msg, bool retain)
+{
+    mqtt_queue_item_t item;
+    item.msg = *msg;
+    item.enqueued_us = esp_timer_get_time();
+    item.bulk = 0;
+    item.retain = retain;
+
+    bool queued = xQueueSend(mqtt_alarm_queue_handle, &item, 0) == pdTRUE;
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    if (queued)
+    {
+        mqtt_alarm_stats.queued++;
+    }
+    else
+    {
+        mqtt_alarm_stats.dropped++;
+    }
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+
+    if (!queued)
+    {
+        ESP_LOGE(TAG, "Alarm queue is full");
+        return false;
+    }
+    xTaskNotifyGive(mqtt_task_handle);
+    return true;
+}
+
+void mqtt_get_burst_stats(node_network_burst_stats_t *stats)
+{
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    *stats = mqtt_burst_stats;
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+}
+
+void mqtt_get_latency_stats(node_network_latency_stats_t *stats)
+{
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    *stats = mqtt_latency_stats;
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+}
+
+void mqtt_get_alarm_stats(node_network_alarm_stats_t *stats)
+{
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    *stats = mqtt_alarm_stats;
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+}
+
+void mqtt_get_connect_stats(node_network_connect_stats_t *stats)
+{
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    *stats = mqtt_connect_stats;
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+}
+
+void mqtt_reset_stats()
+{
+    portENTER_CRITICAL(&mqtt_stats_lock);
+    uint32_t interval_ms = mqtt_burst_stats.interval_ms;
+    memset(&mqtt_burst_stats, 0, sizeof(mqtt_burst_stats));
+    mqtt_burst_stats.interval_ms = interval_ms;
+    node_log_hist_init(&mqtt_latency_stats.hist);
+    mqtt_latency_stats.unmatched = 0;
+    memset(&mqtt_alarm_stats, 0, sizeof(mqtt_alarm_stats));
+    node_log_hist_init(&mqtt_alarm_stats.hist);
+    node_log_hist_init(&mqtt_connect_stats.full);
+    node_log_hist_init(&mqtt_connect_stats.offered);
+    mqtt_connect_stats.attempts = 0;
+    mqtt_connect_stats.failed = 0;
+    mqtt_connect_stats.heap_full = 0;
+    mqtt_connect_stats.heap_offered = 0;
+    portEXIT_CRITICAL(&mqtt_stats_lock);
+    broker_reset_stats();
+}
+
+bool mqtt_set_brokers(const char *const *uris, int count)
+{
+    // TLS session transport cannot carry plain MQTT
+    if (!broker_set(uris, count, mqtt_connect_stats.resumption))
+    {
+        return false;
+    }
+    xTaskNotifyGive(mqtt_task_handle);
+    return true;
 }
\ No newline at end of file
@@ -7,3 +7,34 @@ void mqtt_start();
 void mqtt_send_message(const mqtt_message_t* msg);
 
 bool mqtt_wait_for_connection(int timeoutMS);
+
+bool mqtt_send_bulk(const char *topic, const char *data);
+
+bool mqtt_send_alarm(const mqtt_message_t *msg, bool retain);
+
+/**
+ * Subscribe to the topic filter, if connected.
+ */
+void mqtt_subscribe(const char *topic);
+
+/**
+ * Dispatch network state change to subscribers (node_network.c).
+ */
+void network_notify_state(node_network_state_t state);
+
+/**
+ * Dispatch incoming message to handlers (node_network.c).
+ */
+void network_dispatch_message(const char *topic, int topic_len, const char *data, int data_len);
+
+void mqtt_get_burst_stats(node_network_burst_stats_t *stats);
+
+void mqtt_get_latency_stats(node_network_latency_stats_t *stats);
+
+void mqtt_get_alarm_stats(node_network_alarm_stats_t *stats);
+
+void mqtt_get_connect_stats(node_network_connect_stats_t *stats);
+
+void mqtt_reset_stats();
+
+bool mqtt_set_brokers(const char *const *uris, int count);
@@ -1,14 +1,85 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "node_diag.h"
 #include "node_network.h"
+#include "node_tasks.h"
 #include "node_wifi.h"
 #include "node_mqtt.h"
+#include "node_time.h"
+#include "node_broker.h"
 
 
+enum node_network_const_internal
+{
+    NETWORK_DIAG_PERIOD_MS = CONFIG_NODE_DIAG_PERIOD_S * 1000,
+    NETWORK_DIAG_STACK = 3072
+};
+
+/**
+ * Network state subscriber.
+*/
+typedef struct network_subscriber
+{
+    node_network_state_cb_t cb; /** State change callback */
+    void *arg;                  /** Callback argument */
+} network_subscriber_t;
+
+/**
+ * Incoming topic handler.
+*/
+typedef struct network_handler
+{
+    const char *topic;              /** Topic filter */
+    node_network_message_cb_t cb;   /** Message callback */
+    void *arg;                      /** Callback argument */
+} network_handler_t;
+
+static network_subscriber_t network_subscribers[NODE_NETWORK_MAX_SUBSCRIBERS];
+static int network_subscribers_count = 0;
+static network_handler_t network_handlers[NODE_NETWORK_MAX_HANDLERS];
+static int network_handlers_count = 0;
+static portMUX_TYPE network_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Publish one diagnostics metric.
+*/
+static void network_diag_emit(const char *name, const char *data)
+{
+    mqtt_message_t msg;
+    bzero(&msg, sizeof(msg));
+    snprintf(msg.topic,
+             sizeof(msg.topic),
+             "nodes/node1/diag/%s",
+             name);
+    strlcpy(msg.data, data, sizeof(msg.data));
+    node_mqtt_send_message(&msg);
+}
+
+static void network_diag_task(void *arg)
+{
+    TickType_t last_wake_time = xTaskGetTickCount();
+    while (true)
+    {
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(NETWORK_DIAG_PERIOD_MS));
+        if (node_network_is_ready())
+        {
+            node_diag_collect(&network_diag_emit);
+        }
+    }
+}
+
+static StackType_t network_diag_stack[NETWORK_DIAG_STACK];
+
 bool node_network_start()
 {
     wifi_init();
+    time_start();
     mqtt_start();
+    node_task_start(NODE_TASK_DIAG, &network_diag_task, NULL,
+                    network_diag_stack, sizeof(network_diag_stack));
     return wifi_run();
 }
 
@@ -23,10 +94,144 @@ bool node_network_ready_wait(int timeoutMS)
     return mqtt_wait_for_connection(timeoutMS);
 }
 
+bool node_network_is_ready()
+{
+    return mqtt_wait_for_connection(0);
+}
+
+bool node_network_subscribe(node_network_state_cb_t cb, void *arg)
+{
+    bool subscribed = false;
+
+    portENTER_CRITICAL(&network_lock);
+    if (network_subscribers_count < NODE_NETWORK_MAX_SUBSCRIBERS)
+    {
+        network_subscribers[network_subscribers_count].cb = cb;
+        network_subscribers[network_subscribers_count].arg = arg;
+        ++network_subscribers_count;
+        subscribed = true;
+    }
+    portEXIT_CRITICAL(&network_lock);
+
+    /* Do not let subscriber miss the connection established before. */
+    if (subscribed && node_network_is_ready())
+    {
+        cb(NODE_NETWORK_CONNECTED, arg);
+    }
+    return subscribed;
+}
+
+bool node_network_handle(const char *topic, node_network_message_cb_t cb, void *arg)
+{
+    bool registered = false;
+
+    portENTER_CRITICAL(&network_lock);
+    if (network_handlers_count < NODE_NETWORK_MAX_HANDLERS)
+    {
+        network_handlers[network_handlers_count].topic = topic;
+        network_handlers[network_handlers_count].cb = cb;
+        network_handlers[network_handlers_count].arg = arg;
+        ++network_handlers_count;
+        registered = true;
+    }
+    portEXIT_CRITICAL(&network_lock);
+
+    /* Connected before, later connections subscribe all handlers. */
+    if (registered && node_network_is_ready())
+    {
+        mqtt_subscribe(topic);
+    }
+    return registered;
+}
+
+/**
+ * Match topic against the filter: exact or prefix ending with "/#".
+*/
+static bool network_topic_match(const char *filter, const char *topic, int topic_len)
+{
+    size_t len = strlen(filter);
+    if (len >= 2 && strcmp(filter + len - 2, "/#") == 0)
+    {
+        return topic_len >= len - 1 && strncmp(filter, topic, len - 1) == 0;
+    }
+    return topic_len == len && strncmp(filter, topic, len) == 0;
+}
+
+void network_dispatch_message(const char *topic, int topic_len, const char *data, int data_len)
+{
+    /* Handlers are never removed, so the table may be walked unlocked. */
+    for (int n = 0; n < network_handlers_count; ++n)
+    {
+        if (network_topic_match(network_handlers[n].topic, topic, topic_len))
+        {
+            network_handlers[n].cb(topic, topic_len, data, data_len, network_handlers[n].arg);
+        }
+    }
+}
+
+void network_notify_state(node_network_state_t state)
+{
+    if (state == NODE_NETWORK_CONNECTED)
+    {
+        /* Clean session, subscriptions are not kept by the broker. */
+        for (int n = 0; n < network_handlers_count; ++n)
+        {
+            mqtt_subscribe(network_handlers[n].topic);
+        }
+    }
+
+    /* Subscribers are never removed, so the table may be walked unlocked. */
+    for (int n = 0; n < network_subscribers_count; ++n)
+    {
+        network_subscribers[n].cb(state, network_subscribers[n].arg);
+    }
+}
+
+void node_network_get_burst_stats(node_network_burst_stats_t *stats)
+{
+    mqtt_get_burst_stats(stats);
+}
+
+void node_network_get_latency_stats(node_network_latency_stats_t *stats)
+{
+    mqtt_get_latency_stats(stats);
+}
+
+void node_network_get_alarm_stats(node_network_alarm_stats_t *stats)
+{
+    mqtt_get_alarm_stats(stats);
+}
+
+void node_network_get_connect_stats(node_network_connect_stats_t *stats)
+{
+    mqtt_get_connect_stats(stats);
+}
+
+bool node_network_get_broker_stats(int index, node_network_broker_stats_t *stats)
+{
+    return broker_get_stats(index, stats);
+}
+
+void node_network_get_failover_stats(node_network_failover_stats_t *stats)
+{
+    broker_get_failover_stats(stats);
+}
+
+bool node_network_set_brokers(const char *const *uris, int count)
+{
+    return mqtt_set_brokers(uris, count);
+}
+
+void node_network_reset_stats()
+{
+    mqtt_reset_stats();
+}
+
 void node_mqtt_send_sensor_value(const char *name,
                                  const char *quantity,
                                  const char *unit,
-                                 float value)
+                                 float value,
+                                 int64_t time_us)
 {
     mqtt_message_t msg;
     bzero(&msg, sizeof(msg));
@@ -35,11 +240,15 @@ void node_mqtt_send_sensor_value(const char *name,
              "nodes/node1/%s/%s",
              quantity,
              name);
+    int64_t wall_ms = node_network_wall_ms(time_us);
     snprintf(msg.data,
              sizeof(msg.data),
-             "{\"value\": %.1f, \"unit\": \"%s\"}",
+             wall_ms >= 0
+             ? "{\"value\": %.1f, \"unit\": \"%s\", \"t\": %" PRId64 "}"
+             : "{\"value\": %.1f, \"unit\": \"%s\", \"up\": %" PRId64 "}",
              value,
-             unit);
+             unit,
+             wall_ms >= 0 ? wall_ms : time_us / 1000);
     node_mqtt_send_message(&msg);
 }
 
@@ -47,3 +256,13 @@ void node_mqtt_send_message(const mqtt_message_t* msg)
 {
     mqtt_send_message(msg);
 }
+
+bool node_network_send_bulk(const char *topic, const char *data)
+{
+    return mqtt_send_bulk(topic, data);
+}
+
+bool node_network_send_alarm(const mqtt_message_t *msg, bool retain)
+{
+    return mqtt_send_alarm(msg, retain);
+}
@@ -0,0 +1,116 @@
+/**
+ * Microbenchmarks of the per-message hot path: topic and payload
+ * formatting, message clearing and queue copies.
+ *
+ * Primitives are the same as in node_mqtt_send_sensor_value() and
+ * mqtt_send_message().
+*/
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "node_bench.h"
+#include "node_network.h"
+
+enum network_bench_const_internal
+{
+    NETWORK_BENCH_QUEUE_LENGTH = 8
+};
+
+static mqtt_message_t bench_msg;
+static volatile float bench_value = 23.45f;
+static volatile int64_t bench_time_us = 1000000;
+
+static QueueHandle_t bench_queue_handle;
+static StaticQueue_t bench_queue;
+static uint8_t bench_queue_buf[ NETWORK_BENCH_QUEUE_LENGTH * sizeof(mqtt_message_t) ];
+
+static void network_bench_topic(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        snprintf(bench_msg.topic,
+                 sizeof(bench_msg.topic),
+                 "nodes/node1/%s/%s",
+                 "temperature",
+                 "28ff641e8216c3a1");
+        NODE_BENCH_CLOBBER();
+    }
+}
+
+static void network_bench_value(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        snprintf(bench_msg.data,
+                 sizeof(bench_msg.data),
+                 "{\"value\": %.1f, \"unit\": \"%s\", \"t\": %" PRId64 "}",
+                 bench_value,
+                 "\\u00b0C",
+                 node_network_wall_ms(bench_time_us));
+        NODE_BENCH_CLOBBER();
+    }
+}
+
+static void network_bench_bzero(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        bzero(&bench_msg, sizeof(bench_msg));
+        NODE_BENCH_CLOBBER();
+    }
+}
+
+static void network_bench_queue_setup(void)
+{
+    if (bench_queue_handle == NULL)
+    {
+        bench_queue_handle = xQueueCreateStatic(NETWORK_BENCH_QUEUE_LENGTH,
+                                                sizeof(mqtt_message_t),
+                                                bench_queue_buf,
+                                                &bench_queue);
+    }
+}
+
+static void network_bench_queue(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        xQueueSend(bench_queue_handle, &bench_msg, 0);
+        xQueueReceive(bench_queue_handle, &bench_msg, 0);
+    }
+}
+
+static const node_bench_case_t network_bench_cases[] =
+{
+    {
+        .name = "mqtt.topic_snprintf",
+        .iterations = 1000,
+        .run = &network_bench_topic
+    },
+    {
+        .name = "mqtt.value_snprintf",
+        .iterations = 1000,
+        .run = &network_bench_value
+    },
+    {
+        .name = "mqtt.msg_bzero",
+        .iterations = 10000,
+        .run = &network_bench_bzero
+    },
+    {
+        .name = "mqtt.queue_send_receive",
+        .iterations = 1000,
+        .setup = &network_bench_queue_setup,
+        .run = &network_bench_queue
+    }
+};
+
+void node_network_bench_register()
+{
+    for (int n = 0; n < sizeof(network_bench_cases) / sizeof(network_bench_cases[0]); ++n)
+    {
+        node_bench_register(&network_bench_cases[n]);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "node_diag.h"
+#include "node_time.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_sntp.h"
+#endif
+
+static const char *TAG = "time";
+
+#if CONFIG_IDF_TARGET_LINUX
+/** Host clock is kept by the host, it counts as synchronised. */
+static volatile bool time_synced = true;
+#else
+static volatile bool time_synced = false;
+#endif
+static uint32_t time_syncs = 0;
+static int64_t time_last_sync_us = 0;
+static portMUX_TYPE time_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Diagnostics provider: clock synchronisation state.
+*/
+static void time_diag(node_diag_emit_t emit)
+{
+    portENTER_CRITICAL(&time_lock);
+    uint32_t syncs = time_syncs;
+    int64_t last_sync_us = time_last_sync_us;
+    portEXIT_CRITICAL(&time_lock);
+
+    char data[NODE_DIAG_MAX_DATA_LEN];
+    snprintf(data,
+             sizeof(data),
+             "{\"synced\":%s,\"syncs\":%" PRIu32 ",\"age_s\":%" PRId64 "}",
+             time_synced ? "true" : "false",
+             syncs,
+             syncs ? (esp_timer_get_time() - last_sync_us) / 1000000 : -1);
+    emit("time", data);
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static void time_sync_cb(struct timeval *tv)
+{
+    portENTER_CRITICAL(&time_lock);
+    ++time_syncs;
+    time_last_sync_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&time_lock);
+
+    if (!time_synced)
+    {
+        ESP_LOGI(TAG, "Clock synchronised, %" PRId64 " s since epoch", (int64_t)tv->tv_sec);
+    }
+    time_synced = true;
+}
+#endif
+
+void time_start()
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, CONFIG_NODE_SNTP_SERVER);
+    sntp_set_time_sync_notification_cb(&time_sync_cb);
+    sntp_init();
+#endif
+    node_diag_register(&time_diag);
+}
+
+bool node_network_time_synced()
+{
+    return time_synced;
+}
+
+int64_t node_network_wall_ms(int64_t time_us)
+{
+    if (!time_synced)
+    {
+        return -1;
+    }
+
+    // Wall clock may be stepped by SNTP, the age of the moment may not
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t age_us = esp_timer_get_time() - time_us;
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 - age_us / 1000;
+}
\ No newline at end of file
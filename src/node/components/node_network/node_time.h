@@ -0,0 +1,11 @@
+#pragma once
+
+#include "node_network.h"
+
+/**
+ * Start clock synchronisation over SNTP.
+ *
+ * SNTP client runs in lwIP and retries until the station gets an
+ * address, so it may be started before WiFi is connected.
+ */
+void time_start();
\ No newline at end of file
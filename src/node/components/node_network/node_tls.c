@@ -0,0 +1,206 @@
+#include <string.h>
+#include <sys/select.h>
+#include "esp_log.h"
+#include "esp_tls.h"
+#include "node_tls.h"
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
+
+#if NODE_TLS_RESUME
+
+enum tls_const_internal
+{
+    TLS_DEFAULT_PORT = 8883
+};
+
+static const char *TAG = "tls";
+
+/** There is one MQTT client, so one connection and one cached session. */
+static esp_tls_t *tls_conn = NULL;
+static esp_tls_client_session_t *tls_session = NULL;
+static volatile bool tls_offered = false;
+static const char *tls_ca_pem = NULL;
+
+/**
+ * Wait until the socket is readable or writable.
+ *
+ * @return 1 if ready, 0 on timeout, -1 on error.
+*/
+static int tls_poll(int timeout_ms, bool write)
+{
+    int fd;
+    if (tls_conn == NULL || esp_tls_get_conn_sockfd(tls_conn, &fd) != ESP_OK)
+    {
+        return -1;
+    }
+
+    fd_set ready;
+    fd_set errors;
+    FD_ZERO(&ready);
+    FD_SET(fd, &ready);
+    FD_ZERO(&errors);
+    FD_SET(fd, &errors);
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000
+    };
+    int ret = select(fd + 1,
+                     write ? NULL : &ready,
+                     write ? &ready : NULL,
+                     &errors,
+                     timeout_ms < 0 ? NULL : &timeout);
+    if (ret > 0 && FD_ISSET(fd, &errors))
+    {
+        return -1;
+    }
+    return ret > 0 ? 1 : ret;
+}
+
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    // Decrypted bytes left from the previous record are not on the socket
+    if (tls_conn != NULL && esp_tls_get_bytes_avail(tls_conn) > 0)
+    {
+        return 1;
+    }
+    return tls_poll(timeout_ms, false);
+}
+
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return tls_poll(timeout_ms, true);
+}
+
+static int tls_close(esp_transport_handle_t t)
+{
+    if (tls_conn != NULL)
+    {
+        esp_tls_conn_destroy(tls_conn);
+        tls_conn = NULL;
+    }
+    return 0;
+}
+
+static int tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    tls_close(t);
+    tls_conn = esp_tls_init();
+    if (tls_conn == NULL)
+    {
+        return -1;
+    }
+
+    esp_tls_cfg_t cfg = {
+        .timeout_ms = timeout_ms,
+        .client_session = tls_session
+    };
+    if (tls_ca_pem != NULL)
+    {
+        cfg.cacert_buf = (const unsigned char *)tls_ca_pem;
+        cfg.cacert_bytes = strlen(tls_ca_pem) + 1;
+    }
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+    else
+    {
+        cfg.crt_bundle_attach = esp_crt_bundle_attach;
+    }
+#endif
+
+    tls_offered = tls_session != NULL;
+    if (esp_tls_conn_new_sync(host, strlen(host), port, &cfg, tls_conn) <= 0)
+    {
+        if (tls_session != NULL)
+        {
+            // The broker may have restarted and forgotten it, next attempt
+            // runs a full handshake
+            ESP_LOGW(TAG, "Connection failed, cached session dropped");
+            esp_tls_free_client_session(tls_session);
+            tls_session = NULL;
+        }
+        tls_close(t);
+        return -1;
+    }
+
+    esp_tls_client_session_t *session = esp_tls_get_client_session(tls_conn);
+    if (session != NULL)
+    {
+        if (tls_session != NULL)
+        {
+            esp_tls_free_client_session(tls_session);
+        }
+        tls_session = session;
+    }
+    return 0;
+}
+
+static int tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    int ready = tls_poll_read(t, timeout_ms);
+    if (ready <= 0)
+    {
+        return ready;
+    }
+
+    ssize_t ret = esp_tls_conn_read(tls_conn, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE)
+    {
+        return 0;
+    }
+    // Zero is orderly close by the broker
+    return ret == 0 ? -1 : ret;
+}
+
+static int tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    int ready = tls_poll_write(t, timeout_ms);
+    if (ready <= 0)
+    {
+        return ready;
+    }
+
+    ssize_t ret = esp_tls_conn_write(tls_conn, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE)
+    {
+        return 0;
+    }
+    return ret;
+}
+
+static int tls_destroy(esp_transport_handle_t t)
+{
+    tls_close(t);
+    if (tls_session != NULL)
+    {
+        esp_tls_free_client_session(tls_session);
+        tls_session = NULL;
+    }
+    return 0;
+}
+
+esp_transport_handle_t tls_transport_create(const char *ca_pem)
+{
+    tls_ca_pem = ca_pem;
+    esp_transport_handle_t t = esp_transport_init();
+    if (t == NULL)
+    {
+        return NULL;
+    }
+    esp_transport_set_func(t,
+                           &tls_connect,
+                           &tls_read,
+                           &tls_write,
+                           &tls_close,
+                           &tls_poll_read,
+                           &tls_poll_write,
+                           &tls_destroy);
+    esp_transport_set_default_port(t, TLS_DEFAULT_PORT);
+    return t;
+}
+
+bool tls_session_offered()
+{
+    return tls_offered;
+}
+
+#endif
\ No newline at end of file
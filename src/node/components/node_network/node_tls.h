@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include "esp_idf_version.h"
+
+/**
+ * TLS transport of the MQTT client, resuming the session on reconnect.
+ *
+ * esp-mqtt accepts a custom transport since ESP-IDF 5, older versions
+ * use the built-in one with a full handshake on every connection.
+ */
+#if CONFIG_NODE_MQTT_TLS_RESUME && ESP_IDF_VERSION_MAJOR >= 5
+#define NODE_TLS_RESUME 1
+#else
+#define NODE_TLS_RESUME 0
+#endif
+
+#if NODE_TLS_RESUME
+#include "esp_transport.h"
+
+/**
+ * Create the transport, MQTT client owns it.
+ *
+ * @ca_pem  broker CA certificate, NULL for the certificate bundle
+ */
+esp_transport_handle_t tls_transport_create(const char *ca_pem);
+
+/**
+ * Check if the last connection attempt offered a cached session.
+ */
+bool tls_session_offered();
+#endif
\ No newline at end of file
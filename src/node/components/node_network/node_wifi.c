@@ -1,12 +1,22 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "esp_idf_version.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
+#if ESP_IDF_VERSION_MAJOR >= 5
+#include "esp_random.h"
+#else
+#include "esp_system.h"
+#endif
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 //#include "node_status.h"
+#include "node_hist.h"
 #include "node_wifi.h"
+#include "node_wifi_scan.h"
 
 static const char *TAG = "wifi";
 
@@ -16,25 +26,377 @@ static EventGroupHandle_t wifi_event_group;
 enum wifi_const_internal
 {
     CONNECTED_BIT = BIT0,
-    DEFAULT_CONNECT_TIMEOUT_MS = 3000
+    DEFAULT_CONNECT_TIMEOUT_MS = 3000,
+    WIFI_BACKOFF_MIN_MS = CONFIG_NODE_WIFI_BACKOFF_MIN_MS,
+    WIFI_BACKOFF_MAX_MS = CONFIG_NODE_WIFI_BACKOFF_MAX_MS,
+    WIFI_ROAM_RSSI = CONFIG_NODE_WIFI_ROAM_RSSI,
+    WIFI_ROAM_HYSTERESIS = CONFIG_NODE_WIFI_ROAM_HYSTERESIS,
+    WIFI_ROAM_INTERVAL_S = CONFIG_NODE_WIFI_ROAM_INTERVAL_S,
+    WIFI_SCAN_TTL_S = CONFIG_NODE_WIFI_SCAN_TTL_S,
+    WIFI_MAX_REASONS = 8,       /* distinct disconnect reasons counted */
+    WIFI_BSSID_LEN = 6
 };
 
+/**
+ * Station state, transitions are driven by WiFi events and timers.
+ */
+typedef enum wifi_state
+{
+    WIFI_STATE_IDLE,        /** Not started */
+    WIFI_STATE_CONNECTING,  /** Association or DHCP in progress */
+    WIFI_STATE_CONNECTED,   /** Got IP */
+    WIFI_STATE_BACKOFF,     /** Waiting to retry after a failure */
+    WIFI_STATE_ROAMING      /** Leaving the AP for a stronger one */
+} wifi_state_t;
+
+static const char *WIFI_STATE_NAMES[] =
+{
+    "idle", "connecting", "connected", "backoff", "roaming"
+};
+
+typedef struct wifi_reason_count
+{
+    uint8_t reason;         /** wifi_err_reason_t, 0 if slot is free */
+    uint32_t count;         /** Disconnects with this reason */
+} wifi_reason_count_t;
+
+/**
+ * Connection statistics.
+ *
+ * Reconnect time is measured from losing the AP till IP address,
+ * it includes backoff and roaming.
+ */
+typedef struct wifi_stats
+{
+    node_log_hist_t reconnect;  /** Reconnect time, us */
+    uint32_t attempts;          /** Connection attempts */
+    uint32_t disconnects;       /** Disconnection events */
+    uint32_t other_reasons;     /** Disconnects not fitting the reason table */
+    uint32_t roam_scans;        /** Scans for a stronger AP */
+    uint32_t roams;             /** Moves to a stronger AP */
+    wifi_reason_count_t reasons[WIFI_MAX_REASONS];
+} wifi_stats_t;
+
+static wifi_state_t wifi_state = WIFI_STATE_IDLE;
+/** Failed attempts since the last connection. */
+static uint32_t wifi_failures = 0;
+static uint32_t wifi_backoff_ms = 0;
+/** Connection loss time, 0 while connected. */
+static int64_t wifi_down_us = 0;
+static uint8_t wifi_roam_bssid[WIFI_BSSID_LEN];
+static uint8_t wifi_roam_channel = 0;
+static wifi_stats_t wifi_stats;
+static portMUX_TYPE wifi_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_timer_handle_t wifi_retry_timer;
+static esp_timer_handle_t wifi_roam_timer;
+
+#if CONFIG_NODE_WIFI_PS_MAX_MODEM
+static const wifi_ps_type_t WIFI_POWER_SAVE = WIFI_PS_MAX_MODEM;
+#elif CONFIG_NODE_WIFI_PS_MIN_MODEM
+static const wifi_ps_type_t WIFI_POWER_SAVE = WIFI_PS_MIN_MODEM;
+#else
+static const wifi_ps_type_t WIFI_POWER_SAVE = WIFI_PS_NONE;
+#endif
+
+/**
+ * Delay before the next attempt.
+ *
+ * The first retry after losing the AP is immediate, the following ones
+ * back off exponentially with up to a quarter of random jitter, so nodes
+ * which lost the same AP do not retry in step.
+ */
+static uint32_t wifi_backoff(uint32_t failures)
+{
+    if (failures <= 1)
+    {
+        return 0;
+    }
+    uint32_t shift = failures - 2 > 16 ? 16 : failures - 2;
+    uint32_t backoff_ms = (uint32_t)WIFI_BACKOFF_MIN_MS << shift;
+    if (backoff_ms > WIFI_BACKOFF_MAX_MS)
+    {
+        backoff_ms = WIFI_BACKOFF_MAX_MS;
+    }
+    return backoff_ms + esp_random() % (backoff_ms / 4 + 1);
+}
+
+static void wifi_attempt()
+{
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_state = WIFI_STATE_CONNECTING;
+    wifi_stats.attempts++;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    esp_err_t err = esp_wifi_connect();
+    if (err == ESP_OK)
+    {
+        return;
+    }
+
+    // A refused connect (e.g. during a scan) sends no DISCONNECTED event
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_failures++;
+    wifi_backoff_ms = wifi_backoff(wifi_failures);
+    wifi_state = WIFI_STATE_BACKOFF;
+    uint32_t backoff_ms = wifi_backoff_ms;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    ESP_LOGW(TAG, "Connect refused: %s, retry in %" PRIu32 " ms",
+             esp_err_to_name(err), backoff_ms);
+    esp_timer_stop(wifi_retry_timer);
+    esp_timer_start_once(wifi_retry_timer, (uint64_t)backoff_ms * 1000);
+}
+
+static void wifi_retry_cb(void *arg)
+{
+    if (wifi_state == WIFI_STATE_BACKOFF)
+    {
+        wifi_attempt();
+    }
+}
+
+/**
+ * Count disconnect reason, called with wifi_lock.
+ */
+static void wifi_count_reason(uint8_t reason)
+{
+    wifi_stats.disconnects++;
+    for (int n = 0; n < WIFI_MAX_REASONS; ++n)
+    {
+        wifi_reason_count_t *slot = &wifi_stats.reasons[n];
+        if (slot->reason == reason || slot->reason == 0)
+        {
+            slot->reason = reason;
+            slot->count++;
+            return;
+        }
+    }
+    wifi_stats.other_reasons++;
+}
+
+/**
+ * Arm the low RSSI event, which starts a roaming scan.
+ */
+static void wifi_roam_arm(void *arg)
+{
+    if (WIFI_ROAM_RSSI != 0 && wifi_state == WIFI_STATE_CONNECTED)
+    {
+        esp_wifi_set_rssi_threshold(WIFI_ROAM_RSSI);
+    }
+}
+
+/**
+ * No stronger AP now, look again after the roaming interval.
+ */
+static void wifi_roam_later()
+{
+    esp_timer_stop(wifi_roam_timer);
+    esp_timer_start_once(wifi_roam_timer, (uint64_t)WIFI_ROAM_INTERVAL_S * 1000000);
+}
+
+/**
+ * Get SSID the station is configured for.
+ */
+static bool wifi_sta_ssid(char *ssid, size_t size)
+{
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK)
+    {
+        return false;
+    }
+    size_t len = strnlen((const char *)config.sta.ssid, sizeof(config.sta.ssid));
+    len = len < size - 1 ? len : size - 1;
+    memcpy(ssid, config.sta.ssid, len);
+    ssid[len] = '\0';
+    return true;
+}
+
+/**
+ * Move to a cached AP stronger than the current one by the hysteresis,
+ * the new one is joined on disconnection from the current one.
+ *
+ * @return true if roaming started.
+ */
+static bool wifi_roam_to_cached()
+{
+    char ssid[33];
+    wifi_ap_record_t current;
+    wifi_ap_t best;
+    if (wifi_state != WIFI_STATE_CONNECTED
+        || !wifi_sta_ssid(ssid, sizeof(ssid))
+        || esp_wifi_sta_get_ap_info(&current) != ESP_OK
+        || !wifi_scan_best(ssid, current.bssid, (int64_t)WIFI_SCAN_TTL_S * 1000000, &best)
+        || best.rssi < current.rssi + WIFI_ROAM_HYSTERESIS)
+    {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Roaming from RSSI %d dBm to %d dBm, channel %u",
+             current.rssi, best.rssi, best.channel);
+    memcpy(wifi_roam_bssid, best.bssid, WIFI_BSSID_LEN);
+    wifi_roam_channel = best.channel;
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_state = WIFI_STATE_ROAMING;
+    wifi_stats.roams++;
+    portEXIT_CRITICAL(&wifi_lock);
+    esp_wifi_disconnect();
+    return true;
+}
+
+/**
+ * Signal is low: roam to an AP seen by the background scan, or scan
+ * for APs with the same SSID and decide on SCAN_DONE.
+ */
+static void wifi_on_rssi_low()
+{
+    if (wifi_roam_to_cached())
+    {
+        return;
+    }
+
+    char ssid[33];
+    if (wifi_state == WIFI_STATE_CONNECTED
+        && wifi_sta_ssid(ssid, sizeof(ssid))
+        && wifi_scan_start(WIFI_SCAN_SSID, ssid))
+    {
+        portENTER_CRITICAL(&wifi_lock);
+        wifi_stats.roam_scans++;
+        portEXIT_CRITICAL(&wifi_lock);
+    }
+    else
+    {
+        wifi_roam_later();
+    }
+}
+
+static void wifi_on_scan_done()
+{
+    if (wifi_scan_done() == WIFI_SCAN_SSID && !wifi_roam_to_cached())
+    {
+        ESP_LOGI(TAG, "No stronger AP");
+        wifi_roam_later();
+    }
+}
+
+/**
+ * Set or clear the BSSID the station is bound to.
+ *
+ * Roaming binds the station to the chosen AP, any AP of the SSID is
+ * accepted again once the connection is lost.  Channel is a hint which
+ * limits the connect scan to one channel, 0 scans all of them.
+ */
+static void wifi_bind_bssid(const uint8_t *bssid, uint8_t channel)
+{
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK
+        || (bssid == NULL && !config.sta.bssid_set && config.sta.channel == channel))
+    {
+        return;
+    }
+
+    config.sta.bssid_set = bssid != NULL;
+    if (bssid != NULL)
+    {
+        memcpy(config.sta.bssid, bssid, WIFI_BSSID_LEN);
+    }
+    config.sta.channel = channel;
+    esp_wifi_set_config(WIFI_IF_STA, &config);
+}
+
+static void wifi_on_disconnected(const wifi_event_sta_disconnected_t *event)
+{
+    int64_t now = esp_timer_get_time();
+    xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
+    // set_wifi_configured(true);
+    // set_wifi_connected(false);
+
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_count_reason(event->reason);
+    if (wifi_down_us == 0)
+    {
+        wifi_down_us = now;
+    }
+    wifi_state_t state = wifi_state;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    if (state == WIFI_STATE_IDLE)
+    {
+        return;
+    }
+    if (state == WIFI_STATE_ROAMING)
+    {
+        // Left the old AP on purpose, join the chosen one at once
+        wifi_bind_bssid(wifi_roam_bssid, wifi_roam_channel);
+        wifi_attempt();
+        return;
+    }
+
+    // Any AP of the SSID will do.  The immediate retry scans only the
+    // channel it was last seen on, the following ones scan all channels.
+    char ssid[33];
+    wifi_ap_t ap;
+    uint8_t channel = 0;
+    if (wifi_failures == 0
+        && wifi_sta_ssid(ssid, sizeof(ssid))
+        && wifi_scan_best(ssid, NULL, (int64_t)WIFI_SCAN_TTL_S * 1000000, &ap))
+    {
+        channel = ap.channel;
+    }
+    wifi_bind_bssid(NULL, channel);
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_failures++;
+    wifi_backoff_ms = wifi_backoff(wifi_failures);
+    wifi_state = WIFI_STATE_BACKOFF;
+    uint32_t failures = wifi_failures;
+    uint32_t backoff_ms = wifi_backoff_ms;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    ESP_LOGW(TAG, "Disconnected, reason %u, %" PRIu32 " failure(s), retry in %" PRIu32 " ms",
+             event->reason, failures, backoff_ms);
+    esp_timer_stop(wifi_retry_timer);
+    esp_timer_start_once(wifi_retry_timer, (uint64_t)backoff_ms * 1000);
+}
+
+static void wifi_on_got_ip()
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&wifi_lock);
+    if (wifi_down_us != 0)
+    {
+        node_log_hist_add(&wifi_stats.reconnect, (uint32_t)(now - wifi_down_us));
+        wifi_down_us = 0;
+    }
+    wifi_failures = 0;
+    wifi_backoff_ms = 0;
+    wifi_state = WIFI_STATE_CONNECTED;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    xEventGroupSetBits(wifi_event_group, CONNECTED_BIT);
+    ESP_LOGI(TAG, "Connected");
+    // set_wifi_connected(true);
+    wifi_roam_arm(NULL);
+}
+
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data)
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
-        esp_wifi_connect();
-        xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
-        // set_wifi_configured(true);
-        // set_wifi_connected(false);
-        ESP_LOGW(TAG, "Disconnected");
+        wifi_on_disconnected((const wifi_event_sta_disconnected_t *)event_data);
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_BSS_RSSI_LOW)
+    {
+        wifi_on_rssi_low();
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE)
+    {
+        wifi_on_scan_done();
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
     {
-        xEventGroupSetBits(wifi_event_group, CONNECTED_BIT);
-        ESP_LOGI(TAG, "Connected");
-        // set_wifi_connected(true);
+        wifi_on_got_ip();
     }
 }
 
@@ -48,18 +410,45 @@ void wifi_init()
     assert(sta_netif);
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    node_log_hist_init(&wifi_stats.reconnect);
+    const esp_timer_create_args_t retry_args = {
+        .callback = &wifi_retry_cb,
+        .name = "wifi_retry"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &wifi_retry_timer));
+    const esp_timer_create_args_t roam_args = {
+        .callback = &wifi_roam_arm,
+        .name = "wifi_roam"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&roam_args, &wifi_roam_timer));
+    wifi_scan_init();
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_BSS_RSSI_LOW, &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_FLASH));
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_NULL));
     ESP_ERROR_CHECK(esp_wifi_start());
+    // Radio sleeps between MQTT publish bursts
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_POWER_SAVE));
 }
 
 static bool wifi_connect_internal(wifi_config_t *config)
 {
+#if CONFIG_NODE_WIFI_PS_MAX_MODEM
+    config->sta.listen_interval = CONFIG_NODE_WIFI_LISTEN_INTERVAL;
+#endif
+    // A BSSID bound by roaming is not kept over restart
+    config->sta.bssid_set = false;
+    config->sta.channel = 0;
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, config));
-    esp_wifi_connect();
+
+    esp_timer_stop(wifi_retry_timer);
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_failures = 0;
+    portEXIT_CRITICAL(&wifi_lock);
+    wifi_attempt();
 
     return wifi_wait_for_connection(DEFAULT_CONNECT_TIMEOUT_MS);
 }
@@ -71,7 +460,7 @@ bool wifi_wait_for_connection(int timeoutMS)
         CONNECTED_BIT,
         pdFALSE,
         pdTRUE,
-        timeoutMS / portTICK_PERIOD_MS);
+        timeoutMS < 0 ? portMAX_DELAY : timeoutMS / portTICK_PERIOD_MS);
     return (bits & CONNECTED_BIT) != 0;
 }
 
@@ -103,23 +492,98 @@ bool wifi_run()
     }
 }
 
-void wifi_scan()
+void wifi_list()
 {
-    static const int DEFAULT_SCAN_LIST_SIZE = 16;
+    wifi_scan_print();
 
-    uint16_t number = DEFAULT_SCAN_LIST_SIZE;
-    wifi_ap_record_t ap_info[DEFAULT_SCAN_LIST_SIZE];
-    uint16_t ap_count = 0;
-    bzero(ap_info, sizeof(ap_info));
+    // Channels are swept only while connected, otherwise scan them all,
+    // e.g. to see which SSIDs are around when joining fails
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_state_t state = wifi_state;
+    portEXIT_CRITICAL(&wifi_lock);
+    if (state == WIFI_STATE_CONNECTED || state == WIFI_STATE_ROAMING)
+    {
+        return;
+    }
+    if ((state != WIFI_STATE_IDLE || esp_wifi_set_mode(WIFI_MODE_STA) == ESP_OK)
+        && wifi_scan_start(WIFI_SCAN_FULL, NULL))
+    {
+        printf("Scan started, list again in a few seconds\r\n");
+    }
+    else
+    {
+        printf("Scan not started, the station may be connecting, list again later\r\n");
+    }
+}
 
-    esp_wifi_scan_start(NULL, true);
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&number, ap_info));
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&ap_count));
-    printf("%u APs scanned. Limited to %d ", ap_count, DEFAULT_SCAN_LIST_SIZE);
-    printf("SSID\tRSSI\tChannel\r\n");
-    for (int i = 0; (i < DEFAULT_SCAN_LIST_SIZE) && (i < ap_count); i++)
+static const char *wifi_reason_name(uint8_t reason)
+{
+    switch (reason)
+    {
+    case WIFI_REASON_AUTH_EXPIRE:
+        return "auth expire";
+    case WIFI_REASON_ASSOC_LEAVE:
+        return "assoc leave";
+    case WIFI_REASON_BEACON_TIMEOUT:
+        return "beacon timeout";
+    case WIFI_REASON_NO_AP_FOUND:
+        return "no AP found";
+    case WIFI_REASON_AUTH_FAIL:
+        return "auth fail";
+    case WIFI_REASON_ASSOC_FAIL:
+        return "assoc fail";
+    case WIFI_REASON_HANDSHAKE_TIMEOUT:
+        return "handshake timeout";
+    case WIFI_REASON_CONNECTION_FAIL:
+        return "connection fail";
+    default:
+        return "";
+    }
+}
+
+/**
+ * Print connection state machine and its statistics.
+ */
+static void wifi_print_stats()
+{
+    portENTER_CRITICAL(&wifi_lock);
+    wifi_stats_t stats = wifi_stats;
+    wifi_state_t state = wifi_state;
+    uint32_t failures = wifi_failures;
+    uint32_t backoff_ms = wifi_backoff_ms;
+    portEXIT_CRITICAL(&wifi_lock);
+
+    wifi_ap_record_t ap;
+    if (state == WIFI_STATE_CONNECTED && esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+    {
+        printf("State: %s, RSSI %d dBm, channel %u\r\n", WIFI_STATE_NAMES[state], ap.rssi, ap.primary);
+    }
+    else
+    {
+        printf("State: %s, %" PRIu32 " failure(s) in a row, backoff %" PRIu32 " ms\r\n",
+               WIFI_STATE_NAMES[state], failures, backoff_ms);
+    }
+    printf("Attempts: %" PRIu32 ", disconnects: %" PRIu32 "\r\n", stats.attempts, stats.disconnects);
+    printf("Reconnect, ms: p50 %" PRIu32 ", p99 %" PRIu32 ", max %" PRIu32 " (%" PRIu32 ")\r\n",
+           node_log_hist_percentile(&stats.reconnect, 500) / 1000,
+           node_log_hist_percentile(&stats.reconnect, 990) / 1000,
+           stats.reconnect.max / 1000,
+           stats.reconnect.count);
+    if (WIFI_ROAM_RSSI != 0)
+    {
+        printf("Roaming below %d dBm: %" PRIu32 " scans, %" PRIu32 " roams\r\n",
+               WIFI_ROAM_RSSI, stats.roam_scans, stats.roams);
+    }
+    for (int n = 0; n < WIFI_MAX_REASONS && stats.reasons[n].reason != 0; ++n)
+    {
+        printf("  reason %3u %-18s %" PRIu32 "\r\n",
+               stats.reasons[n].reason,
+               wifi_reason_name(stats.reasons[n].reason),
+               stats.reasons[n].count);
+    }
+    if (stats.other_reasons != 0)
     {
-        printf("%s\t%d\t%d\r\n", ap_info[i].ssid, ap_info[i].rssi, ap_info[i].primary);
+        printf("  other reasons %" PRIu32 "\r\n", stats.other_reasons);
     }
 }
 
@@ -148,4 +612,5 @@ void wifi_print_status()
     printf("netmask:\t\t" IPSTR "; ", IP2STR(&ip.netmask));
     printf("gateway:\t\t" IPSTR, IP2STR(&ip.gw));
     printf("\r\n");
+    wifi_print_stats();
 }
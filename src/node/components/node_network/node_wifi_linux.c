@@ -0,0 +1,41 @@
+/**
+ * WiFi layer of the host (linux target) build.
+ *
+ * Host network is managed by the OS and is always considered connected,
+ * so MQTT client starts immediately.
+*/
+#include <stdio.h>
+#include "esp_log.h"
+#include "node_wifi.h"
+
+static const char *TAG = "wifi";
+
+void wifi_init()
+{
+    ESP_LOGI(TAG, "Host build, using OS network");
+}
+
+bool wifi_run()
+{
+    return true;
+}
+
+void wifi_list()
+{
+    printf("WiFi scan is not available in host build\r\n");
+}
+
+bool wifi_connect(const char *ssid, const char *pass)
+{
+    return true;
+}
+
+void wifi_print_status()
+{
+    printf("Host build, using OS network\r\n");
+}
+
+bool wifi_wait_for_connection(int timeoutMS)
+{
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "node_hist.h"
+#include "node_wifi.h"
+#include "node_wifi_scan.h"
+
+enum wifi_scan_const_internal
+{
+    WIFI_SCAN_INTERVAL_S = CONFIG_NODE_WIFI_SCAN_INTERVAL_S,
+    WIFI_SCAN_DWELL_MS = CONFIG_NODE_WIFI_SCAN_DWELL_MS,
+    WIFI_SCAN_TTL_S = CONFIG_NODE_WIFI_SCAN_TTL_S,
+    WIFI_SCAN_MAX_RECORDS = 16,     /* records taken from one scan */
+    WIFI_SCAN_CACHE_LEN = 16        /* cached APs, the oldest is replaced */
+};
+
+/**
+ * Scan statistics.
+ *
+ * Off-channel time is measured from the start of a scan started while
+ * connected till SCAN_DONE, so it includes the return to the channel
+ * of the AP.
+ */
+typedef struct wifi_scan_stats
+{
+    node_log_hist_t off_channel;    /** Off-channel time per scan, us */
+    uint64_t off_channel_us;        /** Total off-channel time, us */
+    uint32_t scans;                 /** Scans finished */
+    uint32_t failed;                /** Scans which could not start */
+} wifi_scan_stats_t;
+
+static const char *TAG = "wifi_scan";
+
+static wifi_ap_t wifi_scan_cache[WIFI_SCAN_CACHE_LEN];
+static wifi_scan_stats_t wifi_scan_stats;
+static wifi_scan_kind_t wifi_scan_kind = WIFI_SCAN_NONE;
+static int64_t wifi_scan_start_us = 0;
+/** Scan was started while connected, it takes the station off its channel. */
+static bool wifi_scan_connected = false;
+static uint8_t wifi_scan_channel = 0;
+static uint8_t wifi_scan_ssid[33];
+/** Driver records, taken in the event task only. */
+static wifi_ap_record_t wifi_scan_records[WIFI_SCAN_MAX_RECORDS];
+static portMUX_TYPE wifi_scan_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t wifi_scan_timer;
+
+/**
+ * Next channel of the sweep, within the channels of the configured country.
+ */
+static uint8_t wifi_scan_next_channel(uint8_t channel)
+{
+    wifi_country_t country;
+    uint8_t first = 1;
+    uint8_t count = 11;
+    if (esp_wifi_get_country(&country) == ESP_OK && country.nchan > 0)
+    {
+        first = country.schan;
+        count = country.nchan;
+    }
+    return channel < first || channel >= first + count - 1 ? first : channel + 1;
+}
+
+static void wifi_scan_sweep_cb(void *arg)
+{
+    if (wifi_wait_for_connection(0))
+    {
+        wifi_scan_start(WIFI_SCAN_SWEEP, NULL);
+    }
+}
+
+void wifi_scan_init()
+{
+    node_log_hist_init(&wifi_scan_stats.off_channel);
+    if (WIFI_SCAN_INTERVAL_S == 0)
+    {
+        return;
+    }
+
+    const esp_timer_create_args_t sweep_args = {
+        .callback = &wifi_scan_sweep_cb,
+        .name = "wifi_scan"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&sweep_args, &wifi_scan_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(wifi_scan_timer, (uint64_t)WIFI_SCAN_INTERVAL_S * 1000000));
+}
+
+bool wifi_scan_start(wifi_scan_kind_t kind, const char *ssid)
+{
+    bool connected = wifi_wait_for_connection(0);
+
+    portENTER_CRITICAL(&wifi_scan_lock);
+    bool start = wifi_scan_kind == WIFI_SCAN_NONE;
+    if (start)
+    {
+        wifi_scan_kind = kind;
+    }
+    portEXIT_CRITICAL(&wifi_scan_lock);
+    if (!start)
+    {
+        return false;
+    }
+
+    wifi_scan_config_t scan = {0};
+    if (kind == WIFI_SCAN_SWEEP)
+    {
+        // One beacon interval on one channel is all the station misses
+        wifi_scan_channel = wifi_scan_next_channel(wifi_scan_channel);
+        scan.channel = wifi_scan_channel;
+        scan.scan_type = WIFI_SCAN_TYPE_PASSIVE;
+        scan.scan_time.passive = WIFI_SCAN_DWELL_MS;
+    }
+    else
+    {
+        if (kind == WIFI_SCAN_SSID)
+        {
+            strlcpy((char *)wifi_scan_ssid, ssid, sizeof(wifi_scan_ssid));
+            scan.ssid = wifi_scan_ssid;
+        }
+        scan.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+    }
+
+    wifi_scan_connected = connected;
+    wifi_scan_start_us = esp_timer_get_time();
+    esp_err_t err = esp_wifi_scan_start(&scan, false);
+    if (err != ESP_OK)
+    {
+        ESP_LOGD(TAG, "Scan not started: %s", esp_err_to_name(err));
+        portENTER_CRITICAL(&wifi_scan_lock);
+        wifi_scan_kind = WIFI_SCAN_NONE;
+        wifi_scan_stats.failed++;
+        portEXIT_CRITICAL(&wifi_scan_lock);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Update or add cached AP, replace the oldest one if the cache is full.
+ * Called with wifi_scan_lock.
+ */
+static void wifi_scan_cache_add(const wifi_ap_record_t *record, int64_t now_us)
+{
+    wifi_ap_t *slot = &wifi_scan_cache[0];
+    for (int n = 0; n < WIFI_SCAN_CACHE_LEN; ++n)
+    {
+        wifi_ap_t *ap = &wifi_scan_cache[n];
+        if (ap->seen_us != 0 && memcmp(ap->bssid, record->bssid, sizeof(ap->bssid)) == 0)
+        {
+            slot = ap;
+            break;
+        }
+        if (ap->seen_us < slot->seen_us)
+        {
+            slot = ap;
+        }
+    }
+
+    strlcpy(slot->ssid, (const char *)record->ssid, sizeof(slot->ssid));
+    memcpy(slot->bssid, record->bssid, sizeof(slot->bssid));
+    slot->channel = record->primary;
+    slot->rssi = record->rssi;
+    slot->seen_us = now_us;
+}
+
+wifi_scan_kind_t wifi_scan_done()
+{
+    int64_t now = esp_timer_get_time();
+    if (wifi_scan_kind == WIFI_SCAN_NONE)
+    {
+        return WIFI_SCAN_NONE;
+    }
+
+    // Taking the records also frees them in the driver
+    uint16_t count = WIFI_SCAN_MAX_RECORDS;
+    if (esp_wifi_scan_get_ap_records(&count, wifi_scan_records) != ESP_OK)
+    {
+        count = 0;
+    }
+
+    portENTER_CRITICAL(&wifi_scan_lock);
+    for (int n = 0; n < count; ++n)
+    {
+        wifi_scan_cache_add(&wifi_scan_records[n], now);
+    }
+    wifi_scan_stats.scans++;
+    if (wifi_scan_connected)
+    {
+        uint32_t off_channel_us = (uint32_t)(now - wifi_scan_start_us);
+        node_log_hist_add(&wifi_scan_stats.off_channel, off_channel_us);
+        wifi_scan_stats.off_channel_us += off_channel_us;
+    }
+    wifi_scan_kind_t kind = wifi_scan_kind;
+    wifi_scan_kind = WIFI_SCAN_NONE;
+    portEXIT_CRITICAL(&wifi_scan_lock);
+
+    return kind;
+}
+
+bool wifi_scan_best(const char *ssid, const uint8_t *exclude, int64_t max_age_us, wifi_ap_t *ap)
+{
+    int64_t now = esp_timer_get_time();
+    bool found = false;
+
+    portENTER_CRITICAL(&wifi_scan_lock);
+    for (int n = 0; n < WIFI_SCAN_CACHE_LEN; ++n)
+    {
+        const wifi_ap_t *cached = &wifi_scan_cache[n];
+        if (cached->seen_us != 0
+            && now - cached->seen_us <= max_age_us
+            && strcmp(cached->ssid, ssid) == 0
+            && (exclude == NULL || memcmp(cached->bssid, exclude, sizeof(cached->bssid)) != 0)
+            && (!found || cached->rssi > ap->rssi))
+        {
+            *ap = *cached;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&wifi_scan_lock);
+
+    return found;
+}
+
+/**
+ * Sort key, strongest first and free slots last.
+ */
+static int wifi_scan_order(const wifi_ap_t *ap)
+{
+    return ap->seen_us != 0 ? ap->rssi : INT8_MIN - 1;
+}
+
+void wifi_scan_print()
+{
+    // Console task only, too large for its stack
+    static wifi_ap_t aps[WIFI_SCAN_CACHE_LEN];
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&wifi_scan_lock);
+    memcpy(aps, wifi_scan_cache, sizeof(aps));
+    wifi_scan_stats_t stats = wifi_scan_stats;
+    portEXIT_CRITICAL(&wifi_scan_lock);
+
+    for (int i = 1; i < WIFI_SCAN_CACHE_LEN; ++i)
+    {
+        wifi_ap_t ap = aps[i];
+        int j = i;
+        for (; j > 0 && wifi_scan_order(&aps[j - 1]) < wifi_scan_order(&ap); --j)
+        {
+            aps[j] = aps[j - 1];
+        }
+        aps[j] = ap;
+    }
+
+    int count = 0;
+    printf("SSID\tRSSI\tChannel\tAge, s\r\n");
+    for (int n = 0; n < WIFI_SCAN_CACHE_LEN; ++n)
+    {
+        int64_t age_s = (now - aps[n].seen_us) / 1000000;
+        if (aps[n].seen_us == 0 || age_s > WIFI_SCAN_TTL_S)
+        {
+            continue;
+        }
+        printf("%s\t%d\t%u\t%" PRId64 "\r\n", aps[n].ssid, aps[n].rssi, aps[n].channel, age_s);
+        ++count;
+    }
+    printf("%d APs seen in %d s, %" PRIu32 " scans, %" PRIu32 " not started\r\n",
+           count, WIFI_SCAN_TTL_S, stats.scans, stats.failed);
+    printf("Off-channel: total %" PRIu64 " ms, per scan p50 %" PRIu32 " ms, max %" PRIu32 " ms (%" PRIu32 ")\r\n",
+           stats.off_channel_us / 1000,
+           node_log_hist_percentile(&stats.off_channel, 500) / 1000,
+           stats.off_channel.max / 1000,
+           stats.off_channel.count);
+}
\ No newline at end of file
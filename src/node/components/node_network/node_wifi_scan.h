@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Background WiFi scan and cache of seen access points.
+ *
+ * Scans are asynchronous, results are merged into the cache on
+ * WIFI_EVENT_SCAN_DONE.  While connected the cache is refreshed one
+ * channel at a time with a short passive scan, so the station leaves
+ * its channel briefly and rarely.
+ */
+
+/**
+ * Kind of a scan in progress.
+ */
+typedef enum wifi_scan_kind
+{
+    WIFI_SCAN_NONE,     /** No scan in progress */
+    WIFI_SCAN_SWEEP,    /** One channel, passive, next channel every time */
+    WIFI_SCAN_SSID,     /** All channels, active, one SSID */
+    WIFI_SCAN_FULL      /** All channels, active */
+} wifi_scan_kind_t;
+
+/**
+ * Cached access point.
+ */
+typedef struct wifi_ap
+{
+    char ssid[33];          /** SSID */
+    uint8_t bssid[6];       /** BSSID */
+    uint8_t channel;        /** Primary channel */
+    int8_t rssi;            /** Signal level when last seen, dBm */
+    int64_t seen_us;        /** Time last seen, 0 if slot is free */
+} wifi_ap_t;
+
+/**
+ * Start periodic channel sweep.
+ */
+void wifi_scan_init();
+
+/**
+ * Start a scan, unless one is in progress.
+ *
+ * @kind    scan kind
+ * @ssid    SSID for WIFI_SCAN_SSID, NULL otherwise
+ * @return true if started.
+ */
+bool wifi_scan_start(wifi_scan_kind_t kind, const char *ssid);
+
+/**
+ * Merge results of the finished scan into the cache, on WIFI_EVENT_SCAN_DONE.
+ *
+ * @return kind of the finished scan, WIFI_SCAN_NONE if it was not ours.
+ */
+wifi_scan_kind_t wifi_scan_done();
+
+/**
+ * Find the strongest cached AP of the SSID.
+ *
+ * @ssid        SSID
+ * @exclude     BSSID to skip, NULL if none
+ * @max_age_us  skip APs not seen for that long
+ * @ap          filled with the AP found
+ * @return false if there is none.
+ */
+bool wifi_scan_best(const char *ssid, const uint8_t *exclude, int64_t max_age_us, wifi_ap_t *ap);
+
+/**
+ * Print cached APs and scan statistics.
+ */
+void wifi_scan_print();
\ No newline at end of file
@@ -3,15 +3,40 @@
  * Interface to all sensors supported by the Node
 */
 #include <stdbool.h>
+#include <stdint.h>
+#include "node_hist.h"
 
 /**
  * Constants for sensors component.
 */
 enum node_sensors_const
 {
-    NODE_SENSORS_MAX_NAME_LEN = 32  /**< Sensor name length limit. */
+    NODE_SENSORS_MAX_NAME_LEN = 32,     /**< Sensor name length limit. */
+    NODE_SENSORS_MAX_SAMPLERS = 4,      /**< Sampler tasks limit. */
+    NODE_SENSORS_MAX_CAL_POINTS = 8,    /**< Moisture calibration points limit. */
+    NODE_SENSORS_MAX_RULES = 16,        /**< Threshold rules limit. */
+    NODE_SENSORS_RULES_MAX_LEN = 512    /**< Rules definition length limit. */
 };
 
+/**
+ * Adaptive sample period of a sensor.
+ *
+ * The sensor is read at the sampler period while its reading moves and
+ * the period is stretched up to the configured maximum while it is flat.
+*/
+typedef struct node_sensor_rate
+{
+    float delta;            /**< Change per reading worth the full rate, 0 for fixed period */
+    float last;             /**< Last reading */
+    float activity;         /**< Smoothed change between readings */
+    uint32_t base_ms;       /**< Sampler period, the shortest one */
+    uint32_t period_ms;     /**< Current period, 0 until the first reading */
+    uint32_t due_ms;        /**< Tick time of the next reading, ms */
+    uint32_t quiet;         /**< Consecutive readings without change */
+    uint32_t readings;      /**< Readings taken */
+    uint32_t skipped;       /**< Sampler cycles the sensor was not read */
+} node_sensor_rate_t;
+
 typedef struct node_sensor node_sensor_t;
 /**
  * Sensor descriptor
@@ -22,6 +47,9 @@ struct node_sensor
     const char* name;       /**< Sensor name */
     const char* quantity;   /**< Sensor quantity (e.g. temperature) */
     const char* unit;       /**< Sensor unit (e.g. degrees C)*/
+    uint8_t rules;          /**< First threshold rule + 1, 0 if none */
+    bool failed;            /**< Last reading failed, alarm has been published */
+    node_sensor_rate_t rate;    /**< Adaptive sample period, owned by the sampler */
 };
 
 /**
@@ -32,6 +60,12 @@ struct node_sensor
 void
 node_sensors_start();
 
+/**
+ * Register microbenchmarks of the sensor registry.
+*/
+void
+node_sensors_bench_register();
+
 /**
  * Start enumeration of the sensors.
  * 
@@ -47,3 +81,291 @@ node_sensor_enum_start();
 */
 void
 node_sensor_enum_finish();
+
+/**
+ * Sampling statistics of a sampler task.
+ *
+ * Histogram counts deviations of actual intervals between samples from
+ * the nominal sample period, in microseconds.
+*/
+typedef struct node_sampler_stats
+{
+    const char* name;       /**< Sampler name */
+    uint32_t period_ms;     /**< Nominal sample period */
+    node_hist_t hist;       /**< Interval deviation histogram */
+} node_sampler_stats_t;
+
+/**
+ * Get sampling statistics.
+ *
+ * @index   sampler index, 0 to NODE_SENSORS_MAX_SAMPLERS-1
+ * @stats   structure to be filled
+ * @return true if sampler exists, false otherwise.
+*/
+bool
+node_sampler_get_stats(int index, node_sampler_stats_t *stats);
+
+/**
+ * Sensor trace recorder state.
+*/
+typedef struct node_sensors_trace_status
+{
+    bool recording;         /**< Recording is in progress */
+    uint32_t records;       /**< Records captured */
+    uint32_t dropped;       /**< Records lost, trace partition full */
+    uint32_t size;          /**< Trace size, bytes */
+    uint32_t capacity;      /**< Trace partition size, bytes */
+} node_sensors_trace_status_t;
+
+/**
+ * Start recording raw driver outputs to the trace partition.
+ *
+ * Previous trace is erased.  Available with CONFIG_NODE_SENSORS_TRACE.
+ *
+ * @return false if there is no trace partition or recording is running.
+*/
+bool
+node_sensors_trace_start();
+
+/**
+ * Stop recording, write buffered records.
+*/
+void
+node_sensors_trace_stop();
+
+/**
+ * Get trace recorder state.
+*/
+void
+node_sensors_trace_get_status(node_sensors_trace_status_t *status);
+
+/**
+ * Read recorded trace.
+ *
+ * @offset  offset from the start of trace
+ * @buffer  destination
+ * @size    buffer size
+ * @return bytes read, 0 at the end of trace, -1 on error or while recording.
+*/
+int
+node_sensors_trace_read(uint32_t offset, void *buffer, uint32_t size);
+
+
+/**
+ * 1-wire temperature sensor resolution policies.
+ *
+ * Fixed policy is a resolution in bits, 9 to 12.
+*/
+enum node_sensors_1wire_policy
+{
+    NODE_SENSORS_1WIRE_DEFAULT = -1,    /**< Policy from configuration */
+    NODE_SENSORS_1WIRE_ADAPTIVE = 0     /**< Low resolution while stable, high during fast change */
+};
+
+/**
+ * 1-wire sensor state.
+*/
+typedef struct node_sensors_1wire_info
+{
+    char name[NODE_SENSORS_MAX_NAME_LEN];   /**< Sensor name (ROM code) */
+    int policy;             /**< Configured policy, see node_sensors_1wire_policy */
+    int resolution;         /**< Current resolution, bits */
+} node_sensors_1wire_info_t;
+
+/**
+ * Get state of 1-wire sensor.
+ *
+ * @index   sensor index on the bus
+ * @info    structure to be filled
+ * @return false if there is no such sensor.
+*/
+bool
+node_sensors_1wire_get_info(int index, node_sensors_1wire_info_t *info);
+
+/**
+ * Set resolution policy of 1-wire sensor and store it in NVS.
+ *
+ * @name    sensor name
+ * @policy  resolution in bits or node_sensors_1wire_policy
+ * @return false if sensor is not found or policy cannot be stored.
+*/
+bool
+node_sensors_1wire_set_policy(const char *name, int policy);
+
+/**
+ * Statistics of a 1-wire device, kept for each ROM code seen since boot.
+*/
+typedef struct node_sensors_1wire_stats
+{
+    char name[NODE_SENSORS_MAX_NAME_LEN];   /**< Sensor name (ROM code) */
+    bool present;           /**< Found by the last discovery */
+    uint32_t reads;         /**< Readings attempted */
+    uint32_t crc_errors;    /**< Scratchpad CRC mismatches */
+    uint32_t read_errors;   /**< Other bus and device errors */
+    uint32_t retries;       /**< Repeated scratchpad reads */
+    uint32_t failures;      /**< Readings lost after retries */
+    uint32_t por_values;    /**< 85 C power-on reset values */
+    uint64_t read_us;       /**< Total time of read transactions */
+    uint32_t max_read_us;   /**< Longest read transaction */
+} node_sensors_1wire_stats_t;
+
+/**
+ * Statistics of the 1-wire bus.
+*/
+typedef struct node_sensors_1wire_bus_stats
+{
+    uint32_t cycles;        /**< Conversion and read cycles */
+    uint32_t failed_cycles; /**< Cycles with any failed reading */
+    uint32_t discoveries;   /**< Device searches */
+    uint64_t busy_us;       /**< Total cycle time, conversion and reads */
+    uint64_t conversion_us; /**< Total conversion wait */
+    uint32_t max_cycle_us;  /**< Longest cycle */
+    int64_t since_us;       /**< Start of the first cycle, 0 if none */
+} node_sensors_1wire_bus_stats_t;
+
+/**
+ * Get statistics of 1-wire device.
+ *
+ * @index   0 to number of devices seen - 1
+ * @stats   structure to be filled
+ * @return false if there is no such device.
+*/
+bool
+node_sensors_1wire_get_stats(int index, node_sensors_1wire_stats_t *stats);
+
+/**
+ * Get statistics of 1-wire bus.
+*/
+void
+node_sensors_1wire_get_bus_stats(node_sensors_1wire_bus_stats_t *stats);
+
+/**
+ * Moisture probe calibration point.
+*/
+typedef struct node_sensors_cal_point
+{
+    uint16_t voltage_mv;    /**< Probe voltage */
+    uint16_t moisture;      /**< Moisture at this voltage, 0.01 % */
+} node_sensors_cal_point_t;
+
+/**
+ * Get calibration of the ADC moisture probe.
+ *
+ * @channel ADC1 channel
+ * @points  array of NODE_SENSORS_MAX_CAL_POINTS to be filled
+ * @count   number of points filled
+ * @return false if channel is not sampled.
+*/
+bool
+node_sensors_adc_get_calibration(int channel,
+                                 node_sensors_cal_point_t *points,
+                                 int *count);
+
+/**
+ * Store calibration of the ADC moisture probe in NVS.
+ *
+ * Sampler task rebuilds conversion table before the next sample.
+ *
+ * @channel ADC1 channel
+ * @points  2 to NODE_SENSORS_MAX_CAL_POINTS points sorted by voltage
+ * @count   number of points
+ * @return false if points are invalid or cannot be stored.
+*/
+bool
+node_sensors_adc_set_calibration(int channel,
+                                 const node_sensors_cal_point_t *points,
+                                 int count);
+
+/**
+ * State of a threshold rule.
+*/
+typedef struct node_sensors_rule_info
+{
+    char sensor[NODE_SENSORS_MAX_NAME_LEN]; /**< Sensor name */
+    bool above;         /**< On above the threshold, otherwise below */
+    float on;           /**< Threshold to turn on */
+    float off;          /**< Threshold to turn off (hysteresis) */
+    int gpio;           /**< Output */
+    bool invert;        /**< Output is low while on */
+    bool active;        /**< Rule is on */
+    uint32_t triggers;  /**< Transitions to on since the rule was set */
+} node_sensors_rule_info_t;
+
+/**
+ * Compile threshold rules, store them in NVS and apply.
+ *
+ * Available with CONFIG_NODE_SENSORS_RULES, see node_rules.h for the
+ * definition syntax.  Empty definition removes all rules.  Outputs must
+ * not be the 1-wire bus pin or the control loop output.
+ *
+ * @definition  rules text
+ * @return false on syntax error or if rules cannot be stored.
+*/
+bool
+node_sensors_rules_set(const char *definition);
+
+/**
+ * Get current rules definition.
+*/
+const char *
+node_sensors_rules_get();
+
+/**
+ * Get state of the rule.
+ *
+ * @index   rule position in the definition
+ * @info    structure to be filled
+ * @return false if there is no such rule.
+*/
+bool
+node_sensors_rule_get_info(int index, node_sensors_rule_info_t *info);
+
+/**
+ * PID control loop settings.
+*/
+typedef struct node_sensors_control_config
+{
+    char sensor[NODE_SENSORS_MAX_NAME_LEN]; /**< Input sensor, empty if the loop is off */
+    float setpoint;     /**< Target value of the input */
+    float kp;           /**< Proportional gain, % of output per unit */
+    float ki;           /**< Integral gain, % per unit per second */
+    float kd;           /**< Derivative gain, % per unit per second of change */
+    int gpio;           /**< PWM output */
+    bool reverse;       /**< Output rises above the setpoint (cooling), otherwise below (heating) */
+} node_sensors_control_config_t;
+
+/**
+ * PID control loop state.
+*/
+typedef struct node_sensors_control_status
+{
+    node_sensors_control_config_t config;   /**< Current settings */
+    bool valid;         /**< Input is fresh and the loop drives the output */
+    float input;        /**< Last input */
+    float output;       /**< Output duty, % */
+    float integral;     /**< Integral term, % */
+    uint32_t cycles;    /**< Loop iterations */
+    uint32_t timeouts;  /**< Iterations without fresh input, output off */
+    uint32_t saturated; /**< Iterations with output at 0 or 100 % */
+    node_hist_t jitter; /**< Deviation of loop period from nominal, us */
+    node_log_hist_t compute;    /**< Computation and output update time, us */
+} node_sensors_control_status_t;
+
+/**
+ * Store control loop settings in NVS and apply them.
+ *
+ * Available with CONFIG_NODE_SENSORS_CONTROL.  Integral term is kept
+ * when only setpoint or gains change.  Empty sensor switches the loop off.
+ * Output must not be the 1-wire bus pin or a rule output.
+ *
+ * @config  new settings
+ * @return false if settings are invalid or cannot be stored.
+*/
+bool
+node_sensors_control_set(const node_sensors_control_config_t *config);
+
+/**
+ * Get control loop state.
+*/
+void
+node_sensors_control_get_status(node_sensors_control_status_t *status);
\ No newline at end of file
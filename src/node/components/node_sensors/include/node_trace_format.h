@@ -0,0 +1,65 @@
+#pragma once
+/**
+ * Sensor trace file format.
+ *
+ * Trace is a header followed by fixed size records.  Records are written
+ * to erased flash, so the first record of type NODE_TRACE_END (all ones)
+ * or end of file terminates the trace.
+*/
+#include <stdint.h>
+
+enum node_trace_const
+{
+    NODE_TRACE_MAGIC = 0x52544847,  /**< "GHTR" little endian. */
+    NODE_TRACE_VERSION = 2,         /**< Format version. */
+    NODE_TRACE_MAX_CHANNELS = 16,   /**< Channels per record type. */
+    NODE_TRACE_LUT_ENTRIES = 4      /**< Conversion table entries per record. */
+};
+
+/**
+ * Record types.
+*/
+typedef enum node_trace_type
+{
+    NODE_TRACE_1WIRE_DEVICE = 1,    /**< 1-wire device found, payload is ROM code. */
+    NODE_TRACE_1WIRE_TEMP = 2,      /**< DS18B20 reading, status is DS18B20_ERROR. */
+    NODE_TRACE_ADC = 3,             /**< ADC reading, raw counts and millivolts. */
+    NODE_TRACE_ADC_LUT = 4,         /**< ADC conversion table part, status is index of the first entry. */
+    NODE_TRACE_END = 0xff           /**< Erased flash. */
+} node_trace_type_t;
+
+/**
+ * Trace header, same size as a record.
+*/
+typedef struct node_trace_header
+{
+    uint32_t magic;         /**< NODE_TRACE_MAGIC */
+    uint16_t version;       /**< NODE_TRACE_VERSION */
+    uint16_t record_size;   /**< sizeof(node_trace_record_t) */
+    uint32_t reserved[2];   /**< Zero. */
+} node_trace_header_t;
+
+/**
+ * Trace record.
+*/
+typedef struct node_trace_record
+{
+    uint32_t time_ms;       /**< Time since start of recording. */
+    uint8_t type;           /**< node_trace_type_t */
+    uint8_t channel;        /**< Device index or ADC channel. */
+    int16_t status;         /**< Driver error code, 0 if OK. */
+    union
+    {
+        uint8_t rom_code[8];    /**< NODE_TRACE_1WIRE_DEVICE */
+        float temperature;      /**< NODE_TRACE_1WIRE_TEMP */
+        struct
+        {
+            uint32_t raw;       /**< Raw ADC counts. */
+            uint32_t voltage_mv;/**< Calibrated voltage. */
+        } adc;                  /**< NODE_TRACE_ADC */
+        uint16_t lut[NODE_TRACE_LUT_ENTRIES];  /**< NODE_TRACE_ADC_LUT, moisture 0.01 % */
+    };
+} node_trace_record_t;
+
+_Static_assert(sizeof(node_trace_header_t) == sizeof(node_trace_record_t),
+               "trace header and record sizes differ");
\ No newline at end of file
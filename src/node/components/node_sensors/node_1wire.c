@@ -1,23 +1,50 @@
 #include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "owb.h"
 #include "owb_rmt.h"
 #include "ds18b20.h"
+#include "node_1wire.h"
+#include "node_diag.h"
 #include "node_network.h"
 #include "node_sensors_private.h"
+#include "node_tasks.h"
+#include "node_trace.h"
 
 enum sensors_1wire_const_internal
 {
-    SENSORS_1WIRE_GPIO = GPIO_NUM_21,
     SENSORS_1WIRE_MAX_DEVICES = 16,
     SENSORS_1WIRE_DS18B20_FAMILY_CODE = 0x28,
-    SENSORS_1WIRE_DS18B20_RESOLUTION = DS18B20_RESOLUTION_12_BIT,
-    SENSORS_1WIRE_SAMPLE_PERIOD_MS = 1000
+    SENSORS_1WIRE_SAMPLE_PERIOD_MS = CONFIG_NODE_SENSORS_1WIRE_PERIOD_MS,
+    SENSORS_1WIRE_ADAPTIVE_LOW = CONFIG_NODE_SENSORS_1WIRE_ADAPTIVE_LOW,
+    SENSORS_1WIRE_ADAPTIVE_HIGH = CONFIG_NODE_SENSORS_1WIRE_ADAPTIVE_HIGH,
+    SENSORS_1WIRE_ADAPTIVE_HOLD = CONFIG_NODE_SENSORS_1WIRE_ADAPTIVE_HOLD,
+    SENSORS_1WIRE_READ_RETRIES = CONFIG_NODE_SENSORS_1WIRE_READ_RETRIES,
+    SENSORS_1WIRE_TASK_STACK = 3584
 };
 
+/** DS18B20 power-on reset value, returned when conversion did not happen. */
+static const float SENSORS_1WIRE_DS18B20_POR_VALUE = 85.0f;
+
+#if CONFIG_NODE_SENSORS_1WIRE_POLICY_ADAPTIVE
+#define SENSORS_1WIRE_DEFAULT_POLICY NODE_SENSORS_1WIRE_ADAPTIVE
+#else
+#define SENSORS_1WIRE_DEFAULT_POLICY CONFIG_NODE_SENSORS_1WIRE_RESOLUTION
+#endif
+
+/** Fast change threshold, degrees per sample. */
+#define SENSORS_1WIRE_ADAPTIVE_DELTA (CONFIG_NODE_SENSORS_1WIRE_ADAPTIVE_DELTA / 100.0f)
+
+/** Change keeping the full sample rate, degrees per sample. */
+#define SENSORS_1WIRE_PERIOD_DELTA (CONFIG_NODE_SENSORS_1WIRE_PERIOD_DELTA / 100.0f)
+
 /**
  * Sensor structure specific for 1-wire.
 */
@@ -25,6 +52,13 @@ typedef struct sensors_1wire
 {
     node_sensor_t generic;          /**< Generic sensor descriptor. */
     OneWireBus_ROMCode rom_code;    /**< Device ROM code. */
+    DS18B20_Info info;              /**< Driver state, current resolution. */
+    node_sensors_1wire_stats_t *stats; /**< Statistics, kept across rediscovery. */
+    int policy;                     /**< Configured policy, NODE_SENSORS_1WIRE_DEFAULT if none. */
+    bool fast;                      /**< Adaptive: temperature is changing fast. */
+    bool has_last;                  /**< Adaptive: last is valid. */
+    uint32_t stable;                /**< Adaptive: samples since last fast change. */
+    float last;                     /**< Adaptive: last reading. */
 } sensors_1wire_t;
 
 static const char *TAG = "1wire";
@@ -32,6 +66,8 @@ static const char *TAG = "1wire";
 static OneWireBus *owb;
 static owb_rmt_driver_info rmt_driver_info;
 
+static node_sampler_t sensors_1wire_sampler;
+
 /** number of sensors attached to the bus. */
 static int sensors_1wire_count = 0;
 
@@ -45,6 +81,189 @@ static char sensors_1wire_names[SENSORS_1WIRE_MAX_DEVICES]
 static const char* SENSORS_1WIRE_DS18B20_QUANTITY = "temperature";
 static const char* SENSORS_1WIRE_DS18B20_UNIT = "\\u00b0C";
 
+static const char *SENSORS_1WIRE_NVS_NAMESPACE = "1wire_res";
+
+/** Per-device statistics, a slot per ROM code seen since boot. */
+static node_sensors_1wire_stats_t sensors_1wire_stats[SENSORS_1WIRE_MAX_DEVICES];
+static OneWireBus_ROMCode sensors_1wire_stats_rom[SENSORS_1WIRE_MAX_DEVICES];
+static int sensors_1wire_stats_count = 0;
+
+static node_sensors_1wire_bus_stats_t sensors_1wire_bus_stats;
+
+static portMUX_TYPE sensors_1wire_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Find statistics slot of the device, allocate if it is new.
+ *
+ * @return NULL if the table is full.
+*/
+static node_sensors_1wire_stats_t *
+sensors_1wire_stats_slot(const OneWireBus_ROMCode *rom_code, const char *name)
+{
+    node_sensors_1wire_stats_t *stats = NULL;
+    portENTER_CRITICAL(&sensors_1wire_stats_lock);
+    for (int n = 0; n < sensors_1wire_stats_count; ++n)
+    {
+        if (memcmp(&sensors_1wire_stats_rom[n], rom_code, sizeof(*rom_code)) == 0)
+        {
+            stats = &sensors_1wire_stats[n];
+            break;
+        }
+    }
+    if (stats == NULL && sensors_1wire_stats_count < SENSORS_1WIRE_MAX_DEVICES)
+    {
+        sensors_1wire_stats_rom[sensors_1wire_stats_count] = *rom_code;
+        stats = &sensors_1wire_stats[sensors_1wire_stats_count++];
+        strlcpy(stats->name, name, sizeof(stats->name));
+    }
+    if (stats != NULL)
+    {
+        stats->present = true;
+    }
+    portEXIT_CRITICAL(&sensors_1wire_stats_lock);
+    return stats;
+}
+
+static const char *
+sensors_1wire_error_name(DS18B20_ERROR error)
+{
+    switch (error)
+    {
+    case DS18B20_ERROR_DEVICE:
+        return "device";
+    case DS18B20_ERROR_CRC:
+        return "crc";
+    case DS18B20_ERROR_OWB:
+        return "bus";
+    default:
+        return "unknown";
+    }
+}
+
+/**
+ * Read temperature, retry on CRC and bus errors.
+ *
+ * Power-on reset value is reported as device error, it means the
+ * device has not converted (e.g. brown-out on a long cable).
+*/
+static DS18B20_ERROR
+sensors_1wire_read_temp(sensors_1wire_t *sensor, float *value)
+{
+    uint32_t crc_errors = 0;
+    uint32_t read_errors = 0;
+    int retries = 0;
+    int64_t start = esp_timer_get_time();
+
+    DS18B20_ERROR error = ds18b20_read_temp(&sensor->info, value);
+    while (error != DS18B20_OK && retries < SENSORS_1WIRE_READ_RETRIES)
+    {
+        if (error == DS18B20_ERROR_CRC)
+        {
+            ++crc_errors;
+        }
+        else
+        {
+            ++read_errors;
+        }
+        ++retries;
+        error = ds18b20_read_temp(&sensor->info, value);
+    }
+
+    uint32_t elapsed = esp_timer_get_time() - start;
+    bool por = error == DS18B20_OK && *value == SENSORS_1WIRE_DS18B20_POR_VALUE;
+    if (por)
+    {
+        error = DS18B20_ERROR_DEVICE;
+    }
+
+    node_sensors_1wire_stats_t *stats = sensor->stats;
+    if (stats != NULL)
+    {
+        portENTER_CRITICAL(&sensors_1wire_stats_lock);
+        ++stats->reads;
+        stats->crc_errors += crc_errors + (error == DS18B20_ERROR_CRC);
+        stats->read_errors += read_errors + (error != DS18B20_OK && error != DS18B20_ERROR_CRC && !por);
+        stats->retries += retries;
+        stats->failures += error != DS18B20_OK;
+        stats->por_values += por;
+        stats->read_us += elapsed;
+        if (elapsed > stats->max_read_us)
+        {
+            stats->max_read_us = elapsed;
+        }
+        portEXIT_CRITICAL(&sensors_1wire_stats_lock);
+    }
+    return error;
+}
+
+/**
+ * Diagnostics provider: bus and per-device statistics.
+*/
+static void
+sensors_1wire_diag(node_diag_emit_t emit)
+{
+    char name[NODE_DIAG_MAX_NAME_LEN];
+    char data[NODE_DIAG_MAX_DATA_LEN];
+
+    node_sensors_1wire_bus_stats_t bus;
+    node_sensors_1wire_get_bus_stats(&bus);
+    int64_t elapsed = esp_timer_get_time() - bus.since_us;
+    snprintf(data,
+             sizeof(data),
+             "{\"cycles\":%" PRIu32 ",\"failed\":%" PRIu32 ",\"disc\":%" PRIu32
+             ",\"util\":%" PRIu32 ",\"conv_us\":%" PRIu32 ",\"max_us\":%" PRIu32 "}",
+             bus.cycles,
+             bus.failed_cycles,
+             bus.discoveries,
+             bus.since_us && elapsed > 0 ? (uint32_t)(bus.busy_us * 1000 / elapsed) : 0,
+             bus.cycles ? (uint32_t)(bus.conversion_us / bus.cycles) : 0,
+             bus.max_cycle_us);
+    emit("1wire/bus", data);
+
+    node_sensors_1wire_stats_t stats;
+    for (int n = 0; node_sensors_1wire_get_stats(n, &stats); ++n)
+    {
+        snprintf(name, sizeof(name), "1wire/%s", stats.name);
+        snprintf(data,
+                 sizeof(data),
+                 "{\"present\":%s,\"reads\":%" PRIu32 ",\"crc\":%" PRIu32 ",\"err\":%" PRIu32
+                 ",\"retry\":%" PRIu32 ",\"fail\":%" PRIu32 ",\"por\":%" PRIu32
+                 ",\"avg_us\":%" PRIu32 ",\"max_us\":%" PRIu32 "}",
+                 stats.present ? "true" : "false",
+                 stats.reads,
+                 stats.crc_errors,
+                 stats.read_errors,
+                 stats.retries,
+                 stats.failures,
+                 stats.por_values,
+                 stats.reads ? (uint32_t)(stats.read_us / stats.reads) : 0,
+                 stats.max_read_us);
+        emit(name, data);
+    }
+}
+
+bool
+node_sensors_1wire_get_stats(int index, node_sensors_1wire_stats_t *stats)
+{
+    bool found = false;
+    portENTER_CRITICAL(&sensors_1wire_stats_lock);
+    if (index >= 0 && index < sensors_1wire_stats_count)
+    {
+        *stats = sensors_1wire_stats[index];
+        found = true;
+    }
+    portEXIT_CRITICAL(&sensors_1wire_stats_lock);
+    return found;
+}
+
+void
+node_sensors_1wire_get_bus_stats(node_sensors_1wire_bus_stats_t *stats)
+{
+    portENTER_CRITICAL(&sensors_1wire_stats_lock);
+    *stats = sensors_1wire_bus_stats;
+    portEXIT_CRITICAL(&sensors_1wire_stats_lock);
+}
+
 
 void
 sensors_1wire_bus_init()
@@ -61,6 +280,111 @@ sensors_1wire_bus_init()
     owb_use_crc(owb, true); // enable CRC check for ROM code
 }
 
+/**
+ * NVS key of a device, hex serial number (ROM code without family and CRC).
+*/
+static void
+sensors_1wire_nvs_key(const OneWireBus_ROMCode *rom_code, char *key, size_t size)
+{
+    int len = 0;
+    for (int n = sizeof(rom_code->fields.serial_number) - 1; n >= 0 && len < size; --n)
+    {
+        len += snprintf(key + len, size - len, "%02x", rom_code->fields.serial_number[n]);
+    }
+}
+
+/**
+ * Load per-sensor policy from NVS.
+*/
+static int
+sensors_1wire_load_policy(const OneWireBus_ROMCode *rom_code)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    sensors_1wire_nvs_key(rom_code, key, sizeof(key));
+
+    int8_t policy = NODE_SENSORS_1WIRE_DEFAULT;
+    nvs_handle_t nvs;
+    if (nvs_open(SENSORS_1WIRE_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK)
+    {
+        nvs_get_i8(nvs, key, &policy);
+        nvs_close(nvs);
+    }
+    return policy;
+}
+
+static bool
+sensors_1wire_store_policy(const OneWireBus_ROMCode *rom_code, int policy)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    sensors_1wire_nvs_key(rom_code, key, sizeof(key));
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SENSORS_1WIRE_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+    {
+        return false;
+    }
+
+    if (policy == NODE_SENSORS_1WIRE_DEFAULT)
+    {
+        err = nvs_erase_key(nvs, key);
+        if (err == ESP_ERR_NVS_NOT_FOUND)
+        {
+            err = ESP_OK;
+        }
+    }
+    else
+    {
+        err = nvs_set_i8(nvs, key, policy);
+    }
+
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err == ESP_OK;
+}
+
+/**
+ * Resolution for the next conversion.
+ *
+ * Adaptive sensors use high resolution while temperature changes fast
+ * and fall back to low resolution after a number of stable samples.
+*/
+static DS18B20_RESOLUTION
+sensors_1wire_target_resolution(const sensors_1wire_t *sensor)
+{
+    int policy = sensor->policy == NODE_SENSORS_1WIRE_DEFAULT
+                 ? SENSORS_1WIRE_DEFAULT_POLICY
+                 : sensor->policy;
+
+    if (policy == NODE_SENSORS_1WIRE_ADAPTIVE)
+    {
+        return sensor->fast ? SENSORS_1WIRE_ADAPTIVE_HIGH : SENSORS_1WIRE_ADAPTIVE_LOW;
+    }
+    return policy;
+}
+
+/**
+ * Track rate of change for adaptive resolution.
+*/
+static void
+sensors_1wire_adapt(sensors_1wire_t *sensor, float value)
+{
+    if (sensor->has_last && fabsf(value - sensor->last) >= SENSORS_1WIRE_ADAPTIVE_DELTA)
+    {
+        sensor->fast = true;
+        sensor->stable = 0;
+    }
+    else if (sensor->fast && ++sensor->stable >= SENSORS_1WIRE_ADAPTIVE_HOLD)
+    {
+        sensor->fast = false;
+    }
+    sensor->last = value;
+    sensor->has_last = true;
+}
+
 bool
 sensors_1wire_reset()
 {
@@ -76,12 +400,36 @@ sensors_1wire_reset()
 
     node_sensors_unlock();
 
+    portENTER_CRITICAL(&sensors_1wire_stats_lock);
+    for (int n = 0; n < sensors_1wire_stats_count; ++n)
+    {
+        sensors_1wire_stats[n].present = false;
+    }
+    ++sensors_1wire_bus_stats.discoveries;
+    portEXIT_CRITICAL(&sensors_1wire_stats_lock);
+
     sensors_1wire_count = 0;
     bzero(sensors_1wire, sizeof(sensors_1wire));
     bzero(sensors_1wire_names, sizeof(sensors_1wire_names));
     return true;
 }
 
+void
+sensors_1wire_enum_devices(sensors_1wire_device_cb_t cb)
+{
+    while (!node_sensors_lock())
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    for (int n = 0; n < sensors_1wire_count; ++n)
+    {
+        cb(n, sensors_1wire[n].rom_code.bytes);
+    }
+
+    node_sensors_unlock();
+}
+
 bool
 sensors_1wire_add_to_list()
 {
@@ -122,6 +470,16 @@ bool sensors_1wire_find_devices()
         {
             sensors_1wire[sensors_1wire_count].generic.quantity = SENSORS_1WIRE_DS18B20_QUANTITY;
             sensors_1wire[sensors_1wire_count].generic.unit = SENSORS_1WIRE_DS18B20_UNIT;
+
+            sensors_1wire_t *sensor = &sensors_1wire[sensors_1wire_count];
+            ds18b20_init(&sensor->info, owb, sensor->rom_code); // associate with bus and device
+            ds18b20_use_crc(&sensor->info, true); // enable CRC check on all reads
+            sensor->policy = sensors_1wire_load_policy(&sensor->rom_code);
+            sensor->stats = sensors_1wire_stats_slot(&sensor->rom_code, sensor->generic.name);
+            ds18b20_set_resolution(&sensor->info, sensors_1wire_target_resolution(sensor));
+            node_sensor_rate_init(&sensor->generic, SENSORS_1WIRE_SAMPLE_PERIOD_MS, SENSORS_1WIRE_PERIOD_DELTA);
+
+            node_trace_1wire_device(sensors_1wire_count, search_state.rom_code.bytes);
             ++sensors_1wire_count;
         }
         else
@@ -148,23 +506,45 @@ sensors_1wire_DS18B20_read()
         return false;
     }
 
-    DS18B20_Info devices[SENSORS_1WIRE_MAX_DEVICES];
-    bzero(devices, sizeof(devices));
+    // Only devices due for a reading are switched and read, the slowest
+    // of them determines the conversion delay of the whole bus
+    uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+    bool due[SENSORS_1WIRE_MAX_DEVICES] = {0};
+    const DS18B20_Info *slowest = NULL;
     for (int n = 0; n < sensors_1wire_count; ++n)
     {
-        DS18B20_Info* sensor = devices + n;
-        ds18b20_init(sensor, owb, sensors_1wire[n].rom_code); // associate with bus and device
-        ds18b20_use_crc(sensor, true); // enable CRC check on all reads
-        ds18b20_set_resolution(sensor, SENSORS_1WIRE_DS18B20_RESOLUTION);
+        due[n] = node_sensor_rate_due(&sensors_1wire[n].generic, now_ms);
+        if (!due[n])
+        {
+            continue;
+        }
+
+        DS18B20_Info *info = &sensors_1wire[n].info;
+        DS18B20_RESOLUTION resolution = sensors_1wire_target_resolution(&sensors_1wire[n]);
+        if (resolution != info->resolution && !ds18b20_set_resolution(info, resolution))
+        {
+            ESP_LOGW(TAG, "Cannot set %d bit resolution of %s", resolution, sensors_1wire[n].generic.name);
+        }
+
+        if (slowest == NULL || info->resolution > slowest->resolution)
+        {
+            slowest = info;
+        }
     }
 
     node_sensors_unlock();
 
-    ds18b20_convert_all(owb);
+    node_sampler_record(&sensors_1wire_sampler);
+    if (slowest == NULL)
+    {
+        // Nothing is due, the bus stays idle this period
+        return true;
+    }
 
-    // In this application all devices use the same resolution,
-    // so use the first device to determine the delay
-    ds18b20_wait_for_conversion(&devices[0]);
+    int64_t cycle_start = esp_timer_get_time();
+    ds18b20_convert_all(owb);
+    ds18b20_wait_for_conversion(slowest);
+    int64_t conversion_end = esp_timer_get_time();
 
     // Read the results immediately after conversion otherwise it may fail
     // (using printf before reading may take too long)
@@ -173,43 +553,131 @@ sensors_1wire_DS18B20_read()
 
     for (int i = 0; i < sensors_1wire_count; ++i)
     {
-        errors[i] = ds18b20_read_temp(&devices[i], &readings[i]);
+        if (due[i])
+        {
+            errors[i] = sensors_1wire_read_temp(&sensors_1wire[i], &readings[i]);
+        }
     }
+    int64_t cycle_end = esp_timer_get_time();
 
     // Print results in a separate loop, after all have been read
     int errors_count = 0;
     for (int i = 0; i < sensors_1wire_count; ++i)
     {
+        if (!due[i])
+        {
+            continue;
+        }
+
+        node_trace_1wire_temp(i, errors[i], readings[i]);
         if (errors[i] == DS18B20_OK)
         {
-            node_mqtt_send_sensor_value(
-                sensors_1wire[i].generic.name,
-                sensors_1wire[i].generic.quantity,
-                sensors_1wire[i].generic.unit,
-                readings[i]
-            );
+            sensors_1wire_adapt(&sensors_1wire[i], readings[i]);
+            node_sensor_rate_update(&sensors_1wire[i].generic, readings[i], now_ms);
+            node_sensor_set_failure(&sensors_1wire[i].generic, NULL);
+            node_sensor_publish(&sensors_1wire[i].generic, readings[i], conversion_end);
         }
         else
         {
             ++errors_count;
+            node_sensor_set_failure(&sensors_1wire[i].generic, sensors_1wire_error_name(errors[i]));
         }
     }
 
+    uint32_t cycle_us = cycle_end - cycle_start;
+    portENTER_CRITICAL(&sensors_1wire_stats_lock);
+    node_sensors_1wire_bus_stats_t *bus = &sensors_1wire_bus_stats;
+    if (bus->since_us == 0)
+    {
+        bus->since_us = cycle_start;
+    }
+    ++bus->cycles;
+    bus->failed_cycles += errors_count != 0;
+    bus->busy_us += cycle_us;
+    bus->conversion_us += conversion_end - cycle_start;
+    if (cycle_us > bus->max_cycle_us)
+    {
+        bus->max_cycle_us = cycle_us;
+    }
+    portEXIT_CRITICAL(&sensors_1wire_stats_lock);
+
     return errors_count == 0;
 }
 
+bool
+node_sensors_1wire_get_info(int index, node_sensors_1wire_info_t *info)
+{
+    if (!node_sensors_lock())
+    {
+        return false;
+    }
+
+    bool found = index >= 0 && index < sensors_1wire_count;
+    if (found)
+    {
+        const sensors_1wire_t *sensor = &sensors_1wire[index];
+        strlcpy(info->name, sensor->generic.name, sizeof(info->name));
+        info->policy = sensor->policy;
+        info->resolution = sensor->info.resolution;
+    }
+
+    node_sensors_unlock();
+    return found;
+}
+
+bool
+node_sensors_1wire_set_policy(const char *name, int policy)
+{
+    if (policy != NODE_SENSORS_1WIRE_DEFAULT
+        && policy != NODE_SENSORS_1WIRE_ADAPTIVE
+        && (policy < DS18B20_RESOLUTION_9_BIT || policy > DS18B20_RESOLUTION_12_BIT))
+    {
+        return false;
+    }
+
+    if (!node_sensors_lock())
+    {
+        return false;
+    }
+
+    sensors_1wire_t *sensor = NULL;
+    for (int n = 0; n < sensors_1wire_count; ++n)
+    {
+        if (strcmp(sensors_1wire[n].generic.name, name) == 0)
+        {
+            sensor = &sensors_1wire[n];
+            break;
+        }
+    }
+
+    // Sampler task applies new resolution before the next conversion
+    bool stored = sensor != NULL && sensors_1wire_store_policy(&sensor->rom_code, policy);
+    if (stored)
+    {
+        sensor->policy = policy;
+        sensor->fast = false;
+        sensor->stable = 0;
+    }
+
+    node_sensors_unlock();
+    return stored;
+}
+
 
 void sensors_1wire_task()
 {
   sensors_1wire_bus_init();  
+  node_diag_register(&sensors_1wire_diag);
+  node_sampler_register(&sensors_1wire_sampler, "1wire", SENSORS_1WIRE_SAMPLE_PERIOD_MS);
   
+  /* Sampling does not depend on the network: rules, control loop and
+     history keep running while the broker is not reachable. */
   while(true)
   {
+    /* Sampling grid restarts after device discovery,
+       then stays fixed regardless of conversion time. */
     TickType_t last_wake_time = xTaskGetTickCount();
-    while(!node_network_ready_wait(1000))
-    {
-      /* MQTT not ready */
-    }
+    node_sampler_restart(&sensors_1wire_sampler);
 
     while(!sensors_1wire_find_devices())
     {
@@ -224,7 +692,10 @@ void sensors_1wire_task()
   }
 }
 
+static StackType_t sensors_1wire_stack[SENSORS_1WIRE_TASK_STACK];
+
 void sensors_1wire_start()
 {
-    xTaskCreate(&sensors_1wire_task, "1wire_task", 8192, NULL, 5, NULL);
+    node_task_start(NODE_TASK_1WIRE, &sensors_1wire_task, NULL,
+                    sensors_1wire_stack, sizeof(sensors_1wire_stack));
 }
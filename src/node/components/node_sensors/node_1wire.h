@@ -1,3 +1,28 @@
 #pragma once
 
+#include <stdint.h>
+#include "driver/gpio.h"
+
+enum sensors_1wire_const
+{
+    SENSORS_1WIRE_GPIO = GPIO_NUM_21    /**< Bus pin, not available to other outputs */
+};
+
 void sensors_1wire_start();
+
+/**
+ * Callback receiving a discovered device.
+ *
+ * @index       device index, channel of its trace records
+ * @rom_code    1-wire ROM code
+*/
+typedef void (*sensors_1wire_device_cb_t)(uint8_t index, const uint8_t rom_code[8]);
+
+/**
+ * Pass each discovered DS18B20 to the callback, under sensors lock.
+ *
+ * Lets a trace started after discovery declare the devices its readings
+ * refer to.
+*/
+void
+sensors_1wire_enum_devices(sensors_1wire_device_cb_t cb);
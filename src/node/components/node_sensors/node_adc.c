@@ -1,14 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
 #include "driver/adc.h"
 #include "esp_adc_cal.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "node_adc.h"
+#include "node_moisture.h"
 #include "node_network.h"
 #include "node_sensors_private.h"
+#include "node_tasks.h"
+#include "node_trace.h"
 
 //ADC Channels
 #define ADC1_EXAMPLE_CHAN0          ADC1_CHANNEL_0
@@ -19,11 +24,23 @@
 //ADC Calibration
 #define ADC_EXAMPLE_CALI_SCHEME     ESP_ADC_CAL_VAL_EFUSE_VREF
 
+enum sensors_adc_const_internal
+{
+    SENSORS_ADC_SAMPLE_PERIOD_MS = 1000,
+    SENSORS_ADC_TASK_STACK = 3072
+};
+
+/** Moisture change keeping the full rate, %. */
+#define SENSORS_ADC_PERIOD_DELTA (CONFIG_NODE_SENSORS_ADC_PERIOD_DELTA / 100.0f)
+
 static const char *TAG = "ADC";
 
 typedef struct sensor_adc
 {
     node_sensor_t generic;          /**< Generic sensor descriptor. */
+    adc1_channel_t channel;         /**< ADC1 channel. */
+    sensors_moisture_cal_t cal;     /**< Probe calibration points. */
+    uint16_t lut[SENSORS_MOISTURE_LUT_SIZE]; /**< Raw counts to moisture, 0.01 %. */
 } sensor_adc_t;
 
 static sensor_adc_t sensors_adc[] = 
@@ -33,10 +50,18 @@ static sensor_adc_t sensors_adc[] =
             .name = "ADC_1_0",
             .quantity = "moisture",
             .unit = "%"
-        }
+        },
+        .channel = ADC1_EXAMPLE_CHAN0
     }
 };
 
+static const char *SENSORS_ADC_NVS_NAMESPACE = "adc_cal";
+
+/** Set by node_sensors_adc_set_calibration(), sampler task rebuilds tables. */
+static volatile bool sensors_adc_cal_changed = false;
+/** Tables are built, set once by the sampler task. */
+static volatile bool sensors_adc_calibrated = false;
+
 static esp_adc_cal_characteristics_t adc1_chars;
 
 static bool adc_calibration_init(void)
@@ -59,51 +84,218 @@ static bool adc_calibration_init(void)
     return cali_enable;
 }
 
-static float vWet = 1700.0;
-static float vDry = 2800.0;
+static uint32_t sensors_adc_voltage(uint32_t raw, void *arg)
+{
+    return esp_adc_cal_raw_to_voltage(raw, (esp_adc_cal_characteristics_t *)arg);
+}
 
-static TaskHandle_t adc_task = NULL;
+static void sensors_adc_nvs_key(adc1_channel_t channel, char *key, size_t size)
+{
+    snprintf(key, size, "ch%d", channel);
+}
+
+/**
+ * Load calibration points from NVS, use defaults if there are none.
+*/
+static void sensors_adc_cal_load(sensor_adc_t *sensor)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    sensors_adc_nvs_key(sensor->channel, key, sizeof(key));
+
+    nvs_handle_t nvs;
+    size_t size = sizeof(sensor->cal.points);
+    bool loaded = false;
+    if (nvs_open(SENSORS_ADC_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK)
+    {
+        if (nvs_get_blob(nvs, key, sensor->cal.points, &size) == ESP_OK)
+        {
+            sensor->cal.count = size / sizeof(sensor->cal.points[0]);
+            loaded = sensors_moisture_cal_valid(&sensor->cal);
+        }
+        nvs_close(nvs);
+    }
+
+    if (!loaded)
+    {
+        sensors_moisture_cal_default(&sensor->cal);
+    }
+    ESP_LOGI(TAG, "%s: %u calibration points%s",
+             sensor->generic.name,
+             sensor->cal.count,
+             loaded ? "" : " (default)");
+}
+
+/**
+ * Load calibration points and rebuild conversion tables.
+*/
+static void sensors_adc_calibrate()
+{
+    sensors_adc_cal_changed = false;
+    for (int n = 0; n < sizeof(sensors_adc) / sizeof(sensors_adc[0]); ++n)
+    {
+        sensors_adc_cal_load(&sensors_adc[n]);
+        sensors_moisture_build_lut(&sensors_adc[n].cal,
+                                   &sensors_adc_voltage,
+                                   &adc1_chars,
+                                   sensors_adc[n].lut);
+        node_trace_adc_lut(sensors_adc[n].channel, sensors_adc[n].lut);
+    }
+    sensors_adc_calibrated = true;
+}
+
+void
+sensors_adc_enum_luts(sensors_adc_lut_cb_t cb)
+{
+    if (!sensors_adc_calibrated)
+    {
+        return;
+    }
+
+    for (int n = 0; n < sizeof(sensors_adc) / sizeof(sensors_adc[0]); ++n)
+    {
+        cb(sensors_adc[n].channel, sensors_adc[n].lut);
+    }
+}
+
+static sensor_adc_t *sensors_adc_find(int channel)
+{
+    for (int n = 0; n < sizeof(sensors_adc) / sizeof(sensors_adc[0]); ++n)
+    {
+        if (sensors_adc[n].channel == channel)
+        {
+            return &sensors_adc[n];
+        }
+    }
+    return NULL;
+}
+
+bool
+node_sensors_adc_get_calibration(int channel,
+                                 node_sensors_cal_point_t *points,
+                                 int *count)
+{
+    sensor_adc_t *sensor = sensors_adc_find(channel);
+    if (sensor == NULL)
+    {
+        return false;
+    }
+
+    sensors_moisture_cal_t cal = sensor->cal;
+    memcpy(points, cal.points, cal.count * sizeof(cal.points[0]));
+    *count = cal.count;
+    return true;
+}
+
+bool
+node_sensors_adc_set_calibration(int channel,
+                                 const node_sensors_cal_point_t *points,
+                                 int count)
+{
+    if (sensors_adc_find(channel) == NULL || count < 2 || count > NODE_SENSORS_MAX_CAL_POINTS)
+    {
+        return false;
+    }
+
+    sensors_moisture_cal_t cal = { .count = count };
+    memcpy(cal.points, points, count * sizeof(points[0]));
+    if (!sensors_moisture_cal_valid(&cal))
+    {
+        return false;
+    }
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    sensors_adc_nvs_key(channel, key, sizeof(key));
+
+    nvs_handle_t nvs;
+    if (nvs_open(SENSORS_ADC_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        return false;
+    }
+    esp_err_t err = nvs_set_blob(nvs, key, cal.points, count * sizeof(cal.points[0]));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot store calibration: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    sensors_adc_cal_changed = true;
+    return true;
+}
+
+static node_sampler_t sensors_adc_sampler;
 
 void sensors_adc_task()
 {
     if (!adc_calibration_init())
     {
         ESP_LOGE(TAG, "Cannot read calibration data from eFuse. ADC disabled");
-        vTaskDelete(adc_task);
+        node_task_exit(NODE_TASK_ADC);
     }
     //ADC1 config
     ESP_ERROR_CHECK(adc1_config_width(ADC_WIDTH_BIT_DEFAULT));
     ESP_ERROR_CHECK(adc1_config_channel_atten(ADC1_EXAMPLE_CHAN0, ADC_EXAMPLE_ATTEN));
+    sensors_adc_calibrate();
 
     while (!node_sensors_lock())
     {
         vTaskDelay(pdMS_TO_TICKS(100));
     }
 
+    node_sensor_rate_init(&sensors_adc[0].generic, SENSORS_ADC_SAMPLE_PERIOD_MS, SENSORS_ADC_PERIOD_DELTA);
     node_sensor_add(&sensors_adc[0].generic);
 
     node_sensors_unlock();
 
+    node_sampler_register(&sensors_adc_sampler, "adc", SENSORS_ADC_SAMPLE_PERIOD_MS);
 
+    // Absolute schedule, loop execution time does not accumulate.
+    // Readings are taken while the network is down too.
+    TickType_t last_wake_time = xTaskGetTickCount();
     while (true)
     {
-        int adc_raw = adc1_get_raw(ADC1_EXAMPLE_CHAN0);
-        //ESP_LOGI(TAG, "raw  data: %d", adc_raw);
-        float voltage = esp_adc_cal_raw_to_voltage(adc_raw, &adc1_chars);
-        float moisture = 100.0 * (1.0-fmax(fmin((voltage - vWet) / (vDry - vWet), 1.0), 0.0));
-        //ESP_LOGI(TAG, "cali data: %5f mV, %3.1f %%", voltage, moisture);
-        node_sensor_t* sensor = &sensors_adc[0].generic;
-        node_mqtt_send_sensor_value(
-            sensor->name,
-            sensor->quantity,
-            sensor->unit,
-            moisture
-        );
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        if (sensors_adc_cal_changed)
+        {
+            sensors_adc_calibrate();
+        }
+
+        node_sampler_record(&sensors_adc_sampler);
+        sensor_adc_t *sensor = &sensors_adc[0];
+        uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+        if (node_sensor_rate_due(&sensor->generic, now_ms))
+        {
+            int adc_raw = adc1_get_raw(sensor->channel);
+            int64_t time_us = esp_timer_get_time();
+            //ESP_LOGI(TAG, "raw  data: %d", adc_raw);
+            if (node_trace_recording())
+            {
+                node_trace_adc(sensor->channel, adc_raw, esp_adc_cal_raw_to_voltage(adc_raw, &adc1_chars));
+            }
+            if (adc_raw < 0)
+            {
+                node_sensor_set_failure(&sensor->generic, "adc");
+            }
+            else
+            {
+                float moisture = (float)sensors_moisture_lookup(sensor->lut, adc_raw) / SENSORS_MOISTURE_SCALE;
+                node_sensor_set_failure(&sensor->generic, NULL);
+                node_sensor_rate_update(&sensor->generic, moisture, now_ms);
+                node_sensor_publish(&sensor->generic, moisture, time_us);
+            }
+        }
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(SENSORS_ADC_SAMPLE_PERIOD_MS));
     }
 }
 
+static StackType_t sensors_adc_stack[SENSORS_ADC_TASK_STACK];
+
 void sensors_adc_start()
 {
-    adc_task = xTaskCreate(&sensors_adc_task, "adc_task", 8192, NULL, 5, NULL);
+    node_task_start(NODE_TASK_ADC, &sensors_adc_task, NULL,
+                    sensors_adc_stack, sizeof(sensors_adc_stack));
 }
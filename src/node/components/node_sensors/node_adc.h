@@ -1,3 +1,22 @@
 #pragma once
 
+#include <stdint.h>
+
 void sensors_adc_start();
+
+/**
+ * Callback receiving a conversion table.
+ *
+ * @channel     ADC1 channel, channel of its trace records
+ * @lut         raw counts to moisture, SENSORS_MOISTURE_LUT_SIZE entries
+*/
+typedef void (*sensors_adc_lut_cb_t)(uint8_t channel, const uint16_t *lut);
+
+/**
+ * Pass conversion table of each calibrated channel to the callback.
+ *
+ * Lets a trace started after calibration record the tables its readings
+ * are converted with.
+*/
+void
+sensors_adc_enum_luts(sensors_adc_lut_cb_t cb);
\ No newline at end of file
@@ -0,0 +1,536 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "node_control.h"
+#include "node_diag.h"
+#include "node_sensors_private.h"
+#include "node_tasks.h"
+#if CONFIG_NODE_SENSORS_HW
+#include "node_1wire.h"
+#endif
+#if CONFIG_NODE_SENSORS_RULES
+#include "node_rules.h"
+#endif
+
+//LEDC output
+#define SENSORS_CONTROL_LEDC_MODE       LEDC_LOW_SPEED_MODE
+#define SENSORS_CONTROL_LEDC_TIMER      LEDC_TIMER_0
+#define SENSORS_CONTROL_LEDC_CHANNEL    LEDC_CHANNEL_0
+#define SENSORS_CONTROL_LEDC_RESOLUTION LEDC_TIMER_10_BIT
+
+enum sensors_control_const_internal
+{
+    SENSORS_CONTROL_PERIOD_MS = CONFIG_NODE_SENSORS_CONTROL_PERIOD_MS,
+    SENSORS_CONTROL_TIMEOUT_MS = CONFIG_NODE_SENSORS_CONTROL_TIMEOUT_MS,
+    SENSORS_CONTROL_DUTY_FULL = 1 << SENSORS_CONTROL_LEDC_RESOLUTION,
+    SENSORS_CONTROL_TASK_STACK = 3072
+};
+
+static const char *TAG = "control";
+
+static const char *SENSORS_CONTROL_NVS_NAMESPACE = "control";
+static const char *SENSORS_CONTROL_NVS_KEY = "config";
+
+/**
+ * Loop state shared by the loop task, sensor samplers and readers.
+*/
+typedef struct sensors_control
+{
+    node_sensors_control_config_t config;   /**< Settings */
+    const node_sensor_t *sensor;    /**< Input sensor, NULL if not present */
+    float input;            /**< Latest reading */
+    int64_t input_us;       /**< Capture time of the latest reading, 0 if none */
+    float last_input;       /**< Input of the previous iteration */
+    bool valid;             /**< Previous iteration had fresh input */
+    float output;           /**< Output duty, % */
+    float integral;         /**< Integral term, % */
+    bool changed;           /**< Settings changed, output pin to be set up */
+    bool reset;             /**< Input or output changed, integral to be reset */
+    uint32_t cycles;        /**< Loop iterations */
+    uint32_t timeouts;      /**< Iterations without fresh input */
+    uint32_t saturated;     /**< Iterations with saturated output */
+    node_hist_t jitter;     /**< Period deviation, us */
+    node_log_hist_t compute;    /**< Computation time, us */
+} sensors_control_t;
+
+static sensors_control_t control;
+static portMUX_TYPE sensors_control_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t control_task = NULL;
+
+/**
+ * Pin is driven by a sensor driver or a rule.
+*/
+static bool
+sensors_control_gpio_reserved(int gpio)
+{
+#if CONFIG_NODE_SENSORS_HW
+    if (gpio == SENSORS_1WIRE_GPIO)
+    {
+        return true;
+    }
+#endif
+#if CONFIG_NODE_SENSORS_RULES
+    if (sensors_rules_use_gpio(gpio))
+    {
+        return true;
+    }
+#endif
+    return false;
+}
+
+static bool
+sensors_control_valid(const node_sensors_control_config_t *config)
+{
+    if (strnlen(config->sensor, sizeof(config->sensor)) == sizeof(config->sensor))
+    {
+        return false;
+    }
+    if (config->sensor[0] == '\0')
+    {
+        // Loop is off, other settings are not used
+        return true;
+    }
+    return isfinite(config->setpoint)
+           && isfinite(config->kp) && config->kp >= 0
+           && isfinite(config->ki) && config->ki >= 0
+           && isfinite(config->kd) && config->kd >= 0
+           && config->gpio >= 0 && config->gpio < GPIO_NUM_MAX
+           && GPIO_IS_VALID_OUTPUT_GPIO(config->gpio)
+           && !sensors_control_gpio_reserved(config->gpio);
+}
+
+/**
+ * One step of PID.
+ *
+ * Derivative acts on the measurement.  Integral is not accumulated
+ * while the output is saturated and the error pushes it further.
+ *
+ * @config      settings
+ * @input       current input
+ * @last_input  input of the previous step
+ * @integral    integral term, updated
+ * @return output, 0 to 100 %.
+*/
+static float
+sensors_control_step(const node_sensors_control_config_t *config,
+                     float input,
+                     float last_input,
+                     float *integral)
+{
+    const float dt = SENSORS_CONTROL_PERIOD_MS / 1000.0f;
+    float error = config->setpoint - input;
+    float slope = (input - last_input) / dt;
+    if (config->reverse)
+    {
+        error = -error;
+        slope = -slope;
+    }
+
+    float accumulated = *integral + config->ki * error * dt;
+    float output = config->kp * error + accumulated - config->kd * slope;
+    if (output > 100)
+    {
+        output = 100;
+        accumulated = error > 0 ? *integral : accumulated;
+    }
+    else if (output < 0)
+    {
+        output = 0;
+        accumulated = error < 0 ? *integral : accumulated;
+    }
+    *integral = fminf(fmaxf(accumulated, 0), 100);
+    return output;
+}
+
+/**
+ * Move PWM output to the configured pin, release the old one.
+ *
+ * @gpio    current output pin, -1 if none; updated
+ * @config  settings
+*/
+static void
+sensors_control_output_setup(int *gpio, const node_sensors_control_config_t *config)
+{
+    int target = config->sensor[0] != '\0' ? config->gpio : -1;
+    if (target == *gpio)
+    {
+        return;
+    }
+
+    if (*gpio >= 0)
+    {
+        ledc_stop(SENSORS_CONTROL_LEDC_MODE, SENSORS_CONTROL_LEDC_CHANNEL, 0);
+        gpio_reset_pin(*gpio);
+    }
+    *gpio = target;
+    if (target < 0)
+    {
+        ESP_LOGI(TAG, "Loop is off");
+        return;
+    }
+
+    ledc_channel_config_t channel = {
+        .gpio_num = target,
+        .speed_mode = SENSORS_CONTROL_LEDC_MODE,
+        .channel = SENSORS_CONTROL_LEDC_CHANNEL,
+        .intr_type = LEDC_INTR_DISABLE,
+        .timer_sel = SENSORS_CONTROL_LEDC_TIMER,
+        .duty = 0,
+        .hpoint = 0
+    };
+    ESP_ERROR_CHECK(ledc_channel_config(&channel));
+    ESP_LOGI(TAG, "%s -> GPIO%d", config->sensor, target);
+}
+
+/**
+ * Compute and apply new output.
+ *
+ * @config  settings
+ * @now     start of the iteration
+ * @last_us start of the previous iteration, 0 after a pause
+*/
+static void
+sensors_control_iterate(const node_sensors_control_config_t *config,
+                        int64_t now,
+                        int64_t last_us)
+{
+    portENTER_CRITICAL(&sensors_control_lock);
+    bool fresh = control.input_us != 0
+                 && now - control.input_us <= (int64_t)SENSORS_CONTROL_TIMEOUT_MS * 1000;
+    bool was_valid = control.valid;
+    float input = control.input;
+    float last_input = was_valid ? control.last_input : input;
+    float integral = control.integral;
+    portEXIT_CRITICAL(&sensors_control_lock);
+
+    float output = 0;
+    if (fresh)
+    {
+        output = sensors_control_step(config, input, last_input, &integral);
+    }
+    else
+    {
+        integral = 0;
+    }
+    ledc_set_duty(SENSORS_CONTROL_LEDC_MODE,
+                  SENSORS_CONTROL_LEDC_CHANNEL,
+                  (uint32_t)lroundf(output * SENSORS_CONTROL_DUTY_FULL / 100));
+    ledc_update_duty(SENSORS_CONTROL_LEDC_MODE, SENSORS_CONTROL_LEDC_CHANNEL);
+    int64_t compute_us = esp_timer_get_time() - now;
+
+    portENTER_CRITICAL(&sensors_control_lock);
+    control.valid = fresh;
+    control.last_input = input;
+    control.output = output;
+    control.integral = integral;
+    control.cycles++;
+    control.timeouts += fresh ? 0 : 1;
+    control.saturated += fresh && (output <= 0 || output >= 100) ? 1 : 0;
+    if (last_us != 0)
+    {
+        node_hist_add(&control.jitter,
+                      (int32_t)(now - last_us - (int64_t)SENSORS_CONTROL_PERIOD_MS * 1000));
+    }
+    node_log_hist_add(&control.compute, (uint32_t)compute_us);
+    portEXIT_CRITICAL(&sensors_control_lock);
+
+    if (fresh != was_valid)
+    {
+        if (fresh)
+        {
+            ESP_LOGI(TAG, "Input %s is fresh, loop is running", config->sensor);
+        }
+        else
+        {
+            ESP_LOGW(TAG, "No reading of %s, output is off", config->sensor);
+        }
+    }
+}
+
+static void
+sensors_control_task(void *arg)
+{
+    ledc_timer_config_t timer = {
+        .speed_mode = SENSORS_CONTROL_LEDC_MODE,
+        .duty_resolution = SENSORS_CONTROL_LEDC_RESOLUTION,
+        .timer_num = SENSORS_CONTROL_LEDC_TIMER,
+        .freq_hz = CONFIG_NODE_SENSORS_CONTROL_PWM_FREQ_HZ,
+        .clk_cfg = LEDC_AUTO_CLK
+    };
+    ESP_ERROR_CHECK(ledc_timer_config(&timer));
+
+    int gpio = -1;
+    int64_t last_us = 0;
+    // Absolute schedule, computation time does not accumulate
+    TickType_t last_wake_time = xTaskGetTickCount();
+    while (true)
+    {
+        portENTER_CRITICAL(&sensors_control_lock);
+        node_sensors_control_config_t config = control.config;
+        bool changed = control.changed;
+        control.changed = false;
+        if (control.reset)
+        {
+            control.reset = false;
+            control.valid = false;
+            control.output = 0;
+            control.integral = 0;
+        }
+        portEXIT_CRITICAL(&sensors_control_lock);
+
+        if (changed)
+        {
+            sensors_control_output_setup(&gpio, &config);
+        }
+        if (gpio < 0)
+        {
+            // Loop is off, sleep until settings change
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            last_wake_time = xTaskGetTickCount();
+            last_us = 0;
+            continue;
+        }
+
+        int64_t now = esp_timer_get_time();
+        sensors_control_iterate(&config, now, last_us);
+        last_us = now;
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(SENSORS_CONTROL_PERIOD_MS));
+    }
+}
+
+/**
+ * Diagnostics provider: loop state and timing.
+*/
+static void
+sensors_control_diag(node_diag_emit_t emit)
+{
+    // Only the diagnostics task calls providers
+    static node_sensors_control_status_t status;
+    node_sensors_control_get_status(&status);
+    if (status.config.sensor[0] == '\0')
+    {
+        return;
+    }
+
+    char data[NODE_DIAG_MAX_DATA_LEN];
+    snprintf(data,
+             sizeof(data),
+             "{\"in\":%.2f,\"sp\":%.2f,\"out\":%.1f,\"valid\":%s,\"n\":%" PRIu32
+             ",\"timeouts\":%" PRIu32 ",\"sat\":%" PRIu32 "}",
+             status.input,
+             status.config.setpoint,
+             status.output,
+             status.valid ? "true" : "false",
+             status.cycles,
+             status.timeouts,
+             status.saturated);
+    emit("control/loop", data);
+
+    const node_hist_t *hist = &status.jitter;
+    int len = snprintf(data,
+                       sizeof(data),
+                       "{\"period\":%d,\"n\":%" PRIu32
+                       ",\"min\":%" PRId32 ",\"max\":%" PRId32 ",\"h\":[",
+                       SENSORS_CONTROL_PERIOD_MS,
+                       hist->count,
+                       hist->count ? hist->min : 0,
+                       hist->count ? hist->max : 0);
+    for (int b = 0; b < NODE_HIST_BUCKETS && len < sizeof(data); ++b)
+    {
+        len += snprintf(data + len,
+                        sizeof(data) - len,
+                        b ? ",%" PRIu32 : "%" PRIu32,
+                        hist->buckets[b]);
+    }
+    if (len < sizeof(data))
+    {
+        snprintf(data + len, sizeof(data) - len, "]}");
+    }
+    emit("control/jitter", data);
+
+    const node_log_hist_t *compute = &status.compute;
+    snprintf(data,
+             sizeof(data),
+             "{\"avg\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p99\":%" PRIu32 ",\"max\":%" PRIu32 "}",
+             compute->count ? (uint32_t)(compute->sum / compute->count) : 0,
+             node_log_hist_percentile(compute, 500),
+             node_log_hist_percentile(compute, 990),
+             compute->max);
+    emit("control/compute_us", data);
+}
+
+static StackType_t sensors_control_stack[SENSORS_CONTROL_TASK_STACK];
+
+void
+sensors_control_start()
+{
+    node_hist_init(&control.jitter, NODE_HIST_DEVIATION_BOUNDS_US);
+    node_log_hist_init(&control.compute);
+
+    nvs_handle_t nvs;
+    if (nvs_open(SENSORS_CONTROL_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK)
+    {
+        node_sensors_control_config_t config;
+        size_t size = sizeof(config);
+        if (nvs_get_blob(nvs, SENSORS_CONTROL_NVS_KEY, &config, &size) == ESP_OK)
+        {
+            if (size == sizeof(config) && sensors_control_valid(&config))
+            {
+                control.config = config;
+            }
+            else
+            {
+                ESP_LOGE(TAG, "Invalid settings in NVS");
+            }
+        }
+        nvs_close(nvs);
+    }
+    control.changed = true;
+
+    node_diag_register(&sensors_control_diag);
+    control_task = node_task_start(NODE_TASK_CONTROL, &sensors_control_task, NULL,
+                                   sensors_control_stack, sizeof(sensors_control_stack));
+}
+
+void
+sensors_control_bind(const node_sensor_t *sensor)
+{
+    portENTER_CRITICAL(&sensors_control_lock);
+    if (strcmp(sensor->name, control.config.sensor) == 0)
+    {
+        control.sensor = sensor;
+    }
+    portEXIT_CRITICAL(&sensors_control_lock);
+}
+
+void
+sensors_control_unbind(const node_sensor_t *sensor)
+{
+    portENTER_CRITICAL(&sensors_control_lock);
+    if (control.sensor == sensor)
+    {
+        control.sensor = NULL;
+    }
+    portEXIT_CRITICAL(&sensors_control_lock);
+}
+
+int
+sensors_control_gpio()
+{
+    portENTER_CRITICAL(&sensors_control_lock);
+    int gpio = control.config.sensor[0] != '\0' ? control.config.gpio : -1;
+    portEXIT_CRITICAL(&sensors_control_lock);
+    return gpio;
+}
+
+bool
+sensors_control_bound(const node_sensor_t *sensor)
+{
+    return sensor == control.sensor;
+}
+
+void
+sensors_control_input(const node_sensor_t *sensor, float value, int64_t time_us)
+{
+    // Unlocked check keeps the lock out of other sensors' path
+    if (sensor != control.sensor)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&sensors_control_lock);
+    if (sensor == control.sensor)
+    {
+        control.input = value;
+        control.input_us = time_us;
+    }
+    portEXIT_CRITICAL(&sensors_control_lock);
+}
+
+bool
+node_sensors_control_set(const node_sensors_control_config_t *config)
+{
+    if (!sensors_control_valid(config))
+    {
+        return false;
+    }
+
+    nvs_handle_t nvs;
+    if (nvs_open(SENSORS_CONTROL_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        return false;
+    }
+    esp_err_t err = nvs_set_blob(nvs, SENSORS_CONTROL_NVS_KEY, config, sizeof(*config));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot store settings: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    while (!node_sensors_lock())
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    portENTER_CRITICAL(&sensors_control_lock);
+    bool new_input = strcmp(control.config.sensor, config->sensor) != 0;
+    // Setpoint and gains changes keep the integral, so the output does not jump
+    control.reset |= new_input
+                     || control.config.gpio != config->gpio
+                     || control.config.reverse != config->reverse;
+    control.changed = true;
+    control.config = *config;
+    if (new_input)
+    {
+        control.input_us = 0;
+        control.sensor = NULL;
+        for (node_sensor_t *sensor = node_sensors_head(); sensor != NULL; sensor = sensor->next)
+        {
+            if (strcmp(sensor->name, config->sensor) == 0)
+            {
+                control.sensor = sensor;
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&sensors_control_lock);
+
+    node_sensors_unlock();
+
+    if (control_task != NULL)
+    {
+        xTaskNotifyGive(control_task);
+    }
+    return true;
+}
+
+void
+node_sensors_control_get_status(node_sensors_control_status_t *status)
+{
+    portENTER_CRITICAL(&sensors_control_lock);
+    status->config = control.config;
+    status->valid = control.valid;
+    status->input = control.input;
+    status->output = control.output;
+    status->integral = control.integral;
+    status->cycles = control.cycles;
+    status->timeouts = control.timeouts;
+    status->saturated = control.saturated;
+    status->jitter = control.jitter;
+    status->compute = control.compute;
+    portEXIT_CRITICAL(&sensors_control_lock);
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+/**
+ * PID control loop.
+ *
+ * The loop runs on its own high-priority task with a fixed period
+ * (CONFIG_NODE_SENSORS_CONTROL_PERIOD_MS), takes the latest reading of
+ * the input sensor and drives an LEDC PWM output, 0 to 100 % duty.
+ *
+ * Derivative acts on the measurement, so setpoint changes do not kick
+ * the output.  Integral is frozen while the output is saturated in the
+ * direction of the error (anti-windup).  Without fresh input the output
+ * is switched off and the integral is reset.
+ *
+ * Settings are stored in NVS (namespace "control").
+*/
+#include "node_sensors.h"
+
+/**
+ * Load settings from NVS and start the loop task.
+*/
+void
+sensors_control_start();
+
+/**
+ * Use the sensor as the loop input if its name matches the settings.
+ *
+ * Called with sensors list locked, when the sensor is added.
+*/
+void
+sensors_control_bind(const node_sensor_t *sensor);
+
+/**
+ * Stop using the sensor as the loop input.
+ *
+ * Called with sensors list locked, when the sensor is removed.
+*/
+void
+sensors_control_unbind(const node_sensor_t *sensor);
+
+/**
+ * Pass a reading to the loop, if the sensor is its input.
+ *
+ * @time_us capture time, input timeout counts from it
+*/
+void
+sensors_control_input(const node_sensor_t *sensor, float value, int64_t time_us);
+
+/**
+ * Output pin of the loop, -1 if the loop is off.
+*/
+int
+sensors_control_gpio();
+
+/**
+ * Check if the sensor is the loop input.
+ *
+ * The input is read every sampler cycle, the loop needs fresh readings.
+*/
+bool
+sensors_control_bound(const node_sensor_t *sensor);
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include <string.h>
+#include "node_moisture.h"
+
+static const node_sensors_cal_point_t sensors_moisture_default_points[] =
+{
+    { .voltage_mv = 1700, .moisture = 100 * SENSORS_MOISTURE_SCALE },
+    { .voltage_mv = 2800, .moisture = 0 }
+};
+
+void
+sensors_moisture_cal_default(sensors_moisture_cal_t *cal)
+{
+    cal->count = sizeof(sensors_moisture_default_points) / sizeof(sensors_moisture_default_points[0]);
+    memcpy(cal->points, sensors_moisture_default_points, sizeof(sensors_moisture_default_points));
+}
+
+bool
+sensors_moisture_cal_valid(const sensors_moisture_cal_t *cal)
+{
+    if (cal->count < 2 || cal->count > NODE_SENSORS_MAX_CAL_POINTS)
+    {
+        return false;
+    }
+
+    for (uint32_t n = 0; n < cal->count; ++n)
+    {
+        if (cal->points[n].moisture > 100 * SENSORS_MOISTURE_SCALE)
+        {
+            return false;
+        }
+        if (n > 0 && cal->points[n].voltage_mv <= cal->points[n - 1].voltage_mv)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t
+sensors_moisture_from_mv(const sensors_moisture_cal_t *cal, uint32_t voltage_mv)
+{
+    const node_sensors_cal_point_t *points = cal->points;
+    const uint32_t last = cal->count - 1;
+
+    if (voltage_mv <= points[0].voltage_mv)
+    {
+        return points[0].moisture;
+    }
+
+    for (uint32_t n = 0; n < last; ++n)
+    {
+        const node_sensors_cal_point_t *lo = &points[n];
+        const node_sensors_cal_point_t *hi = &points[n + 1];
+        if (voltage_mv < hi->voltage_mv)
+        {
+            int32_t dm = (int32_t)hi->moisture - lo->moisture;
+            int32_t dv = (int32_t)hi->voltage_mv - lo->voltage_mv;
+            int32_t v = (int32_t)voltage_mv - lo->voltage_mv;
+            /* Round to nearest, dm may be negative */
+            int32_t m = (2 * dm * v + (dm < 0 ? -dv : dv)) / (2 * dv);
+            return lo->moisture + m;
+        }
+    }
+    return points[last].moisture;
+}
+
+void
+sensors_moisture_build_lut(const sensors_moisture_cal_t *cal,
+                           sensors_moisture_voltage_t voltage,
+                           void *arg,
+                           uint16_t *lut)
+{
+    for (uint32_t n = 0; n < SENSORS_MOISTURE_LUT_SIZE; ++n)
+    {
+        /* Middle of the raw counts range covered by the entry */
+        uint32_t raw = (n << SENSORS_MOISTURE_LUT_SHIFT)
+                       + ((1 << SENSORS_MOISTURE_LUT_SHIFT) >> 1);
+        lut[n] = sensors_moisture_from_mv(cal, voltage(raw, arg));
+    }
+}
\ No newline at end of file
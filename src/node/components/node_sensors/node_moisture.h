@@ -0,0 +1,74 @@
+#pragma once
+/**
+ * Fixed-point moisture conversion.
+ *
+ * Calibration points map probe voltage to moisture, values between points
+ * are interpolated linearly and clamped outside.  For the ADC the mapping
+ * is precomputed into a lookup table indexed by raw counts, so a sample
+ * costs one table read.
+*/
+#include <stdint.h>
+#include "node_sensors.h"
+
+enum sensors_moisture_const
+{
+    SENSORS_MOISTURE_RAW_BITS = 12,     /**< ADC resolution. */
+    SENSORS_MOISTURE_LUT_SHIFT = 2,     /**< Raw counts per table entry, log2. */
+    SENSORS_MOISTURE_LUT_SIZE = 1 << (SENSORS_MOISTURE_RAW_BITS - SENSORS_MOISTURE_LUT_SHIFT),
+    SENSORS_MOISTURE_SCALE = 100        /**< Moisture unit is 0.01 %. */
+};
+
+/**
+ * Calibration of a moisture probe.
+*/
+typedef struct sensors_moisture_cal
+{
+    uint32_t count;     /**< Number of points, 2 or more. */
+    node_sensors_cal_point_t points[NODE_SENSORS_MAX_CAL_POINTS]; /**< Sorted by voltage. */
+} sensors_moisture_cal_t;
+
+/**
+ * Voltage of raw ADC counts, mV.
+*/
+typedef uint32_t (*sensors_moisture_voltage_t)(uint32_t raw, void *arg);
+
+/**
+ * Fill default two-point calibration (1700 mV wet, 2800 mV dry).
+*/
+void
+sensors_moisture_cal_default(sensors_moisture_cal_t *cal);
+
+/**
+ * Check that points are sorted by voltage and count is in range.
+*/
+bool
+sensors_moisture_cal_valid(const sensors_moisture_cal_t *cal);
+
+/**
+ * Convert probe voltage to moisture, 0.01 %.
+*/
+uint16_t
+sensors_moisture_from_mv(const sensors_moisture_cal_t *cal, uint32_t voltage_mv);
+
+/**
+ * Precompute moisture for each table entry.
+ *
+ * @cal     calibration points
+ * @voltage raw counts to voltage conversion
+ * @arg     argument of voltage()
+ * @lut     table of SENSORS_MOISTURE_LUT_SIZE entries
+*/
+void
+sensors_moisture_build_lut(const sensors_moisture_cal_t *cal,
+                           sensors_moisture_voltage_t voltage,
+                           void *arg,
+                           uint16_t *lut);
+
+/**
+ * Moisture of raw ADC counts, 0.01 %.
+*/
+static inline uint16_t
+sensors_moisture_lookup(const uint16_t *lut, uint32_t raw)
+{
+    return lut[(raw >> SENSORS_MOISTURE_LUT_SHIFT) & (SENSORS_MOISTURE_LUT_SIZE - 1)];
+}
\ No newline at end of file
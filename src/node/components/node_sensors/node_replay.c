@@ -0,0 +1,333 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "node_moisture.h"
+#include "node_network.h"
+#include "node_replay.h"
+#include "node_sensors_private.h"
+#include "node_tasks.h"
+#include "node_trace.h"
+
+#if CONFIG_NODE_SENSORS_REPLAY_REALTIME
+#define SENSORS_REPLAY_REALTIME true
+#else
+#define SENSORS_REPLAY_REALTIME false
+#endif
+
+enum sensors_replay_const_internal
+{
+    SENSORS_REPLAY_ROM_CODE_LEN = 8,
+    /** Lower than MQTT task, so queue is drained while replaying at full speed. */
+    SENSORS_REPLAY_FAST_PRIORITY = 1,
+    SENSORS_REPLAY_TASK_STACK = 3584
+};
+
+/**
+ * Sensor structure specific for replay.
+*/
+typedef struct sensors_replay
+{
+    node_sensor_t generic;          /**< Generic sensor descriptor. */
+    bool added;                     /**< Sensor is in the list. */
+    uint8_t rom_code[SENSORS_REPLAY_ROM_CODE_LEN];  /**< 1-wire ROM code. */
+} sensors_replay_t;
+
+/**
+ * ADC conversion table recorded in the trace.
+*/
+typedef struct sensors_replay_lut
+{
+    bool loaded;                    /**< Last part of the table is read. */
+    uint16_t lut[SENSORS_MOISTURE_LUT_SIZE]; /**< Raw counts to moisture, 0.01 %. */
+} sensors_replay_lut_t;
+
+/**
+ * Replay counters.
+*/
+typedef struct sensors_replay_stats
+{
+    uint32_t records;       /**< Records read */
+    uint32_t readings;      /**< Readings published */
+    uint32_t errors;        /**< Readings with driver error */
+    uint32_t unknown;       /**< Records of unknown type or channel */
+} sensors_replay_stats_t;
+
+static const char *TAG = "replay";
+
+static sensors_replay_t sensors_replay_1wire[NODE_TRACE_MAX_CHANNELS];
+static char sensors_replay_1wire_names[NODE_TRACE_MAX_CHANNELS][NODE_SENSORS_MAX_NAME_LEN];
+
+static sensors_replay_t sensors_replay_adc[NODE_TRACE_MAX_CHANNELS];
+static char sensors_replay_adc_names[NODE_TRACE_MAX_CHANNELS][NODE_SENSORS_MAX_NAME_LEN];
+/** Calibration of each channel as the driver applied it, NVS is not available on the host. */
+static sensors_replay_lut_t sensors_replay_adc_luts[NODE_TRACE_MAX_CHANNELS];
+
+/* Same as live drivers, so replayed topics match recorded ones. */
+static const char* SENSORS_REPLAY_DS18B20_QUANTITY = "temperature";
+static const char* SENSORS_REPLAY_DS18B20_UNIT = "\\u00b0C";
+static const char* SENSORS_REPLAY_ADC_QUANTITY = "moisture";
+static const char* SENSORS_REPLAY_ADC_UNIT = "%";
+
+static bool
+sensors_replay_add(sensors_replay_t *sensor)
+{
+    if (sensor->added)
+    {
+        return true;
+    }
+
+    while (!node_sensors_lock())
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    sensor->added = node_sensor_add(&sensor->generic);
+    node_sensors_unlock();
+    return sensor->added;
+}
+
+/**
+ * Declare 1-wire device, name is ROM code as printed by owb.
+*/
+static void
+sensors_replay_1wire_device(const node_trace_record_t *record)
+{
+    sensors_replay_t *sensor = &sensors_replay_1wire[record->channel];
+    char *name = sensors_replay_1wire_names[record->channel];
+
+    for (int n = 0; n < SENSORS_REPLAY_ROM_CODE_LEN; ++n)
+    {
+        sprintf(name + 2 * n, "%02x", record->rom_code[SENSORS_REPLAY_ROM_CODE_LEN - 1 - n]);
+    }
+    memcpy(sensor->rom_code, record->rom_code, sizeof(sensor->rom_code));
+    sensor->generic.name = name;
+    sensor->generic.quantity = SENSORS_REPLAY_DS18B20_QUANTITY;
+    sensor->generic.unit = SENSORS_REPLAY_DS18B20_UNIT;
+    sensors_replay_add(sensor);
+}
+
+static sensors_replay_t *
+sensors_replay_adc_sensor(uint8_t channel)
+{
+    sensors_replay_t *sensor = &sensors_replay_adc[channel];
+    if (!sensor->added)
+    {
+        char *name = sensors_replay_adc_names[channel];
+        snprintf(name, NODE_SENSORS_MAX_NAME_LEN, "ADC_1_%u", channel);
+        sensor->generic.name = name;
+        sensor->generic.quantity = SENSORS_REPLAY_ADC_QUANTITY;
+        sensor->generic.unit = SENSORS_REPLAY_ADC_UNIT;
+        sensors_replay_add(sensor);
+    }
+    return sensor;
+}
+
+/**
+ * Store part of ADC conversion table.
+*/
+static bool
+sensors_replay_adc_lut(const node_trace_record_t *record)
+{
+    if (record->status < 0 || record->status > SENSORS_MOISTURE_LUT_SIZE - NODE_TRACE_LUT_ENTRIES)
+    {
+        return false;
+    }
+
+    sensors_replay_lut_t *lut = &sensors_replay_adc_luts[record->channel];
+    memcpy(lut->lut + record->status, record->lut, sizeof(record->lut));
+    if (record->status == SENSORS_MOISTURE_LUT_SIZE - NODE_TRACE_LUT_ENTRIES)
+    {
+        lut->loaded = true;
+    }
+    return true;
+}
+
+/**
+ * Feed one record, readings are stamped with their time in the trace.
+*/
+static void
+sensors_replay_record(const node_trace_record_t *record,
+                      int64_t start_us,
+                      sensors_replay_stats_t *stats)
+{
+    if (record->channel >= NODE_TRACE_MAX_CHANNELS)
+    {
+        ++stats->unknown;
+        return;
+    }
+
+    int64_t time_us = start_us + (int64_t)record->time_ms * 1000;
+
+    switch (record->type)
+    {
+    case NODE_TRACE_1WIRE_DEVICE:
+        sensors_replay_1wire_device(record);
+        break;
+
+    case NODE_TRACE_1WIRE_TEMP:
+        if (!sensors_replay_1wire[record->channel].added)
+        {
+            ++stats->unknown;
+        }
+        else if (record->status != 0)
+        {
+            ++stats->errors;
+            node_sensor_set_failure(&sensors_replay_1wire[record->channel].generic, "read");
+        }
+        else
+        {
+            node_sensor_set_failure(&sensors_replay_1wire[record->channel].generic, NULL);
+            node_sensor_publish(&sensors_replay_1wire[record->channel].generic,
+                                record->temperature,
+                                time_us);
+            ++stats->readings;
+        }
+        break;
+
+    case NODE_TRACE_ADC_LUT:
+        if (!sensors_replay_adc_lut(record))
+        {
+            ++stats->unknown;
+        }
+        break;
+
+    case NODE_TRACE_ADC:
+        if (!sensors_replay_adc_luts[record->channel].loaded)
+        {
+            ++stats->unknown;
+        }
+        else if ((int32_t)record->adc.raw < 0)
+        {
+            // Driver error is recorded as negative raw counts
+            ++stats->errors;
+            node_sensor_set_failure(&sensors_replay_adc_sensor(record->channel)->generic, "adc");
+        }
+        else
+        {
+            sensors_replay_t *sensor = sensors_replay_adc_sensor(record->channel);
+            node_sensor_set_failure(&sensor->generic, NULL);
+            node_sensor_publish(&sensor->generic,
+                                (float)sensors_moisture_lookup(sensors_replay_adc_luts[record->channel].lut,
+                                                               record->adc.raw)
+                                / SENSORS_MOISTURE_SCALE,
+                                time_us);
+            ++stats->readings;
+        }
+        break;
+
+    default:
+        ++stats->unknown;
+        break;
+    }
+}
+
+static int64_t
+sensors_replay_cpu_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+sensors_replay_task()
+{
+    FILE *trace = fopen(CONFIG_NODE_SENSORS_REPLAY_FILE, "rb");
+    if (trace == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot open trace %s", CONFIG_NODE_SENSORS_REPLAY_FILE);
+        node_task_exit(NODE_TASK_REPLAY);
+    }
+
+    node_trace_header_t header;
+    if (fread(&header, sizeof(header), 1, trace) != 1
+        || header.magic != NODE_TRACE_MAGIC
+        || header.version != NODE_TRACE_VERSION
+        || header.record_size != sizeof(node_trace_record_t))
+    {
+        ESP_LOGE(TAG, "%s is not a sensor trace", CONFIG_NODE_SENSORS_REPLAY_FILE);
+        fclose(trace);
+        node_task_exit(NODE_TASK_REPLAY);
+    }
+
+    node_sensors_subscribe_network(xTaskGetCurrentTaskHandle());
+    node_sensors_wait_network();
+    node_network_reset_stats();
+
+    if (!SENSORS_REPLAY_REALTIME)
+    {
+        vTaskPrioritySet(NULL, SENSORS_REPLAY_FAST_PRIORITY);
+    }
+
+    ESP_LOGI(TAG, "Replaying %s", CONFIG_NODE_SENSORS_REPLAY_FILE);
+
+    sensors_replay_stats_t stats = {0};
+    uint32_t duration_ms = 0;
+    int64_t start_us = esp_timer_get_time();
+    int64_t start_cpu_us = sensors_replay_cpu_us();
+    TickType_t start_tick = xTaskGetTickCount();
+
+    node_trace_record_t record;
+    while (fread(&record, sizeof(record), 1, trace) == 1
+           && record.type != NODE_TRACE_END)
+    {
+        if (SENSORS_REPLAY_REALTIME)
+        {
+            TickType_t due = start_tick + pdMS_TO_TICKS(record.time_ms);
+            TickType_t now = xTaskGetTickCount();
+            if ((int32_t)(due - now) > 0)
+            {
+                vTaskDelay(due - now);
+            }
+        }
+        ++stats.records;
+        duration_ms = record.time_ms;
+        sensors_replay_record(&record, start_us, &stats);
+    }
+    fclose(trace);
+
+    int64_t cpu_us = sensors_replay_cpu_us() - start_cpu_us;
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    /* Let the last messages get published before taking MQTT counters. */
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_NODE_MQTT_BURST_MAX_LATENCY_MS));
+    node_network_burst_stats_t burst;
+    node_network_get_burst_stats(&burst);
+    node_network_alarm_stats_t alarms;
+    node_network_get_alarm_stats(&alarms);
+
+    printf("{\"bench\": \"replay\", \"trace\": \"%s\", \"realtime\": %s, \"records\": %" PRIu32
+           ", \"readings\": %" PRIu32 ", \"errors\": %" PRIu32 ", \"unknown\": %" PRIu32
+           ", \"trace_ms\": %" PRIu32 ", \"elapsed_us\": %" PRId64 ", \"cpu_us\": %" PRId64
+           ", \"published\": %" PRIu32 ", \"bursts\": %" PRIu32 ", \"dropped\": %" PRIu32
+           ", \"alarms\": %" PRIu32 ", \"alarm_p99_us\": %" PRIu32 "}\n",
+           CONFIG_NODE_SENSORS_REPLAY_FILE,
+           SENSORS_REPLAY_REALTIME ? "true" : "false",
+           stats.records,
+           stats.readings,
+           stats.errors,
+           stats.unknown,
+           duration_ms,
+           elapsed_us,
+           cpu_us,
+           burst.messages,
+           burst.bursts,
+           burst.dropped,
+           alarms.queued,
+           node_log_hist_percentile(&alarms.hist, 990));
+    fflush(stdout);
+
+    node_task_exit(NODE_TASK_REPLAY);
+}
+
+static StackType_t sensors_replay_stack[SENSORS_REPLAY_TASK_STACK];
+
+void sensors_replay_start()
+{
+    node_task_start(NODE_TASK_REPLAY, &sensors_replay_task, NULL,
+                    sensors_replay_stack, sizeof(sensors_replay_stack));
+}
\ No newline at end of file
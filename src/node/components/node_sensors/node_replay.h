@@ -0,0 +1,3 @@
+#pragma once
+
+void sensors_replay_start();
\ No newline at end of file
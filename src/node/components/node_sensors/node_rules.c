@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+#include "node_network.h"
+#include "node_rules.h"
+#include "node_sensors_private.h"
+#if CONFIG_NODE_SENSORS_HW
+#include "node_1wire.h"
+#endif
+#if CONFIG_NODE_SENSORS_CONTROL
+#include "node_control.h"
+#endif
+
+static const char *TAG = "rules";
+
+static const char *SENSORS_RULES_NVS_NAMESPACE = "rules";
+static const char *SENSORS_RULES_NVS_KEY = "rules";
+
+/**
+ * Compiled rule.
+*/
+typedef struct sensors_rule
+{
+    char sensor[NODE_SENSORS_MAX_NAME_LEN]; /**< Sensor name */
+    float on;           /**< Threshold to turn on */
+    float off;          /**< Threshold to turn off */
+    bool above;         /**< On above the threshold, otherwise below */
+    bool invert;        /**< Output is low while on */
+    bool last;          /**< Last rule of the sensor */
+    bool active;        /**< Rule is on */
+    bool published;     /**< State has been published since the rule was set */
+    uint8_t gpio;       /**< Output */
+    uint8_t number;     /**< Position in the definition */
+    uint32_t triggers;  /**< Transitions to on */
+} sensors_rule_t;
+
+static sensors_rule_t sensors_rules[NODE_SENSORS_MAX_RULES];
+static int sensors_rules_count = 0;
+static char sensors_rules_text[NODE_SENSORS_RULES_MAX_LEN];
+
+/** Guards rules against replacement during evaluation. */
+static portMUX_TYPE sensors_rules_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Pin is driven by a sensor driver or the control loop.
+*/
+static bool
+sensors_rules_gpio_reserved(int gpio)
+{
+#if CONFIG_NODE_SENSORS_HW
+    if (gpio == SENSORS_1WIRE_GPIO)
+    {
+        return true;
+    }
+#endif
+#if CONFIG_NODE_SENSORS_CONTROL
+    if (gpio == sensors_control_gpio())
+    {
+        return true;
+    }
+#endif
+    return false;
+}
+
+/**
+ * Parse one rule, advance the pointer past it.
+*/
+static bool
+sensors_rules_parse_one(const char **text, sensors_rule_t *rule)
+{
+    const char *p = *text;
+    size_t len = strcspn(p, "<>");
+    if (len == 0 || len >= sizeof(rule->sensor) || p[len] == '\0')
+    {
+        return false;
+    }
+    memset(rule, 0, sizeof(*rule));
+    memcpy(rule->sensor, p, len);
+    rule->above = p[len] == '>';
+    p += len + 1;
+
+    char *end;
+    rule->on = strtof(p, &end);
+    if (end == p)
+    {
+        return false;
+    }
+    p = end;
+
+    float hysteresis = 0;
+    if (*p == '~')
+    {
+        hysteresis = strtof(++p, &end);
+        if (end == p || hysteresis < 0)
+        {
+            return false;
+        }
+        p = end;
+    }
+    rule->off = rule->above ? rule->on - hysteresis : rule->on + hysteresis;
+
+    if (*p++ != ':')
+    {
+        return false;
+    }
+    long gpio = strtol(p, &end, 10);
+    if (end == p
+        || gpio < 0 || gpio >= GPIO_NUM_MAX
+        || !GPIO_IS_VALID_OUTPUT_GPIO(gpio)
+        || sensors_rules_gpio_reserved(gpio))
+    {
+        return false;
+    }
+    rule->gpio = gpio;
+    p = end;
+
+    if (*p == '!')
+    {
+        rule->invert = true;
+        ++p;
+    }
+    if (*p == ';')
+    {
+        ++p;
+    }
+    else if (*p != '\0')
+    {
+        return false;
+    }
+
+    *text = p;
+    return true;
+}
+
+/**
+ * Compile definition into sorted array.
+ *
+ * @return number of rules, -1 on syntax error.
+*/
+static int
+sensors_rules_compile(const char *text, sensors_rule_t *rules)
+{
+    int count = 0;
+    while (*text != '\0')
+    {
+        if (count == NODE_SENSORS_MAX_RULES || !sensors_rules_parse_one(&text, &rules[count]))
+        {
+            return -1;
+        }
+        rules[count].number = count;
+        ++count;
+    }
+
+    // Group rules of a sensor, keep definition order within the group
+    for (int i = 1; i < count; ++i)
+    {
+        sensors_rule_t rule = rules[i];
+        int j = i;
+        for (; j > 0 && strcmp(rules[j - 1].sensor, rule.sensor) > 0; --j)
+        {
+            rules[j] = rules[j - 1];
+        }
+        rules[j] = rule;
+    }
+    for (int n = 0; n < count; ++n)
+    {
+        rules[n].last = n + 1 == count || strcmp(rules[n].sensor, rules[n + 1].sensor) != 0;
+    }
+    return count;
+}
+
+static void
+sensors_rules_output(const sensors_rule_t *rule)
+{
+    gpio_set_level(rule->gpio, rule->active != rule->invert);
+}
+
+/**
+ * Find the first rule of the sensor.  Called with rules locked.
+*/
+static void
+sensors_rules_bind_locked(node_sensor_t *sensor)
+{
+    sensor->rules = 0;
+    for (int n = 0; n < sensors_rules_count; ++n)
+    {
+        if (strcmp(sensors_rules[n].sensor, sensor->name) == 0)
+        {
+            sensor->rules = n + 1;
+            return;
+        }
+    }
+}
+
+void
+sensors_rules_bind(node_sensor_t *sensor)
+{
+    portENTER_CRITICAL(&sensors_rules_lock);
+    sensors_rules_bind_locked(sensor);
+    portEXIT_CRITICAL(&sensors_rules_lock);
+}
+
+/**
+ * Check if one of the rules drives the pin.
+*/
+static bool
+sensors_rules_find_gpio(const sensors_rule_t *rules, int count, uint8_t gpio)
+{
+    for (int n = 0; n < count; ++n)
+    {
+        if (rules[n].gpio == gpio)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Replace active rules, release outputs no longer used.
+ *
+ * Outputs kept by the new rules are not touched, so relays do not
+ * glitch; they are driven on the next reading of the sensor.
+*/
+static bool
+sensors_rules_apply(const sensors_rule_t *rules, int count)
+{
+    while (!node_sensors_lock())
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    for (int n = 0; n < sensors_rules_count; ++n)
+    {
+        uint8_t gpio = sensors_rules[n].gpio;
+        if (!sensors_rules_find_gpio(rules, count, gpio)
+            && !sensors_rules_find_gpio(sensors_rules, n, gpio))
+        {
+            gpio_reset_pin(gpio);
+        }
+    }
+    for (int n = 0; n < count; ++n)
+    {
+        uint8_t gpio = rules[n].gpio;
+        if (!sensors_rules_find_gpio(sensors_rules, sensors_rules_count, gpio)
+            && !sensors_rules_find_gpio(rules, n, gpio))
+        {
+            gpio_reset_pin(gpio);
+            gpio_set_direction(gpio, GPIO_MODE_OUTPUT);
+            sensors_rules_output(&rules[n]);
+        }
+    }
+
+    portENTER_CRITICAL(&sensors_rules_lock);
+    memcpy(sensors_rules, rules, count * sizeof(rules[0]));
+    sensors_rules_count = count;
+    for (node_sensor_t *sensor = node_sensors_head(); sensor != NULL; sensor = sensor->next)
+    {
+        sensors_rules_bind_locked(sensor);
+    }
+    portEXIT_CRITICAL(&sensors_rules_lock);
+
+    node_sensors_unlock();
+    ESP_LOGI(TAG, "%d rules", count);
+    return true;
+}
+
+bool
+sensors_rules_use_gpio(int gpio)
+{
+    bool used = false;
+
+    portENTER_CRITICAL(&sensors_rules_lock);
+    for (int n = 0; n < sensors_rules_count && !used; ++n)
+    {
+        used = sensors_rules[n].gpio == gpio;
+    }
+    portEXIT_CRITICAL(&sensors_rules_lock);
+
+    return used;
+}
+
+void
+sensors_rules_init()
+{
+    nvs_handle_t nvs;
+    size_t size = sizeof(sensors_rules_text);
+    if (nvs_open(SENSORS_RULES_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+    {
+        return;
+    }
+    esp_err_t err = nvs_get_str(nvs, SENSORS_RULES_NVS_KEY, sensors_rules_text, &size);
+    nvs_close(nvs);
+    if (err != ESP_OK)
+    {
+        sensors_rules_text[0] = '\0';
+        return;
+    }
+
+    static sensors_rule_t rules[NODE_SENSORS_MAX_RULES];
+    int count = sensors_rules_compile(sensors_rules_text, rules);
+    if (count < 0)
+    {
+        ESP_LOGE(TAG, "Invalid rules in NVS: %s", sensors_rules_text);
+        sensors_rules_text[0] = '\0';
+        return;
+    }
+    sensors_rules_apply(rules, count);
+}
+
+void
+sensors_rules_evaluate(const node_sensor_t *sensor, float value)
+{
+    // Unlocked check keeps the lock out of sensors without rules
+    if (sensor->rules == 0)
+    {
+        return;
+    }
+
+    // Transitions are published after the lock is released
+    uint8_t changed[NODE_SENSORS_MAX_RULES];
+    bool active[NODE_SENSORS_MAX_RULES];
+    int count = 0;
+
+    portENTER_CRITICAL(&sensors_rules_lock);
+    // Index is read under the lock, rules may have been replaced since the check
+    for (int n = sensor->rules - 1; n >= 0 && n < sensors_rules_count; ++n)
+    {
+        sensors_rule_t *rule = &sensors_rules[n];
+        if (strcmp(rule->sensor, sensor->name) != 0)
+        {
+            break;
+        }
+        bool on = rule->active
+                  ? (rule->above ? value >= rule->off : value <= rule->off)
+                  : (rule->above ? value > rule->on : value < rule->on);
+        // The first state is published too, it replaces retained state
+        // left by the previous rules or before reboot
+        if (on != rule->active || !rule->published)
+        {
+            rule->triggers += on && !rule->active ? 1 : 0;
+            rule->active = on;
+            rule->published = true;
+            sensors_rules_output(rule);
+            changed[count] = rule->number;
+            active[count] = on;
+            ++count;
+        }
+        if (rule->last)
+        {
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&sensors_rules_lock);
+
+    for (int n = 0; n < count; ++n)
+    {
+        mqtt_message_t msg;
+        snprintf(msg.topic, sizeof(msg.topic), "nodes/node1/event/rule/%u", changed[n]);
+        snprintf(msg.data, sizeof(msg.data),
+                 "{\"rule\": %u, \"sensor\": \"%s\", \"value\": %.2f, \"active\": %s}",
+                 changed[n], sensor->name, value, active[n] ? "true" : "false");
+        // Retained, the broker keeps the current state of each rule
+        node_network_send_alarm(&msg, true);
+    }
+}
+
+bool
+node_sensors_rules_set(const char *definition)
+{
+    static sensors_rule_t rules[NODE_SENSORS_MAX_RULES];
+    if (strlen(definition) >= sizeof(sensors_rules_text))
+    {
+        return false;
+    }
+    int count = sensors_rules_compile(definition, rules);
+    if (count < 0)
+    {
+        return false;
+    }
+
+    nvs_handle_t nvs;
+    if (nvs_open(SENSORS_RULES_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        return false;
+    }
+    esp_err_t err = count > 0
+                    ? nvs_set_str(nvs, SENSORS_RULES_NVS_KEY, definition)
+                    : nvs_erase_key(nvs, SENSORS_RULES_NVS_KEY);
+    if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot store rules: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    strlcpy(sensors_rules_text, definition, sizeof(sensors_rules_text));
+    return sensors_rules_apply(rules, count);
+}
+
+const char *
+node_sensors_rules_get()
+{
+    return sensors_rules_text;
+}
+
+bool
+node_sensors_rule_get_info(int index, node_sensors_rule_info_t *info)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&sensors_rules_lock);
+    for (int n = 0; n < sensors_rules_count; ++n)
+    {
+        const sensors_rule_t *rule = &sensors_rules[n];
+        if (rule->number == index)
+        {
+            strlcpy(info->sensor, rule->sensor, sizeof(info->sensor));
+            info->above = rule->above;
+            info->on = rule->on;
+            info->off = rule->off;
+            info->gpio = rule->gpio;
+            info->invert = rule->invert;
+            info->active = rule->active;
+            info->triggers = rule->triggers;
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&sensors_rules_lock);
+
+    return found;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+/**
+ * Local threshold rules.
+ *
+ * Rules are defined by a compact text stored in NVS:
+ *
+ *   <sensor><op><threshold>[~<hysteresis>]:<gpio>[!][;...]
+ *
+ * e.g. "28ff641e8216c3a1>28.5~0.5:17;ADC_1_0<30~5:18!".  Rule with '>'
+ * turns on above the threshold and off below threshold - hysteresis,
+ * '<' is symmetric.  Output is driven high while the rule is on, low
+ * with '!'.  Each transition is published as a retained alarm on
+ * nodes/node1/event/rule/<n>, n is the rule position in the definition.
+ *
+ * Definition is compiled into a flat array sorted by sensor, and each
+ * sensor descriptor keeps the index of its first rule, so evaluation
+ * costs a couple of comparisons per rule of the sensor.
+*/
+#include "node_sensors.h"
+
+/**
+ * Load rules from NVS.
+*/
+void
+sensors_rules_init();
+
+/**
+ * Set index of the first rule of the sensor.
+ *
+ * Called with sensors list locked, when the sensor is added.
+*/
+void
+sensors_rules_bind(node_sensor_t *sensor);
+
+/**
+ * Check if a rule drives the pin.
+*/
+bool
+sensors_rules_use_gpio(int gpio);
+
+/**
+ * Evaluate rules of the sensor, drive outputs and publish transitions.
+*/
+void
+sensors_rules_evaluate(const node_sensor_t *sensor, float value);
\ No newline at end of file
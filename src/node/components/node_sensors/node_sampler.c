@@ -0,0 +1,198 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "node_control.h"
+#include "node_diag.h"
+#include "node_sensors_private.h"
+
+enum node_sampler_const_internal
+{
+    SAMPLER_RATE_MAX_PERIOD_MS = CONFIG_NODE_SENSORS_ADAPTIVE_MAX_PERIOD_S * 1000,
+    SAMPLER_RATE_HOLD = CONFIG_NODE_SENSORS_ADAPTIVE_HOLD,
+    /** Weight of the new change in the smoothed activity is 1/4. */
+    SAMPLER_RATE_SMOOTHING = 4
+};
+
+static node_sampler_t* samplers[NODE_SENSORS_MAX_SAMPLERS];
+static int samplers_count = 0;
+static portMUX_TYPE samplers_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Diagnostics provider: sampling interval histograms.
+*/
+static void
+node_sampler_diag(node_diag_emit_t emit)
+{
+    for (int n = 0; n < NODE_SENSORS_MAX_SAMPLERS; ++n)
+    {
+        node_sampler_stats_t stats;
+        if (!node_sampler_get_stats(n, &stats))
+        {
+            break;
+        }
+
+        char name[NODE_DIAG_MAX_NAME_LEN];
+        char data[NODE_DIAG_MAX_DATA_LEN];
+        snprintf(name, sizeof(name), "sampling/%s", stats.name);
+        int len = snprintf(data,
+                           sizeof(data),
+                           "{\"period\":%" PRIu32 ",\"n\":%" PRIu32
+                           ",\"min\":%" PRId32 ",\"max\":%" PRId32 ",\"h\":[",
+                           stats.period_ms,
+                           stats.hist.count,
+                           stats.hist.count ? stats.hist.min : 0,
+                           stats.hist.count ? stats.hist.max : 0);
+        for (int b = 0; b < NODE_HIST_BUCKETS && len < sizeof(data); ++b)
+        {
+            len += snprintf(data + len,
+                            sizeof(data) - len,
+                            b ? ",%" PRIu32 : "%" PRIu32,
+                            stats.hist.buckets[b]);
+        }
+        if (len < sizeof(data))
+        {
+            snprintf(data + len, sizeof(data) - len, "]}");
+        }
+        emit(name, data);
+    }
+}
+
+bool
+node_sampler_register(node_sampler_t *sampler,
+                      const char *name,
+                      uint32_t period_ms)
+{
+    sampler->stats.name = name;
+    sampler->stats.period_ms = period_ms;
+    sampler->last_us = 0;
+    node_hist_init(&sampler->stats.hist, NODE_HIST_DEVIATION_BOUNDS_US);
+
+    bool registered = false;
+    bool first = false;
+    portENTER_CRITICAL(&samplers_lock);
+    if (samplers_count < NODE_SENSORS_MAX_SAMPLERS)
+    {
+        first = samplers_count == 0;
+        samplers[samplers_count++] = sampler;
+        registered = true;
+    }
+    portEXIT_CRITICAL(&samplers_lock);
+
+    if (first)
+    {
+        node_diag_register(&node_sampler_diag);
+    }
+    return registered;
+}
+
+void
+node_sampler_record(node_sampler_t *sampler)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&samplers_lock);
+    if (sampler->last_us != 0)
+    {
+        int64_t interval = now - sampler->last_us;
+        node_hist_add(&sampler->stats.hist,
+                      (int32_t)(interval - (int64_t)sampler->stats.period_ms * 1000));
+    }
+    sampler->last_us = now;
+    portEXIT_CRITICAL(&samplers_lock);
+}
+
+void
+node_sampler_restart(node_sampler_t *sampler)
+{
+    portENTER_CRITICAL(&samplers_lock);
+    sampler->last_us = 0;
+    portEXIT_CRITICAL(&samplers_lock);
+}
+
+bool
+node_sampler_get_stats(int index, node_sampler_stats_t *stats)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&samplers_lock);
+    if (index >= 0 && index < samplers_count)
+    {
+        *stats = samplers[index]->stats;
+        found = true;
+    }
+    portEXIT_CRITICAL(&samplers_lock);
+
+    return found;
+}
+
+void
+node_sensor_rate_init(node_sensor_t *sensor, uint32_t period_ms, float delta)
+{
+    node_sensor_rate_t *rate = &sensor->rate;
+    memset(rate, 0, sizeof(*rate));
+    rate->delta = delta;
+    rate->base_ms = period_ms;
+}
+
+bool
+node_sensor_rate_due(node_sensor_t *sensor, uint32_t now_ms)
+{
+    node_sensor_rate_t *rate = &sensor->rate;
+    // Wake-ups are quantized to ticks, half a cycle early is on time
+    bool due = rate->delta <= 0
+               || rate->period_ms == 0
+               || (int32_t)(now_ms + rate->base_ms / 2 - rate->due_ms) >= 0;
+#if CONFIG_NODE_SENSORS_CONTROL
+    due = due || sensors_control_bound(sensor);
+#endif
+    if (!due)
+    {
+        ++rate->skipped;
+    }
+    return due;
+}
+
+void
+node_sensor_rate_update(node_sensor_t *sensor, float value, uint32_t now_ms)
+{
+    node_sensor_rate_t *rate = &sensor->rate;
+    ++rate->readings;
+    if (rate->period_ms == 0)
+    {
+        rate->period_ms = rate->base_ms;
+    }
+    else if (rate->delta > 0)
+    {
+        float change = fabsf(value - rate->last);
+        rate->activity += (change - rate->activity) / SAMPLER_RATE_SMOOTHING;
+        if (change >= rate->delta)
+        {
+            // Moving again, back to the full rate at once
+            rate->period_ms = rate->base_ms;
+            rate->activity = change;
+            rate->quiet = 0;
+        }
+        else if (rate->activity < rate->delta / 4)
+        {
+            // Doubled period still keeps change per reading below delta/2
+            if (++rate->quiet >= SAMPLER_RATE_HOLD)
+            {
+                uint32_t period_ms = rate->period_ms * 2;
+                uint32_t max_ms = SAMPLER_RATE_MAX_PERIOD_MS > rate->base_ms
+                                  ? SAMPLER_RATE_MAX_PERIOD_MS
+                                  : rate->base_ms;
+                rate->period_ms = period_ms < max_ms ? period_ms : max_ms;
+                rate->quiet = 0;
+            }
+        }
+        else
+        {
+            rate->quiet = 0;
+        }
+    }
+    rate->last = value;
+    rate->due_ms = now_ms + rate->period_ms;
+}
\ No newline at end of file
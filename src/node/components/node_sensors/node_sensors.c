@@ -1,14 +1,33 @@
 #include <assert.h>
 #include <stdio.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "node_history.h"
+#include "node_network.h"
 #include "node_sensors.h"
+#include "node_sensors_private.h"
+#if CONFIG_NODE_SENSORS_HW
 #include "node_1wire.h"
 #include "node_adc.h"
-
-static node_sensor_t* sensors_head = NULL;
-static node_sensor_t* sensors_tail = NULL;
+#endif
+#if CONFIG_NODE_SENSORS_SIM
+#include "node_sim.h"
+#endif
+#if CONFIG_NODE_SENSORS_REPLAY
+#include "node_replay.h"
+#endif
+#if CONFIG_NODE_SENSORS_RULES
+#include "node_rules.h"
+#endif
+#if CONFIG_NODE_SENSORS_CONTROL
+#include "node_control.h"
+#endif
+#include "node_trace.h"
+
+static node_sensors_list_t sensors_list = { NULL, NULL };
 
 static SemaphoreHandle_t sensors_lock;
 static StaticSemaphore_t sensors_mutex;
@@ -25,8 +44,25 @@ node_sensors_start()
     sensors_lock = xSemaphoreCreateMutexStatic(&sensors_mutex);
     assert(sensors_lock != NULL);
 
+#if CONFIG_NODE_SENSORS_TRACE
+    node_trace_init();
+#endif
+#if CONFIG_NODE_SENSORS_RULES
+    sensors_rules_init();
+#endif
+#if CONFIG_NODE_SENSORS_CONTROL
+    sensors_control_start();
+#endif
+#if CONFIG_NODE_SENSORS_HW
     sensors_1wire_start();
     sensors_adc_start();
+#endif
+#if CONFIG_NODE_SENSORS_SIM
+    sensors_sim_start();
+#endif
+#if CONFIG_NODE_SENSORS_REPLAY
+    sensors_replay_start();
+#endif
 }
 
 
@@ -44,12 +80,57 @@ node_sensors_unlock()
     xSemaphoreGive(sensors_lock);
 }
 
+static void
+node_sensors_network_cb(node_network_state_t state, void *arg)
+{
+    xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+void
+node_sensors_subscribe_network(TaskHandle_t task)
+{
+    node_network_subscribe(&node_sensors_network_cb, task);
+}
+
+void
+node_sensors_wait_network()
+{
+    while (!node_network_is_ready())
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+void
+node_sensor_publish(const node_sensor_t *sensor, float value, int64_t time_us)
+{
+#if CONFIG_NODE_SENSORS_RULES
+    // Local reaction first, it does not wait for the network
+    sensors_rules_evaluate(sensor, value);
+#endif
+#if CONFIG_NODE_SENSORS_CONTROL
+    sensors_control_input(sensor, value, time_us);
+#endif
+#if CONFIG_NODE_HISTORY
+    // History keeps readings taken while the broker is not reachable
+    node_history_record(sensor->name, time_us, value);
+#endif
+    if (node_network_is_ready())
+    {
+        node_mqtt_send_sensor_value(sensor->name,
+                                    sensor->quantity,
+                                    sensor->unit,
+                                    value,
+                                    time_us);
+    }
+}
+
 const node_sensor_t *
 node_sensor_enum_start()
 {
     if (node_sensors_lock())
     {
-        return sensors_head;
+        return sensors_list.head;
     }
     return NULL;
 }
@@ -61,41 +142,45 @@ node_sensor_enum_finish()
 }
 
 bool
-node_sensor_add(node_sensor_t * sensor)
+node_sensors_list_add(node_sensors_list_t *list, node_sensor_t *sensor)
 {
     sensor->next = NULL;
 
-    if (sensors_head == NULL)
+    if (list->head == NULL)
     {
-        sensors_head = sensor;
+        list->head = sensor;
     }
     else
     {
-        sensors_tail->next = sensor;
+        list->tail->next = sensor;
     }
 
-    sensors_tail = sensor;
+    list->tail = sensor;
     return true;
 }
 
 
 bool
-node_sensor_remove(node_sensor_t * sensor)
+node_sensors_list_remove(node_sensors_list_t *list, node_sensor_t *sensor)
 {
-    if (sensors_head == NULL)
+    if (list->head == NULL)
     {
         /* Empty sensor list. */
         return false;
     }
 
-    if (sensors_head == sensor)
+    if (list->head == sensor)
     {   /* Special case - found ar head. */
-        sensors_head = sensor->next;
+        list->head = sensor->next;
+        if (list->tail == sensor)
+        {
+            list->tail = NULL;
+        }
         sensor->next = NULL;
         return true;
     }
 
-    node_sensor_t * prev = sensors_head;
+    node_sensor_t * prev = list->head;
     while (prev != NULL && prev->next != sensor)
     {
         prev = prev->next;
@@ -109,6 +194,60 @@ node_sensor_remove(node_sensor_t * sensor)
 
     /* At this point prev->next == sensor */
     prev->next = sensor->next;
+    if (list->tail == sensor)
+    {
+        list->tail = prev;
+    }
     sensor->next = NULL;
     return true;
 }
+
+void
+node_sensor_set_failure(node_sensor_t *sensor, const char *error)
+{
+    bool failed = error != NULL;
+    if (failed == sensor->failed)
+    {
+        return;
+    }
+    sensor->failed = failed;
+
+    mqtt_message_t msg;
+    snprintf(msg.topic, sizeof(msg.topic), "nodes/node1/event/sensor/%s", sensor->name);
+    snprintf(msg.data,
+             sizeof(msg.data),
+             "{\"sensor\": \"%s\", \"failed\": %s, \"error\": \"%s\"}",
+             sensor->name,
+             failed ? "true" : "false",
+             failed ? error : "");
+    node_network_send_alarm(&msg, false);
+}
+
+
+node_sensor_t *
+node_sensors_head()
+{
+    return sensors_list.head;
+}
+
+bool
+node_sensor_add(node_sensor_t * sensor)
+{
+#if CONFIG_NODE_SENSORS_RULES
+    sensors_rules_bind(sensor);
+#endif
+#if CONFIG_NODE_SENSORS_CONTROL
+    sensors_control_bind(sensor);
+#endif
+    return node_sensors_list_add(&sensors_list, sensor);
+}
+
+
+bool
+node_sensor_remove(node_sensor_t * sensor)
+{
+#if CONFIG_NODE_SENSORS_CONTROL
+    sensors_control_unbind(sensor);
+#endif
+    return node_sensors_list_remove(&sensors_list, sensor);
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+/**
+ * Microbenchmarks of the sensor registry.
+ *
+ * Cases run on a private list, so the registry used by sampler tasks is
+ * neither locked nor modified.
+*/
+#include <stdio.h>
+#include "node_bench.h"
+#include "node_sensors_private.h"
+
+enum sensors_bench_const_internal
+{
+    SENSORS_BENCH_LIST_LENGTH = 16
+};
+
+static node_sensor_t bench_sensors[SENSORS_BENCH_LIST_LENGTH + 1];
+static node_sensors_list_t bench_list;
+
+static void sensors_bench_setup(void)
+{
+    bench_list.head = NULL;
+    bench_list.tail = NULL;
+    for (int n = 0; n < SENSORS_BENCH_LIST_LENGTH; ++n)
+    {
+        node_sensors_list_add(&bench_list, &bench_sensors[n]);
+    }
+}
+
+/**
+ * Append one sensor to the full list and remove it, walking the list.
+*/
+static void sensors_bench_add_remove_tail(uint32_t n)
+{
+    node_sensor_t *sensor = &bench_sensors[SENSORS_BENCH_LIST_LENGTH];
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        node_sensors_list_add(&bench_list, sensor);
+        node_sensors_list_remove(&bench_list, sensor);
+        NODE_BENCH_CLOBBER();
+    }
+}
+
+/**
+ * Remove the head of the list and append it back.
+*/
+static void sensors_bench_remove_add_head(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        node_sensor_t *sensor = bench_list.head;
+        node_sensors_list_remove(&bench_list, sensor);
+        node_sensors_list_add(&bench_list, sensor);
+        NODE_BENCH_CLOBBER();
+    }
+}
+
+static const node_bench_case_t sensors_bench_cases[] =
+{
+    {
+        .name = "sensors.add_remove_tail",
+        .iterations = 1000,
+        .setup = &sensors_bench_setup,
+        .run = &sensors_bench_add_remove_tail
+    },
+    {
+        .name = "sensors.remove_add_head",
+        .iterations = 1000,
+        .setup = &sensors_bench_setup,
+        .run = &sensors_bench_remove_add_head
+    }
+};
+
+void node_sensors_bench_register()
+{
+    for (int n = 0; n < sizeof(sensors_bench_cases) / sizeof(sensors_bench_cases[0]); ++n)
+    {
+        node_bench_register(&sensors_bench_cases[n]);
+    }
+}
\ No newline at end of file
@@ -4,6 +4,8 @@
  * 
  * All functions should be called after sensors_start().
 */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "node_sensors.h"
 
 /**
@@ -21,6 +23,35 @@ node_sensors_lock();
 void
 node_sensors_unlock();
 
+/**
+ * Singly linked list of sensors.
+*/
+typedef struct node_sensors_list
+{
+    node_sensor_t *head;    /**< First sensor, NULL if empty. */
+    node_sensor_t *tail;    /**< Last sensor, NULL if empty. */
+} node_sensors_list_t;
+
+/**
+ * Append the sensor to the list.
+*/
+bool
+node_sensors_list_add(node_sensors_list_t *list, node_sensor_t *sensor);
+
+/**
+ * Remove the sensor from the list.
+*/
+bool
+node_sensors_list_remove(node_sensors_list_t *list, node_sensor_t *sensor);
+
+/**
+ * First sensor of the list, NULL if empty.
+ *
+ * Caller is responsible for locking and unlocking.
+*/
+node_sensor_t *
+node_sensors_head();
+
 /**
  * Add the sensor to the list.
  * 
@@ -36,3 +67,104 @@ node_sensor_add(node_sensor_t * sensor);
 */
 bool
 node_sensor_remove(node_sensor_t * sensor);
+
+/**
+ * Publish sensor reading.
+ *
+ * All drivers pass their readings through this function.  Rules,
+ * control loop and history get every reading, the broker only those
+ * taken while the network is ready.
+ *
+ * @time_us capture time, esp_timer_get_time() taken at conversion
+*/
+void
+node_sensor_publish(const node_sensor_t *sensor, float value, int64_t time_us);
+
+/**
+ * Report result of reading the sensor.
+ *
+ * Failure and recovery are published as alarms on
+ * nodes/node1/event/sensor/<name>, repeated failures are not.
+ *
+ * @error   short failure description, NULL if reading succeeded
+*/
+void
+node_sensor_set_failure(node_sensor_t *sensor, const char *error);
+
+/**
+ * Subscribe sampler task to network state changes.
+ *
+ * The task gets notification on each transition.
+*/
+void
+node_sensors_subscribe_network(TaskHandle_t task);
+
+/**
+ * Block calling task until network is ready.
+ *
+ * The task must be subscribed with node_sensors_subscribe_network().
+ * It sleeps on notification, no periodic wake-ups.
+*/
+void
+node_sensors_wait_network();
+
+/**
+ * Sampler task descriptor.
+*/
+typedef struct node_sampler
+{
+    node_sampler_stats_t stats; /**< Sampling statistics. */
+    int64_t last_us;            /**< Time of the last sample, 0 if none. */
+} node_sampler_t;
+
+/**
+ * Register the sampler for statistics reporting.
+*/
+bool
+node_sampler_register(node_sampler_t *sampler,
+                      const char *name,
+                      uint32_t period_ms);
+
+/**
+ * Record the moment of taking a sample.
+*/
+void
+node_sampler_record(node_sampler_t *sampler);
+
+/**
+ * Restart sampling after a pause.
+ *
+ * Next sample does not produce interval, so pauses (e.g. waiting for
+ * network or device discovery) are not counted as jitter.
+*/
+void
+node_sampler_restart(node_sampler_t *sampler);
+
+
+/**
+ * Set up adaptive sample period of the sensor.
+ *
+ * @period_ms   sampler period, the sensor is never read more often
+ * @delta       change between readings that keeps the full rate,
+ *              0 reads the sensor every sampler cycle
+*/
+void
+node_sensor_rate_init(node_sensor_t *sensor, uint32_t period_ms, float delta);
+
+/**
+ * Check if the sensor should be read in this sampler cycle.
+ *
+ * @now_ms  tick time, ms
+*/
+bool
+node_sensor_rate_due(node_sensor_t *sensor, uint32_t now_ms);
+
+/**
+ * Adapt sample period to the new reading.
+ *
+ * Period drops to the sampler period as soon as the reading changes by
+ * delta, and doubles after CONFIG_NODE_SENSORS_ADAPTIVE_HOLD readings
+ * changing by less than a quarter of it.
+*/
+void
+node_sensor_rate_update(node_sensor_t *sensor, float value, uint32_t now_ms);
\ No newline at end of file
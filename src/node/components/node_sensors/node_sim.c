@@ -0,0 +1,178 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "node_network.h"
+#include "node_sensors_private.h"
+#include "node_sim.h"
+#include "node_tasks.h"
+
+enum sensors_sim_const_internal
+{
+    SENSORS_SIM_COUNT = CONFIG_NODE_SENSORS_SIM_COUNT,
+    SENSORS_SIM_SAMPLE_PERIOD_MS = CONFIG_NODE_SENSORS_SIM_PERIOD_MS,
+    SENSORS_SIM_WAVE_PERIOD_MS = CONFIG_NODE_SENSORS_SIM_WAVE_PERIOD_S * 1000,
+    SENSORS_SIM_TASK_STACK = 3072
+};
+
+/** Change keeping the full rate, 0 for fixed period. */
+#define SENSORS_SIM_PERIOD_DELTA (CONFIG_NODE_SENSORS_SIM_PERIOD_DELTA / 100.0f)
+
+/**
+ * Waveforms of simulated sensors.
+*/
+typedef enum sensors_sim_waveform
+{
+    SENSORS_SIM_SINE,
+    SENSORS_SIM_RAMP,
+    SENSORS_SIM_SQUARE,
+    SENSORS_SIM_NOISE,
+    SENSORS_SIM_WAVEFORMS
+} sensors_sim_waveform_t;
+
+#if CONFIG_NODE_SENSORS_SIM_SINE
+#define SENSORS_SIM_WAVEFORM(n) SENSORS_SIM_SINE
+#elif CONFIG_NODE_SENSORS_SIM_RAMP
+#define SENSORS_SIM_WAVEFORM(n) SENSORS_SIM_RAMP
+#elif CONFIG_NODE_SENSORS_SIM_SQUARE
+#define SENSORS_SIM_WAVEFORM(n) SENSORS_SIM_SQUARE
+#elif CONFIG_NODE_SENSORS_SIM_NOISE
+#define SENSORS_SIM_WAVEFORM(n) SENSORS_SIM_NOISE
+#else
+#define SENSORS_SIM_WAVEFORM(n) ((sensors_sim_waveform_t)((n) % SENSORS_SIM_WAVEFORMS))
+#endif
+
+/**
+ * Sensor structure specific for simulation.
+*/
+typedef struct sensors_sim
+{
+    node_sensor_t generic;          /**< Generic sensor descriptor. */
+    sensors_sim_waveform_t waveform;/**< Produced waveform. */
+    float offset;                   /**< Mean value. */
+    float amplitude;                /**< Waveform amplitude. */
+    uint32_t phase_ms;              /**< Waveform phase shift. */
+    uint32_t noise;                 /**< Noise generator state. */
+} sensors_sim_t;
+
+static const char *TAG = "sim";
+
+static sensors_sim_t sensors_sim[SENSORS_SIM_COUNT];
+
+static char sensors_sim_names[SENSORS_SIM_COUNT][NODE_SENSORS_MAX_NAME_LEN];
+
+static node_sampler_t sensors_sim_sampler;
+
+static const char* SENSORS_SIM_QUANTITY = "simulated";
+static const char* SENSORS_SIM_UNIT = "";
+
+/**
+ * Uniform noise in [-1, 1), xorshift32 generator.
+*/
+static float sensors_sim_noise(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (float)x / 2147483648.0f - 1.0f;
+}
+
+static float sensors_sim_value(sensors_sim_t *sensor, uint32_t time_ms)
+{
+    float phase = (float)((time_ms + sensor->phase_ms) % SENSORS_SIM_WAVE_PERIOD_MS)
+                  / SENSORS_SIM_WAVE_PERIOD_MS;
+    float wave = 0.0f;
+
+    switch (sensor->waveform)
+    {
+    case SENSORS_SIM_SINE:
+        wave = sinf(2.0f * (float)M_PI * phase);
+        break;
+    case SENSORS_SIM_RAMP:
+        wave = 2.0f * phase - 1.0f;
+        break;
+    case SENSORS_SIM_SQUARE:
+        wave = phase < 0.5f ? 1.0f : -1.0f;
+        break;
+    default:
+        wave = sensors_sim_noise(&sensor->noise);
+        break;
+    }
+
+    return sensor->offset + sensor->amplitude * wave;
+}
+
+static void sensors_sim_init()
+{
+    _Static_assert(offsetof(struct sensors_sim, generic) == 0,
+                   "sensors_sim_t is not properly aligned");
+
+    for (int n = 0; n < SENSORS_SIM_COUNT; ++n)
+    {
+        snprintf(sensors_sim_names[n], sizeof(sensors_sim_names[n]), "sim_%02d", n);
+        sensors_sim[n].generic.name = sensors_sim_names[n];
+        sensors_sim[n].generic.quantity = SENSORS_SIM_QUANTITY;
+        sensors_sim[n].generic.unit = SENSORS_SIM_UNIT;
+        sensors_sim[n].waveform = SENSORS_SIM_WAVEFORM(n);
+        sensors_sim[n].offset = 20.0f;
+        sensors_sim[n].amplitude = 5.0f;
+        sensors_sim[n].phase_ms = (uint32_t)n * SENSORS_SIM_WAVE_PERIOD_MS / SENSORS_SIM_COUNT;
+        sensors_sim[n].noise = 2463534242u + n;
+        node_sensor_rate_init(&sensors_sim[n].generic,
+                              SENSORS_SIM_SAMPLE_PERIOD_MS,
+                              SENSORS_SIM_PERIOD_DELTA);
+    }
+
+    while (!node_sensors_lock())
+    {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+
+    for (int n = 0; n < SENSORS_SIM_COUNT; ++n)
+    {
+        node_sensor_add(&sensors_sim[n].generic);
+    }
+
+    node_sensors_unlock();
+}
+
+static void sensors_sim_task(void *arg)
+{
+    sensors_sim_init();
+    node_sampler_register(&sensors_sim_sampler, "sim", SENSORS_SIM_SAMPLE_PERIOD_MS);
+
+    ESP_LOGI(TAG, "%d sensors, %d ms period",
+             SENSORS_SIM_COUNT,
+             SENSORS_SIM_SAMPLE_PERIOD_MS);
+
+    TickType_t last_wake_time = xTaskGetTickCount();
+    while (true)
+    {
+        node_sampler_record(&sensors_sim_sampler);
+        uint32_t time_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+        for (int n = 0; n < SENSORS_SIM_COUNT; ++n)
+        {
+            if (node_sensor_rate_due(&sensors_sim[n].generic, time_ms))
+            {
+                float value = sensors_sim_value(&sensors_sim[n], time_ms);
+                node_sensor_rate_update(&sensors_sim[n].generic, value, time_ms);
+                node_sensor_publish(&sensors_sim[n].generic, value, esp_timer_get_time());
+            }
+        }
+
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(SENSORS_SIM_SAMPLE_PERIOD_MS));
+    }
+}
+
+static StackType_t sensors_sim_stack[SENSORS_SIM_TASK_STACK];
+
+void sensors_sim_start()
+{
+    node_task_start(NODE_TASK_SIM, &sensors_sim_task, NULL,
+                    sensors_sim_stack, sizeof(sensors_sim_stack));
+}
\ No newline at end of file
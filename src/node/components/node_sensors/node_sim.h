@@ -0,0 +1,3 @@
+#pragma once
+
+void sensors_sim_start();
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "node_1wire.h"
+#include "node_adc.h"
+#include "node_moisture.h"
+#include "node_sensors.h"
+#include "node_trace.h"
+
+enum node_trace_const_internal
+{
+    NODE_TRACE_PARTITION_SUBTYPE = 0x40,
+    NODE_TRACE_BLOCK_RECORDS = 32
+};
+
+static const char *TAG = "trace";
+
+static const char *NODE_TRACE_PARTITION_LABEL = "trace";
+
+static const esp_partition_t *trace_partition;
+
+static SemaphoreHandle_t trace_lock;
+static StaticSemaphore_t trace_mutex;
+
+/** Fast path check, records are dropped without locking when false. */
+static volatile bool trace_recording = false;
+
+static int64_t trace_start_us;
+
+/** Bytes written to the partition. */
+static uint32_t trace_offset = 0;
+
+/** Records waiting to be written, block is flushed when full. */
+static node_trace_record_t trace_block[NODE_TRACE_BLOCK_RECORDS];
+static uint32_t trace_block_count = 0;
+
+static uint32_t trace_records = 0;
+static uint32_t trace_dropped = 0;
+
+
+void
+node_trace_init()
+{
+    trace_lock = xSemaphoreCreateMutexStatic(&trace_mutex);
+    trace_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                               NODE_TRACE_PARTITION_SUBTYPE,
+                                               NODE_TRACE_PARTITION_LABEL);
+    if (trace_partition == NULL)
+    {
+        ESP_LOGW(TAG, "No '%s' partition, sensor trace disabled",
+                 NODE_TRACE_PARTITION_LABEL);
+    }
+}
+
+/**
+ * Write the block to flash, stop recording when the partition is full.
+ *
+ * Caller holds trace_lock.
+*/
+static void
+node_trace_flush()
+{
+    uint32_t size = trace_block_count * sizeof(node_trace_record_t);
+    if (size == 0)
+    {
+        return;
+    }
+
+    if (trace_offset + size > trace_partition->size)
+    {
+        ESP_LOGW(TAG, "Trace partition is full, recording stopped");
+        trace_recording = false;
+        trace_dropped += trace_block_count;
+    }
+    else if (esp_partition_write(trace_partition, trace_offset, trace_block, size) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Trace write failed at %u, recording stopped", trace_offset);
+        trace_recording = false;
+        trace_dropped += trace_block_count;
+    }
+    else
+    {
+        trace_offset += size;
+    }
+    trace_block_count = 0;
+}
+
+/**
+ * Add the record to the block.
+ *
+ * Caller holds trace_lock.
+*/
+static void
+node_trace_put(const node_trace_record_t *record)
+{
+    trace_block[trace_block_count++] = *record;
+    ++trace_records;
+    if (trace_block_count == NODE_TRACE_BLOCK_RECORDS)
+    {
+        node_trace_flush();
+    }
+}
+
+/**
+ * Append the record, fill timestamp.
+*/
+static void
+node_trace_append(node_trace_record_t *record)
+{
+    if (!trace_recording)
+    {
+        return;
+    }
+
+    record->time_ms = (esp_timer_get_time() - trace_start_us) / 1000;
+
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    if (trace_recording)
+    {
+        node_trace_put(record);
+    }
+    xSemaphoreGive(trace_lock);
+}
+
+bool
+node_trace_recording()
+{
+    return trace_recording;
+}
+
+void
+node_trace_1wire_device(uint8_t index, const uint8_t rom_code[8])
+{
+    node_trace_record_t record = {
+        .type = NODE_TRACE_1WIRE_DEVICE,
+        .channel = index
+    };
+    memcpy(record.rom_code, rom_code, sizeof(record.rom_code));
+    node_trace_append(&record);
+}
+
+void
+node_trace_1wire_temp(uint8_t index, int16_t error, float temperature)
+{
+    node_trace_record_t record = {
+        .type = NODE_TRACE_1WIRE_TEMP,
+        .channel = index,
+        .status = error,
+        .temperature = temperature
+    };
+    node_trace_append(&record);
+}
+
+void
+node_trace_adc(uint8_t channel, uint32_t raw, uint32_t voltage_mv)
+{
+    node_trace_record_t record = {
+        .type = NODE_TRACE_ADC,
+        .channel = channel,
+        .adc = { .raw = raw, .voltage_mv = voltage_mv }
+    };
+    node_trace_append(&record);
+}
+
+void
+node_trace_adc_lut(uint8_t channel, const uint16_t *lut)
+{
+    for (int index = 0; index < SENSORS_MOISTURE_LUT_SIZE; index += NODE_TRACE_LUT_ENTRIES)
+    {
+        node_trace_record_t record = {
+            .type = NODE_TRACE_ADC_LUT,
+            .channel = channel,
+            .status = index
+        };
+        memcpy(record.lut, lut + index, sizeof(record.lut));
+        node_trace_append(&record);
+    }
+}
+
+/**
+ * Declare a device found before the trace started.
+ *
+ * Caller holds trace_lock, recording is not started yet.
+*/
+static void
+node_trace_put_device(uint8_t index, const uint8_t rom_code[8])
+{
+    node_trace_record_t record = {
+        .type = NODE_TRACE_1WIRE_DEVICE,
+        .channel = index
+    };
+    memcpy(record.rom_code, rom_code, sizeof(record.rom_code));
+    node_trace_put(&record);
+}
+
+/**
+ * Record ADC conversion table built before the trace started.
+ *
+ * Caller holds trace_lock, recording is not started yet.
+*/
+static void
+node_trace_put_adc_lut(uint8_t channel, const uint16_t *lut)
+{
+    for (int index = 0; index < SENSORS_MOISTURE_LUT_SIZE; index += NODE_TRACE_LUT_ENTRIES)
+    {
+        node_trace_record_t record = {
+            .type = NODE_TRACE_ADC_LUT,
+            .channel = channel,
+            .status = index
+        };
+        memcpy(record.lut, lut + index, sizeof(record.lut));
+        node_trace_put(&record);
+    }
+}
+
+bool
+node_sensors_trace_start()
+{
+    if (trace_partition == NULL || trace_recording)
+    {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Erasing %u bytes", trace_partition->size);
+    if (esp_partition_erase_range(trace_partition, 0, trace_partition->size) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot erase trace partition");
+        return false;
+    }
+
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    const node_trace_header_t header = {
+        .magic = NODE_TRACE_MAGIC,
+        .version = NODE_TRACE_VERSION,
+        .record_size = sizeof(node_trace_record_t)
+    };
+    memcpy(&trace_block[0], &header, sizeof(header));
+    trace_block_count = 1;
+    trace_offset = 0;
+    trace_records = 0;
+    trace_dropped = 0;
+    trace_start_us = esp_timer_get_time();
+    // Devices are declared at discovery, the ones found earlier go first
+    // so their readings replay
+    sensors_1wire_enum_devices(&node_trace_put_device);
+    sensors_adc_enum_luts(&node_trace_put_adc_lut);
+    trace_recording = true;
+    xSemaphoreGive(trace_lock);
+    return true;
+}
+
+void
+node_sensors_trace_stop()
+{
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    if (trace_recording)
+    {
+        node_trace_flush();
+        trace_recording = false;
+    }
+    xSemaphoreGive(trace_lock);
+}
+
+void
+node_sensors_trace_get_status(node_sensors_trace_status_t *status)
+{
+    xSemaphoreTake(trace_lock, portMAX_DELAY);
+    status->recording = trace_recording;
+    status->records = trace_records;
+    status->dropped = trace_dropped;
+    status->size = trace_offset + trace_block_count * sizeof(node_trace_record_t);
+    status->capacity = trace_partition != NULL ? trace_partition->size : 0;
+    xSemaphoreGive(trace_lock);
+}
+
+int
+node_sensors_trace_read(uint32_t offset, void *buffer, uint32_t size)
+{
+    if (trace_partition == NULL || trace_recording)
+    {
+        return -1;
+    }
+
+    if (offset >= trace_offset)
+    {
+        return 0;
+    }
+
+    if (size > trace_offset - offset)
+    {
+        size = trace_offset - offset;
+    }
+
+    if (esp_partition_read(trace_partition, offset, buffer, size) != ESP_OK)
+    {
+        return -1;
+    }
+    return size;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+/**
+ * Sensor trace recorder: raw driver outputs recorded for later replay.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include "node_trace_format.h"
+
+#if CONFIG_NODE_SENSORS_TRACE
+/**
+ * Find trace partition, called from node_sensors_start().
+*/
+void
+node_trace_init();
+
+/**
+ * Check whether recording is in progress.
+ *
+ * Lets drivers skip preparing data which is only needed for the trace.
+*/
+bool
+node_trace_recording();
+
+/**
+ * Record 1-wire device found at discovery.
+*/
+void
+node_trace_1wire_device(uint8_t index, const uint8_t rom_code[8]);
+
+/**
+ * Record DS18B20 temperature reading.
+*/
+void
+node_trace_1wire_temp(uint8_t index, int16_t error, float temperature);
+
+/**
+ * Record ADC reading.
+*/
+void
+node_trace_adc(uint8_t channel, uint32_t raw, uint32_t voltage_mv);
+
+/**
+ * Record ADC conversion table, raw counts to moisture.
+ *
+ * Replay converts raw counts recorded later with the table, same as the
+ * driver does.
+*/
+void
+node_trace_adc_lut(uint8_t channel, const uint16_t *lut);
+#else
+static inline bool
+node_trace_recording() { return false; }
+
+static inline void
+node_trace_1wire_device(uint8_t index, const uint8_t rom_code[8]) {}
+
+static inline void
+node_trace_1wire_temp(uint8_t index, int16_t error, float temperature) {}
+
+static inline void
+node_trace_adc(uint8_t channel, uint32_t raw, uint32_t voltage_mv) {}
+
+static inline void
+node_trace_adc_lut(uint8_t channel, const uint16_t *lut) {}
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+/**
+ * Diagnostics of the Node.
+ *
+ * Components register providers, which report their metrics as named
+ * JSON objects.  Network layer periodically collects the metrics and
+ * publishes them on diagnostics topics.
+*/
+#include <stdbool.h>
+
+/**
+ * Constants for diagnostics.
+*/
+enum node_diag_const
+{
+    NODE_DIAG_MAX_PROVIDERS = 8,    /**< Providers limit */
+    NODE_DIAG_MAX_NAME_LEN = 48,    /**< Metric name length limit */
+    NODE_DIAG_MAX_DATA_LEN = 128    /**< Metric data length limit */
+};
+
+/**
+ * Report one metric.
+ *
+ * @name    metric name, used as the last part of the topic
+ * @data    metric value, JSON text
+*/
+typedef void (*node_diag_emit_t)(const char *name, const char *data);
+
+/**
+ * Diagnostics provider reports its metrics calling emit function.
+*/
+typedef void (*node_diag_provider_t)(node_diag_emit_t emit);
+
+/**
+ * Register diagnostics provider.
+ *
+ * @return true if registered, false if providers table is full.
+*/
+bool
+node_diag_register(node_diag_provider_t provider);
+
+/**
+ * Collect metrics from all providers.
+*/
+void
+node_diag_collect(node_diag_emit_t emit);
@@ -0,0 +1,94 @@
+#pragma once
+/**
+ * Histograms.
+ *
+ * Fixed-bucket histogram counts values in buckets separated by
+ * caller-provided bounds.  Logarithmic histogram covers the whole
+ * uint32_t range with bounded relative error and is used for percentiles
+ * of latencies.  Minimum, maximum and sum are tracked as well.
+ *
+ * Histograms are not thread-safe, caller is responsible for locking.
+*/
+#include <stdint.h>
+
+/**
+ * Constants for histogram.
+*/
+enum node_hist_const
+{
+    NODE_HIST_BUCKETS = 9,          /**< Number of buckets */
+    NODE_LOG_HIST_SUB_BITS = 2,     /**< Log2 of buckets per power of two */
+    NODE_LOG_HIST_BUCKETS = (32 - NODE_LOG_HIST_SUB_BITS + 1) << NODE_LOG_HIST_SUB_BITS
+                                    /**< Number of logarithmic buckets */
+};
+
+/**
+ * Histogram of integer values.
+*/
+typedef struct node_hist
+{
+    const int32_t *bounds;  /**< NODE_HIST_BUCKETS-1 ascending bucket upper bounds */
+    uint32_t count;         /**< Number of values */
+    int32_t min;            /**< Minimal value */
+    int32_t max;            /**< Maximal value */
+    int64_t sum;            /**< Sum of values */
+    uint32_t buckets[NODE_HIST_BUCKETS]; /**< Bucket counters */
+} node_hist_t;
+
+/**
+ * Bounds for deviation of interval from nominal, microseconds.
+*/
+extern const int32_t NODE_HIST_DEVIATION_BOUNDS_US[NODE_HIST_BUCKETS - 1];
+
+/**
+ * Initialize empty histogram.
+ *
+ * @hist    histogram
+ * @bounds  NODE_HIST_BUCKETS-1 ascending bucket upper bounds, value
+ *          goes to the first bucket which bound is greater than value.
+*/
+void
+node_hist_init(node_hist_t *hist, const int32_t *bounds);
+
+/**
+ * Add value to histogram.
+*/
+void
+node_hist_add(node_hist_t *hist, int32_t value);
+
+/**
+ * Logarithmic histogram of unsigned values.
+ *
+ * Each power of two is split in 2^NODE_LOG_HIST_SUB_BITS buckets, so the
+ * relative error of percentiles does not exceed 25%.
+*/
+typedef struct node_log_hist
+{
+    uint32_t count;         /**< Number of values */
+    uint32_t max;           /**< Maximal value */
+    uint64_t sum;           /**< Sum of values */
+    uint32_t buckets[NODE_LOG_HIST_BUCKETS]; /**< Bucket counters */
+} node_log_hist_t;
+
+/**
+ * Initialize empty logarithmic histogram.
+*/
+void
+node_log_hist_init(node_log_hist_t *hist);
+
+/**
+ * Add value to logarithmic histogram.
+*/
+void
+node_log_hist_add(node_log_hist_t *hist, uint32_t value);
+
+/**
+ * Estimate percentile.
+ *
+ * @hist        histogram
+ * @permille    percentile in 1/1000 (e.g. 990 for p99)
+ * @return upper bound of the bucket containing the percentile, limited
+ *         by the maximal value; 0 for empty histogram.
+*/
+uint32_t
+node_log_hist_percentile(const node_log_hist_t *hist, unsigned permille);
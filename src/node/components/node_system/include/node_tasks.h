@@ -0,0 +1,82 @@
+#pragma once
+/**
+ * Central table of the Node tasks.
+ *
+ * All tasks of the Node are created statically from the table, which
+ * defines priority and core affinity of each task.  Stack is owned and
+ * sized by the component running the task.  Stack high-water marks are
+ * tracked for diagnostics.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * Identifiers of the Node tasks.
+*/
+typedef enum node_task_id
+{
+    NODE_TASK_MQTT,     /**< MQTT publisher */
+    NODE_TASK_DIAG,     /**< Diagnostics publisher */
+    NODE_TASK_1WIRE,    /**< 1-wire sensors sampler */
+    NODE_TASK_ADC,      /**< ADC sensors sampler */
+    NODE_TASK_SIM,      /**< Simulated sensors sampler */
+    NODE_TASK_REPLAY,   /**< Sensor trace replay */
+    NODE_TASK_HISTORY,  /**< History writer */
+    NODE_TASK_REMOTE,   /**< Remote console commands */
+    NODE_TASK_CONTROL,  /**< PID control loop */
+    NODE_TASK_COUNT     /**< Number of tasks in the table */
+} node_task_id_t;
+
+/**
+ * Task information.
+*/
+typedef struct node_task_info
+{
+    const char *name;       /**< Task name */
+    uint32_t stack_size;    /**< Stack size, bytes */
+    uint32_t stack_hwm;     /**< Minimal free stack observed, bytes */
+    UBaseType_t priority;   /**< Task priority */
+    BaseType_t core;        /**< Core affinity (tskNO_AFFINITY if not pinned) */
+    bool running;           /**< Task has been started */
+} node_task_info_t;
+
+/**
+ * Create the task from the table.
+ *
+ * @id          task identifier
+ * @func        task function
+ * @arg         task function argument
+ * @stack       static stack buffer of the task
+ * @stack_size  stack size, bytes
+ * @return task handle, NULL if task is already running
+*/
+TaskHandle_t
+node_task_start(node_task_id_t id,
+                TaskFunction_t func,
+                void *arg,
+                StackType_t *stack,
+                uint32_t stack_size);
+
+/**
+ * Delete the calling task and mark it as not running.
+ *
+ * Tasks started from the table must exit with this function, not
+ * vTaskDelete(), so their table entry does not refer to a deleted task.
+ *
+ * @id      identifier of the calling task
+*/
+void
+node_task_exit(node_task_id_t id);
+
+/**
+ * Get task information.
+ *
+ * Updates and returns stack high-water mark of running task.
+ *
+ * @id      task identifier
+ * @info    structure to be filled
+*/
+void
+node_task_get_info(node_task_id_t id, node_task_info_t *info);
@@ -0,0 +1,66 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "node_diag.h"
+#include "node_tasks.h"
+
+static node_diag_provider_t diag_providers[NODE_DIAG_MAX_PROVIDERS];
+static int diag_providers_count = 0;
+static portMUX_TYPE diag_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Built-in provider: stack usage of the Node tasks.
+*/
+static void
+node_diag_tasks(node_diag_emit_t emit)
+{
+    for (int id = 0; id < NODE_TASK_COUNT; ++id)
+    {
+        node_task_info_t info;
+        node_task_get_info(id, &info);
+        if (!info.running)
+        {
+            continue;
+        }
+
+        char name[NODE_DIAG_MAX_NAME_LEN];
+        char data[NODE_DIAG_MAX_DATA_LEN];
+        snprintf(name, sizeof(name), "tasks/%s", info.name);
+        snprintf(data,
+                 sizeof(data),
+                 "{\"stack\": %" PRIu32 ", \"hwm\": %" PRIu32 ", \"prio\": %u, \"core\": %d}",
+                 info.stack_size,
+                 info.stack_hwm,
+                 (unsigned)info.priority,
+                 info.core == tskNO_AFFINITY ? -1 : (int)info.core);
+        emit(name, data);
+    }
+}
+
+bool
+node_diag_register(node_diag_provider_t provider)
+{
+    bool registered = false;
+
+    portENTER_CRITICAL(&diag_lock);
+    if (diag_providers_count < NODE_DIAG_MAX_PROVIDERS)
+    {
+        diag_providers[diag_providers_count++] = provider;
+        registered = true;
+    }
+    portEXIT_CRITICAL(&diag_lock);
+
+    return registered;
+}
+
+void
+node_diag_collect(node_diag_emit_t emit)
+{
+    node_diag_tasks(emit);
+
+    /* Providers are never removed, so the table may be walked unlocked. */
+    for (int n = 0; n < diag_providers_count; ++n)
+    {
+        diag_providers[n](emit);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include <string.h>
+#include "node_hist.h"
+
+const int32_t NODE_HIST_DEVIATION_BOUNDS_US[NODE_HIST_BUCKETS - 1] =
+{
+    -100000, -20000, -5000, -1000, 1000, 5000, 20000, 100000
+};
+
+void
+node_hist_init(node_hist_t *hist, const int32_t *bounds)
+{
+    memset(hist, 0, sizeof(*hist));
+    hist->bounds = bounds;
+    hist->min = INT32_MAX;
+    hist->max = INT32_MIN;
+}
+
+void
+node_hist_add(node_hist_t *hist, int32_t value)
+{
+    int bucket = 0;
+    while (bucket < NODE_HIST_BUCKETS - 1 && value >= hist->bounds[bucket])
+    {
+        ++bucket;
+    }
+
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->sum += value;
+    hist->min = value < hist->min ? value : hist->min;
+    hist->max = value > hist->max ? value : hist->max;
+}
+
+static int
+node_log_hist_bucket(uint32_t value)
+{
+    const uint32_t sub_count = 1u << NODE_LOG_HIST_SUB_BITS;
+    if (value < sub_count)
+    {
+        return value;
+    }
+
+    int msb = 31 - __builtin_clz(value);
+    int sub = (value >> (msb - NODE_LOG_HIST_SUB_BITS)) & (sub_count - 1);
+    return ((msb - NODE_LOG_HIST_SUB_BITS + 1) << NODE_LOG_HIST_SUB_BITS) + sub;
+}
+
+static uint32_t
+node_log_hist_upper(int bucket)
+{
+    const int sub_count = 1 << NODE_LOG_HIST_SUB_BITS;
+    if (bucket < sub_count)
+    {
+        return bucket;
+    }
+
+    int msb = (bucket >> NODE_LOG_HIST_SUB_BITS) - 1 + NODE_LOG_HIST_SUB_BITS;
+    uint64_t lower = (uint64_t)(sub_count + (bucket & (sub_count - 1)))
+                     << (msb - NODE_LOG_HIST_SUB_BITS);
+    uint64_t upper = lower + ((uint64_t)1 << (msb - NODE_LOG_HIST_SUB_BITS)) - 1;
+    return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+void
+node_log_hist_init(node_log_hist_t *hist)
+{
+    memset(hist, 0, sizeof(*hist));
+}
+
+void
+node_log_hist_add(node_log_hist_t *hist, uint32_t value)
+{
+    hist->buckets[node_log_hist_bucket(value)]++;
+    hist->count++;
+    hist->sum += value;
+    hist->max = value > hist->max ? value : hist->max;
+}
+
+uint32_t
+node_log_hist_percentile(const node_log_hist_t *hist, unsigned permille)
+{
+    if (hist->count == 0)
+    {
+        return 0;
+    }
+
+    /* Rank of the percentile value, 1-based. */
+    uint64_t rank = ((uint64_t)hist->count * permille + 999) / 1000;
+    rank = rank > 0 ? rank : 1;
+
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < NODE_LOG_HIST_BUCKETS; ++bucket)
+    {
+        seen += hist->buckets[bucket];
+        if (seen >= rank)
+        {
+            uint32_t upper = node_log_hist_upper(bucket);
+            return upper < hist->max ? upper : hist->max;
+        }
+    }
+    return hist->max;
+}
\ No newline at end of file
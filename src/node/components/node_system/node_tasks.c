@@ -0,0 +1,171 @@
+#include <assert.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "node_tasks.h"
+
+#if CONFIG_FREERTOS_UNICORE
+#define NODE_TASK_CORE(core) ((core) < 0 ? tskNO_AFFINITY : 0)
+#else
+#define NODE_TASK_CORE(core) ((core) < 0 ? tskNO_AFFINITY : (core))
+#endif
+
+static const char *TAG = "tasks";
+
+/** Guards task handles, a task may exit while its info is taken. */
+static portMUX_TYPE node_tasks_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Task table entry.
+*/
+typedef struct node_task
+{
+    const char *name;       /**< Task name */
+    StackType_t *stack;     /**< Stack buffer, supplied at start */
+    uint32_t stack_size;    /**< Stack size, bytes */
+    UBaseType_t priority;   /**< Task priority */
+    BaseType_t core;        /**< Core affinity */
+    StaticTask_t tcb;       /**< Task control block */
+    TaskFunction_t func;    /**< Task function, supplied at start */
+    void *arg;              /**< Task function argument */
+    bool active;            /**< Started and not exited */
+    TaskHandle_t handle;    /**< Task handle, set by the task itself, NULL if not running */
+} node_task_t;
+
+static node_task_t node_tasks[NODE_TASK_COUNT] =
+{
+    [NODE_TASK_MQTT] = {
+        .name = "mqtt_task",
+        .priority = CONFIG_NODE_TASK_MQTT_PRIORITY,
+        .core = NODE_TASK_CORE(CONFIG_NODE_TASK_NETWORK_CORE)
+    },
+    [NODE_TASK_DIAG] = {
+        .name = "diag_task",
+        .priority = CONFIG_NODE_TASK_DIAG_PRIORITY,
+        .core = NODE_TASK_CORE(CONFIG_NODE_TASK_NETWORK_CORE)
+    },
+    [NODE_TASK_1WIRE] = {
+        .name = "1wire_task",
+        .priority = CONFIG_NODE_TASK_SENSORS_PRIORITY,
+        .core = NODE_TASK_CORE(CONFIG_NODE_TASK_SENSORS_CORE)
+    },
+    [NODE_TASK_ADC] = {
+        .name = "adc_task",
+        .priority = CONFIG_NODE_TASK_SENSORS_PRIORITY,
+        .core = NODE_TASK_CORE(CONFIG_NODE_TASK_SENSORS_CORE)
+    },
+    [NODE_TASK_SIM] = {
+        .name = "sim_task",
+        .priority = CONFIG_NODE_TASK_SENSORS_PRIORITY,
+        .core = NODE_TASK_CORE(CONFIG_NODE_TASK_SENSORS_CORE)
+    },
+    [NODE_TASK_REPLAY] = {
+        .name = "replay_task",
+        .priority = CONFIG_NODE_TASK_SENSORS_PRIORITY,
+        .core = NODE_TASK_CORE(CONFIG_NODE_TASK_SENSORS_CORE)
+    },
+    [NODE_TASK_HISTORY] = {
+        .name = "history_task",
+        .priority = CONFIG_NODE_TASK_HISTORY_PRIORITY,
+        .core = NODE_TASK_CORE(CONFIG_NODE_TASK_NETWORK_CORE)
+    },
+    [NODE_TASK_REMOTE] = {
+        .name = "remote_task",
+        .priority = CONFIG_NODE_TASK_REMOTE_PRIORITY,
+        .core = NODE_TASK_CORE(CONFIG_NODE_TASK_NETWORK_CORE)
+    },
+    [NODE_TASK_CONTROL] = {
+        .name = "control_task",
+        .priority = CONFIG_NODE_TASK_CONTROL_PRIORITY,
+        .core = NODE_TASK_CORE(CONFIG_NODE_TASK_SENSORS_CORE)
+    }
+};
+
+/**
+ * Entry point of every table task.
+ *
+ * The task publishes its own handle before running, so a task which
+ * preempts its creator and exits at once does not leave a stale handle.
+*/
+static void
+node_task_entry(void *arg)
+{
+    node_task_t *task = (node_task_t *)arg;
+    portENTER_CRITICAL(&node_tasks_lock);
+    task->handle = xTaskGetCurrentTaskHandle();
+    portEXIT_CRITICAL(&node_tasks_lock);
+    task->func(task->arg);
+}
+
+TaskHandle_t
+node_task_start(node_task_id_t id,
+                TaskFunction_t func,
+                void *arg,
+                StackType_t *stack,
+                uint32_t stack_size)
+{
+    assert(id < NODE_TASK_COUNT);
+    node_task_t *task = &node_tasks[id];
+
+    portENTER_CRITICAL(&node_tasks_lock);
+    bool active = task->active;
+    task->active = true;
+    portEXIT_CRITICAL(&node_tasks_lock);
+    if (active)
+    {
+        ESP_LOGE(TAG, "Task %s is already running", task->name);
+        return NULL;
+    }
+
+    task->stack = stack;
+    task->stack_size = stack_size;
+    task->func = func;
+    task->arg = arg;
+
+    TaskHandle_t handle = xTaskCreateStaticPinnedToCore(&node_task_entry,
+                                                        task->name,
+                                                        task->stack_size,
+                                                        task,
+                                                        task->priority,
+                                                        task->stack,
+                                                        &task->tcb,
+                                                        task->core);
+    if (handle == NULL)
+    {
+        portENTER_CRITICAL(&node_tasks_lock);
+        task->active = false;
+        portEXIT_CRITICAL(&node_tasks_lock);
+    }
+    return handle;
+}
+
+void
+node_task_exit(node_task_id_t id)
+{
+    assert(id < NODE_TASK_COUNT);
+    node_task_t *task = &node_tasks[id];
+
+    portENTER_CRITICAL(&node_tasks_lock);
+    task->handle = NULL;
+    task->active = false;
+    portEXIT_CRITICAL(&node_tasks_lock);
+    vTaskDelete(NULL);
+}
+
+void
+node_task_get_info(node_task_id_t id, node_task_info_t *info)
+{
+    assert(id < NODE_TASK_COUNT);
+    const node_task_t *task = &node_tasks[id];
+
+    info->name = task->name;
+    info->stack_size = task->stack_size;
+    info->priority = task->priority;
+    info->core = task->core;
+    portENTER_CRITICAL(&node_tasks_lock);
+    info->running = task->handle != NULL;
+    info->stack_hwm = info->running
+                      ? uxTaskGetStackHighWaterMark(task->handle)
+                      : task->stack_size;
+    portEXIT_CRITICAL(&node_tasks_lock);
+}
\ No newline at end of file
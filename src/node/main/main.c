@@ -2,6 +2,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "node_console.h"
+#include "node_history.h"
 #include "node_network.h"
 #include "node_sensors.h"
 #include "nvs_flash.h"
@@ -28,6 +29,13 @@ void app_main(void)
     ESP_LOGW(tag, "Network requires WiFi credentials");
   }
 
+#if CONFIG_NODE_HISTORY
+  if (!node_history_start())
+  {
+    ESP_LOGW(tag, "History is not available");
+  }
+#endif
+
   node_sensors_start();
 
   console_run();